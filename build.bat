@@ -1,3 +1,14 @@
+clang-cl -D_CRT_SECURE_NO_WARNINGS tools/sid_gen.c -o sid_gen.exe /link setargv.obj || exit /b 1
+sid_gen.exe src\string_id_gen.h src\*.c src\*.h src\*.inl || exit /b 1
+sid_gen.exe --blob res\strings.sid src\*.c src\*.h src\*.inl ^
+--names res\shaders\* res\meshes\* res\textures\* res\fonts\* || exit /b 1
+clang-cl -D_CRT_SECURE_NO_WARNINGS tools/mesh_conv.c src/resources.c src/memory.c src/gpu.c src/GL/gl3w.c -o mesh_conv.exe /link opengl32.lib || exit /b 1
+clang-cl -D_CRT_SECURE_NO_WARNINGS tools/pak_gen.c src/lz.c -o pak_gen.exe /link setargv.obj || exit /b 1
+set PAK_TRACE=
+if exist load.trace set PAK_TRACE=--trace load.trace
+pak_gen.exe %PAK_TRACE% data.pak res\shaders\* res\meshes\* res\textures\* res\fonts\* res\strings.sid || exit /b 1
+clang-cl /O2 -D_CRT_SECURE_NO_WARNINGS tools/bench.c src/memory.c src/string_id.c src/jobs.c src/graphics.c src/gpu.c src/resources.c src/math.c src/GL/gl3w.c src/file.c src/lz.c src/resources_storage.c -o bench.exe /link opengl32.lib || exit /b 1
+
 clang-cl -Zi -O0 ^
 -D_CRT_SECURE_NO_WARNINGS ^
 -Wall -Werror -Wno-unknown-pragmas -Wno-macro-redefined -Wno-unused-parameter ^
@@ -15,6 +26,9 @@ src/graphics.c ^
 src/camera.c ^
 src/scene.c ^
 src/string_id.c ^
+src/jobs.c ^
+src/lz.c ^
+src/watch.c ^
 src/resources_storage.c ^
 src/GL/gl3w.c ^
 -o main ^
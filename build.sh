@@ -1,3 +1,14 @@
+clang-3.9 -std=c11 -Wall -Werror tools/sid_gen.c -o sid_gen && \
+./sid_gen src/string_id_gen.h src/*.c src/*.h src/*.inl && \
+./sid_gen --blob res/strings.sid src/*.c src/*.h src/*.inl \
+      --names $(find res -type f ! -name strings.sid) && \
+clang-3.9 -std=c11 -Wall -Werror tools/mesh_conv.c src/resources.c src/memory.c src/gpu.c src/GL/gl3w.c \
+      -o mesh_conv -lm -ldl && \
+clang-3.9 -std=c11 -Wall -Werror tools/pak_gen.c src/lz.c -o pak_gen && \
+./pak_gen $([ -f load.trace ] && echo --trace load.trace) data.pak $(find res -type f) && \
+clang-3.9 -O2 -std=c11 -Wall -Werror tools/bench.c src/memory.c src/string_id.c src/jobs.c \
+      src/graphics.c src/gpu.c src/resources.c src/math.c src/GL/gl3w.c \
+      src/file.c src/lz.c src/resources_storage.c -o bench -lm -ldl -lpthread && \
 clang-3.9 -g -Wall -Werror -std=c11 -I../src -fno-exceptions -ferror-limit=1 \
       src/main.c \
       src/math.c \
@@ -10,6 +21,9 @@ clang-3.9 -g -Wall -Werror -std=c11 -I../src -fno-exceptions -ferror-limit=1 \
       src/camera.c \
       src/scene.c \
       src/string_id.c \
+      src/jobs.c \
+      src/lz.c \
+      src/watch.c \
       src/resources_storage.c \
       src/GL/gl3w.c \
-      -o main -lSDL2 -lGL -ldl -lm
+      -o main -lSDL2 -lGL -ldl -lm -lpthread
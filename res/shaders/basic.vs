@@ -1,20 +1,35 @@
 #version 330
 
 layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal;
+layout(location = 1) in vec3 normal; // xy only when octahedral
 layout(location = 2) in vec3 texcoord;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Quantized vertices, see gpu_pack_verts_quantized.
+uniform vec3 position_scale;
+uniform vec3 position_bias;
+uniform int octahedral_normals;
+
 out vec3 pos;
 out vec3 norm;
 out vec2 tex;
+
+vec3 decode_oct(vec2 e)
+{
+  vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return normalize(n);
+}
+
 void main()
 {
-  pos = position;
-  norm = normal;
+  pos = position*position_scale + position_bias;
+  norm = octahedral_normals != 0 ? decode_oct(normal.xy) : normal;
   tex = texcoord.xy;
-  gl_Position = projection*view*model*vec4(position.xyz, 1.0f);
+  gl_Position = projection*view*model*vec4(pos, 1.0f);
 }
@@ -1,7 +1,40 @@
+// madvise and fseeko are hidden by -std=c11 otherwise.
+#define _DEFAULT_SOURCE
+
 #include "file.h"
+#include "jobs.h"
+#include "lz.h"
+#include "string_id.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define FILE_MAX_PATH 512
+
+static file_free_fptr file_free = NULL;
+static file_realloc_fptr file_realloc = NULL;
+
+void file_set_mem(file_free_fptr f, file_realloc_fptr r)
+{
+    file_free = f;
+    file_realloc = r;
+}
+
+// Looks the path up in the mounts. Gives either the source in memory, or the
+// path of the file on disk in os_path, which holds FILE_MAX_PATH.
+static enum file_status resolve(const char* path, struct file_source* src, char* os_path);
+// Copies or decompresses a source in memory into dst, which holds its size.
+static enum file_status pak_read(const struct file_source* src, uint8_t* dst);
+
+// Handles of mappings of sources in memory: views of stored ones, and
+// decompressed copies of the others.
+static uint8_t source_view;
+static uint8_t source_copy;
+
+// Record what is loaded while tracing, see file_trace_begin.
+static uint32_t trace_path(const char* path);
+static void trace_range(uint32_t path, uint64_t offset, uint64_t size);
 
 enum file_status file_load_text(const char* path, const char** buf,
                                 uint32_t* size)
@@ -10,14 +43,39 @@ enum file_status file_load_text(const char* path, const char** buf,
     char* b = 0;
     uint32_t s = 0;
 
-    f = fopen(path, "rb");
+    char os_path[FILE_MAX_PATH];
+    struct file_source src;
+    if (resolve(path, &src, os_path) != FILE_OK)
+        goto error;
+
+    if (src.data) {
+        if (src.size >= UINT32_MAX)
+            goto error;
+
+        s = (uint32_t)src.size;
+        b = file_realloc((void*)*buf, s + 1);
+        if (!b)
+            goto error;
+
+        if (pak_read(&src, (uint8_t*)b) != FILE_OK)
+            goto error;
+        b[s] = '\0';
+
+        *buf = b;
+        *size = s;
+
+        trace_range(trace_path(path), 0, s);
+        return FILE_OK;
+    }
+
+    f = fopen(os_path, "rb");
     if (!f)
         goto error;
 
     fseek(f, 0, SEEK_END);
     s = ftell(f);
 
-    b = realloc((void*)*buf, s + 1);
+    b = file_realloc((void*)*buf, s + 1);
     if (!b)
         goto error;
 
@@ -31,12 +89,13 @@ enum file_status file_load_text(const char* path, const char** buf,
     *buf = b;
     *size = s;
 
+    trace_range(trace_path(path), 0, s);
     return FILE_OK;
 
 error:
     if (f)
         fclose(f);
-    free(b);
+    file_free(b);
     *buf = 0;
     *size = 0;
 
@@ -45,7 +104,7 @@ error:
 
 void file_unload_text(const char** buf)
 {
-    free((void*)*buf);
+    file_free((void*)*buf);
     *buf = 0;
 }
 
@@ -74,14 +133,37 @@ enum file_status file_load_binary(const char* path, uint8_t** buf,
     FILE* f = 0;
     uint8_t* b = 0;
 
-    f = fopen(path, "rb");
+    char os_path[FILE_MAX_PATH];
+    struct file_source src;
+    if (resolve(path, &src, os_path) != FILE_OK)
+        goto error;
+
+    if (src.data) {
+        if (src.size > UINT32_MAX)
+            goto error;
+
+        b = (uint8_t*)file_realloc((void*)*buf, (size_t)src.size);
+        if (!b)
+            goto error;
+
+        if (pak_read(&src, b) != FILE_OK)
+            goto error;
+
+        *buf = b;
+        *size = (uint32_t)src.size;
+
+        trace_range(trace_path(path), 0, src.size);
+        return FILE_OK;
+    }
+
+    f = fopen(os_path, "rb");
     if (!f)
         goto error;
 
     fseek(f, 0, SEEK_END);
 
     uint32_t s = ftell(f);
-    b = (uint8_t*)realloc((void*)*buf, s);
+    b = (uint8_t*)file_realloc((void*)*buf, s);
     if (!b)
         goto error;
 
@@ -94,12 +176,13 @@ enum file_status file_load_binary(const char* path, uint8_t** buf,
     *buf = b;
     *size = s;
 
+    trace_range(trace_path(path), 0, s);
     return FILE_OK;
 
 error:
     if (f)
         fclose(f);
-    free(b);
+    file_free(b);
     *buf = 0;
     *size = 0;
 
@@ -128,6 +211,1594 @@ error:
 
 void file_unload_binary(uint8_t** buf)
 {
-    free(*buf);
+    file_free(*buf);
     *buf = 0;
 }
+
+// ---- Mapping ----------------------------------------------------------------
+
+#if defined(_WIN32)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// The access hint is given when the file is opened, views into a pak get
+// none.
+static void advise(const uint8_t* data, uint64_t size, enum file_access access)
+{
+    (void)data;
+    (void)size;
+    (void)access;
+}
+
+static enum file_status map_file(const char* path, enum file_access access,
+                                 struct file_mapping* mapping)
+{
+    *mapping = (struct file_mapping){};
+
+    DWORD flags = access == FILE_ACCESS_SEQUENTIAL ? FILE_FLAG_SEQUENTIAL_SCAN
+                                                   : FILE_FLAG_RANDOM_ACCESS;
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0,
+                           OPEN_EXISTING, flags, 0);
+    if (f == INVALID_HANDLE_VALUE)
+        return FILE_FAILURE;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size))
+        goto error;
+
+    if (size.QuadPart == 0) {
+        CloseHandle(f);
+        return FILE_OK;
+    }
+
+    HANDLE m = CreateFileMappingA(f, 0, PAGE_READONLY, 0, 0, 0);
+    if (!m)
+        goto error;
+
+    const uint8_t* data = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(m);
+        goto error;
+    }
+
+    // The view keeps the file open.
+    CloseHandle(f);
+
+    mapping->data = data;
+    mapping->size = (uint64_t)size.QuadPart;
+    mapping->handle = m;
+
+    return FILE_OK;
+
+error:
+    CloseHandle(f);
+    return FILE_FAILURE;
+}
+
+static void unmap_file(struct file_mapping* mapping)
+{
+    if (mapping->data) {
+        UnmapViewOfFile(mapping->data);
+        CloseHandle(mapping->handle);
+    }
+
+    *mapping = (struct file_mapping){};
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Only hints, failing them is harmless.
+static void advise(const uint8_t* data, uint64_t size, enum file_access access)
+{
+    if (size == 0)
+        return;
+
+    // Pak entries start on FILE_PAK_ALIGN, which may be below the page size.
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)data & ~(page - 1);
+    size_t len = (size_t)((uintptr_t)data - start + size);
+
+    madvise((void*)start, len,
+            access == FILE_ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+    if (access == FILE_ACCESS_SEQUENTIAL)
+        madvise((void*)start, len, MADV_WILLNEED);
+}
+
+static enum file_status map_file(const char* path, enum file_access access,
+                                 struct file_mapping* mapping)
+{
+    *mapping = (struct file_mapping){};
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return FILE_FAILURE;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        goto error;
+
+    if (st.st_size == 0) {
+        close(fd);
+        return FILE_OK;
+    }
+
+    void* data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        goto error;
+
+    // The mapping keeps the file open.
+    close(fd);
+
+    advise(data, (uint64_t)st.st_size, access);
+
+    mapping->data = data;
+    mapping->size = (uint64_t)st.st_size;
+
+    return FILE_OK;
+
+error:
+    close(fd);
+    return FILE_FAILURE;
+}
+
+static void unmap_file(struct file_mapping* mapping)
+{
+    if (mapping->data)
+        munmap((void*)mapping->data, (size_t)mapping->size);
+
+    *mapping = (struct file_mapping){};
+}
+
+#else
+
+static void advise(const uint8_t* data, uint64_t size, enum file_access access)
+{
+    (void)data;
+    (void)size;
+    (void)access;
+}
+
+static enum file_status map_file(const char* path, enum file_access access,
+                                 struct file_mapping* mapping)
+{
+    *mapping = (struct file_mapping){};
+
+    uint8_t* buf = 0;
+    uint32_t size = 0;
+    if (file_load_binary(path, &buf, &size) != FILE_OK)
+        return FILE_FAILURE;
+
+    mapping->data = buf;
+    mapping->size = size;
+
+    return FILE_OK;
+}
+
+static void unmap_file(struct file_mapping* mapping)
+{
+    file_free((void*)mapping->data);
+    *mapping = (struct file_mapping){};
+}
+
+#endif
+
+enum file_status file_map(const char* path, enum file_access access,
+                          struct file_mapping* mapping)
+{
+    *mapping = (struct file_mapping){};
+
+    char os_path[FILE_MAX_PATH];
+    struct file_source src;
+    if (resolve(path, &src, os_path) != FILE_OK)
+        return FILE_FAILURE;
+
+    if (!src.data) {
+        if (map_file(os_path, access, mapping) != FILE_OK)
+            return FILE_FAILURE;
+
+        trace_range(trace_path(path), 0, mapping->size);
+        return FILE_OK;
+    }
+
+    trace_range(trace_path(path), 0, src.size);
+
+    if (src.packed_size == 0) {
+        advise(src.data, src.size, access);
+        *mapping = (struct file_mapping){ .data = src.data, .size = src.size, .handle = &source_view };
+
+        return FILE_OK;
+    }
+
+    uint8_t* buf = file_realloc(0, (size_t)src.size);
+    if (!buf)
+        return FILE_FAILURE;
+
+    if (pak_read(&src, buf) != FILE_OK) {
+        file_free(buf);
+        return FILE_FAILURE;
+    }
+
+    *mapping = (struct file_mapping){ .data = buf, .size = src.size, .handle = &source_copy };
+
+    return FILE_OK;
+}
+
+void file_unmap(struct file_mapping* mapping)
+{
+    if (mapping->handle == &source_view) {
+        *mapping = (struct file_mapping){};
+    } else if (mapping->handle == &source_copy) {
+        file_free((void*)mapping->data);
+        *mapping = (struct file_mapping){};
+    } else {
+        unmap_file(mapping);
+    }
+}
+
+// ---- Pak --------------------------------------------------------------------
+
+#define PAK_MAX_TASKS 64
+
+// Consecutive blocks of a compressed entry, decoded by one job.
+struct pak_task {
+    const struct file_source* src;
+    uint8_t* dst;
+    uint32_t first_block;
+    uint32_t end_block;
+    uint8_t failed;
+};
+
+static uint64_t pak_nblocks(const struct file_source* src)
+{
+    return (src->size + FILE_PAK_BLOCK_SIZE - 1) / FILE_PAK_BLOCK_SIZE;
+}
+
+// Decodes block b of a compressed entry, which starts at *packed_offset, and
+// moves that past it.
+static enum file_status pak_decode_block(const struct file_source* src, uint32_t b,
+                                         uint64_t* packed_offset, uint8_t* dst)
+{
+    uint32_t block = ((const uint32_t*)src->data)[b];
+    uint32_t packed = block & ~FILE_PAK_BLOCK_STORED;
+
+    uint64_t offset = (uint64_t)b * FILE_PAK_BLOCK_SIZE;
+    size_t size = src->size - offset < FILE_PAK_BLOCK_SIZE ? (size_t)(src->size - offset)
+                                                           : FILE_PAK_BLOCK_SIZE;
+
+    uint64_t pos = *packed_offset;
+    if (pos > src->packed_size || packed > src->packed_size - pos)
+        return FILE_FAILURE;
+
+    if (block & FILE_PAK_BLOCK_STORED) {
+        if (packed != size)
+            return FILE_FAILURE;
+        memcpy(dst, src->data + pos, size);
+    } else if (lz_decompress(src->data + pos, packed, dst, size) != LZ_OK) {
+        return FILE_FAILURE;
+    }
+
+    *packed_offset = pos + packed;
+    return FILE_OK;
+}
+
+static void pak_decode_job(void* data)
+{
+    struct pak_task* t = data;
+    const uint32_t* blocks = (const uint32_t*)t->src->data;
+
+    uint64_t pos = pak_nblocks(t->src) * sizeof(uint32_t);
+    for (uint32_t b = 0; b < t->first_block; ++b)
+        pos += blocks[b] & ~FILE_PAK_BLOCK_STORED;
+
+    for (uint32_t b = t->first_block; b < t->end_block; ++b) {
+        uint8_t* dst = t->dst + (uint64_t)b * FILE_PAK_BLOCK_SIZE;
+        if (pak_decode_block(t->src, b, &pos, dst) != FILE_OK) {
+            t->failed = 1;
+            return;
+        }
+    }
+}
+
+static enum file_status pak_read(const struct file_source* src, uint8_t* dst)
+{
+    if (src->packed_size == 0) {
+        if (src->size)
+            memcpy(dst, src->data, (size_t)src->size);
+        return FILE_OK;
+    }
+
+    uint64_t nblocks = pak_nblocks(src);
+    if (nblocks > src->packed_size / sizeof(uint32_t))
+        return FILE_FAILURE;
+
+    // One run of blocks per thread, the waiting one included.
+    uint64_t ntasks = jobs_nthreads() + 1;
+    if (ntasks > PAK_MAX_TASKS)
+        ntasks = PAK_MAX_TASKS;
+    if (ntasks > nblocks)
+        ntasks = nblocks;
+
+    struct pak_task tasks[PAK_MAX_TASKS];
+    struct jobs_counter counter;
+    atomic_init(&counter.pending, 0);
+
+    for (uint32_t i = 0; i < ntasks; ++i) {
+        tasks[i] = (struct pak_task){
+            .src = src,
+            .dst = dst,
+            .first_block = (uint32_t)(nblocks * i / ntasks),
+            .end_block = (uint32_t)(nblocks * (i + 1) / ntasks),
+        };
+        jobs_submit(pak_decode_job, &tasks[i], &counter);
+    }
+    jobs_wait(&counter);
+
+    for (uint32_t i = 0; i < ntasks; ++i) {
+        if (tasks[i].failed)
+            return FILE_FAILURE;
+    }
+
+    return FILE_OK;
+}
+
+// ---- Mounts -----------------------------------------------------------------
+
+#define FILE_MAX_MOUNTS 32
+
+enum mount_type { MOUNT_FREE = 0,
+                  MOUNT_DIR,
+                  MOUNT_PAK,
+                  MOUNT_BLOB };
+
+struct mount {
+    enum mount_type type;
+    int32_t priority;
+    uint32_t order; // mount sequence, breaks ties
+
+    // Directory: the ids of the indexed files
+    char os_dir[FILE_MAX_PATH];
+    char point[FILE_MAX_PATH];
+    uint64_t* ids;
+    uint32_t nids;
+    uint32_t ids_capacity;
+
+    // Pak
+    struct file_mapping mapping;
+    const struct file_pak_header* header;
+    const struct file_pak_entry* toc;
+    uint32_t nentries; // occupied TOC slots, counted when mounting
+
+    // Blob
+    uint64_t blob_id;
+    const uint8_t* blob;
+    uint64_t blob_size;
+};
+
+// Which mount provides a path; entry is the TOC slot for paks.
+struct lookup_slot {
+    uint64_t id;
+    uint32_t mount;
+    uint32_t entry;
+};
+
+static struct mount mounts[FILE_MAX_MOUNTS];
+static uint32_t mounts_order;
+
+// Open addressing over the ids of all mounts, rebuilt on every change.
+static struct {
+    struct lookup_slot* slots;
+    uint32_t capacity; // power of two
+} lookup;
+
+static void lookup_insert(uint64_t id, uint32_t mount, uint32_t entry)
+{
+    uint32_t mask = lookup.capacity - 1;
+    uint32_t slot = file_pak_slot(id, lookup.capacity);
+
+    for (; lookup.slots[slot].id != 0; slot = (slot + 1) & mask) {
+        // Mounts come highest priority first, the first one keeps the path.
+        if (lookup.slots[slot].id == id)
+            return;
+    }
+
+    lookup.slots[slot] = (struct lookup_slot){ .id = id, .mount = mount, .entry = entry };
+}
+
+static const struct lookup_slot* lookup_find(uint64_t id)
+{
+    if (lookup.capacity == 0)
+        return 0;
+
+    uint32_t mask = lookup.capacity - 1;
+    for (uint32_t slot = file_pak_slot(id, lookup.capacity);; slot = (slot + 1) & mask) {
+        if (lookup.slots[slot].id == id)
+            return &lookup.slots[slot];
+        if (lookup.slots[slot].id == 0)
+            return 0;
+    }
+}
+
+static uint8_t mount_before(const struct mount* a, const struct mount* b)
+{
+    return a->priority != b->priority ? a->priority > b->priority : a->order > b->order;
+}
+
+static enum file_status lookup_rebuild()
+{
+    uint32_t order[FILE_MAX_MOUNTS];
+    uint32_t norder = 0;
+    uint64_t nids = 0;
+
+    for (uint32_t i = 0; i < FILE_MAX_MOUNTS; ++i) {
+        const struct mount* m = &mounts[i];
+        if (m->type == MOUNT_FREE)
+            continue;
+
+        nids += m->type == MOUNT_DIR ? m->nids : m->type == MOUNT_PAK ? m->nentries : 1;
+
+        uint32_t j = norder++;
+        while (j > 0 && mount_before(m, &mounts[order[j - 1]])) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = i;
+    }
+
+    // At most half full, so probes stay short and one slot is always free.
+    uint32_t capacity = 16;
+    while (capacity < nids * 2)
+        capacity *= 2;
+
+    struct lookup_slot* slots = file_realloc(0, sizeof(struct lookup_slot) * capacity);
+    if (!slots)
+        return FILE_FAILURE;
+    memset(slots, 0, sizeof(struct lookup_slot) * capacity);
+
+    file_free(lookup.slots);
+    lookup.slots = slots;
+    lookup.capacity = capacity;
+
+    for (uint32_t o = 0; o < norder; ++o) {
+        const struct mount* m = &mounts[order[o]];
+        switch (m->type) {
+        case MOUNT_DIR:
+            for (uint32_t i = 0; i < m->nids; ++i)
+                lookup_insert(m->ids[i], order[o], 0);
+            break;
+        case MOUNT_PAK:
+            for (uint32_t i = 0; i < m->header->nslots; ++i) {
+                if (m->toc[i].id != 0)
+                    lookup_insert(m->toc[i].id, order[o], i);
+            }
+            break;
+        case MOUNT_BLOB:
+            lookup_insert(m->blob_id, order[o], 0);
+            break;
+        case MOUNT_FREE:
+            break;
+        }
+    }
+
+    return FILE_OK;
+}
+
+static void mount_release(struct mount* m)
+{
+    if (m->type == MOUNT_PAK)
+        unmap_file(&m->mapping);
+    file_free(m->ids);
+
+    *m = (struct mount){};
+}
+
+static struct mount* mount_alloc(int32_t priority)
+{
+    for (uint32_t i = 0; i < FILE_MAX_MOUNTS; ++i) {
+        if (mounts[i].type == MOUNT_FREE) {
+            mounts[i] = (struct mount){ .priority = priority, .order = ++mounts_order };
+            return &mounts[i];
+        }
+    }
+
+    return 0;
+}
+
+// Indexes the new mount, or takes it back when that fails.
+static enum file_status mount_commit(struct mount* m, file_mount_handle* mount)
+{
+    if (lookup_rebuild() != FILE_OK) {
+        mount_release(m);
+        return FILE_FAILURE;
+    }
+
+    *mount = (file_mount_handle)(m - mounts) + 1;
+    return FILE_OK;
+}
+
+static enum file_status dir_add(struct mount* m, const char* path)
+{
+    if (m->nids == m->ids_capacity) {
+        uint32_t capacity = m->ids_capacity ? m->ids_capacity * 2 : 64;
+        uint64_t* ids = file_realloc(m->ids, sizeof(uint64_t) * capacity);
+        if (!ids)
+            return FILE_FAILURE;
+
+        m->ids = ids;
+        m->ids_capacity = capacity;
+    }
+
+    m->ids[m->nids++] = str_id_hash(path);
+    return FILE_OK;
+}
+
+static enum file_status index_dir(struct mount* m, char* os_path, size_t os_len,
+                                  char* path, size_t len);
+
+// Appends name to both paths and indexes what it names.
+static enum file_status index_entry(struct mount* m, const char* name, uint8_t is_dir,
+                                    char* os_path, size_t os_len, char* path, size_t len)
+{
+    size_t n = strlen(name);
+    if (os_len + 1 + n >= FILE_MAX_PATH || len + 1 + n >= FILE_MAX_PATH)
+        return FILE_OK; // cannot be opened through the mount anyway
+
+    os_path[os_len] = '/';
+    memcpy(os_path + os_len + 1, name, n + 1);
+
+    size_t sub_len = len;
+    if (len != 0)
+        path[sub_len++] = '/';
+    memcpy(path + sub_len, name, n + 1);
+
+    enum file_status status = is_dir ? index_dir(m, os_path, os_len + 1 + n, path, sub_len + n)
+                                     : dir_add(m, path);
+
+    os_path[os_len] = '\0';
+    path[len] = '\0';
+
+    return status;
+}
+
+#if defined(_WIN32)
+
+static enum file_status index_dir(struct mount* m, char* os_path, size_t os_len,
+                                  char* path, size_t len)
+{
+    if (os_len + 2 >= FILE_MAX_PATH)
+        return FILE_FAILURE;
+    memcpy(os_path + os_len, "/*", 3);
+
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(os_path, &data);
+    os_path[os_len] = '\0';
+    if (find == INVALID_HANDLE_VALUE)
+        return FILE_FAILURE;
+
+    enum file_status status = FILE_OK;
+    do {
+        const char* name = data.cFileName;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+
+        uint8_t is_dir = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        status = index_entry(m, name, is_dir, os_path, os_len, path, len);
+    } while (status == FILE_OK && FindNextFileA(find, &data));
+
+    FindClose(find);
+    return status;
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+
+#include <dirent.h>
+
+static enum file_status index_dir(struct mount* m, char* os_path, size_t os_len,
+                                  char* path, size_t len)
+{
+    DIR* dir = opendir(os_path);
+    if (!dir)
+        return FILE_FAILURE;
+
+    enum file_status status = FILE_OK;
+    struct dirent* e;
+    while (status == FILE_OK && (e = readdir(dir)) != 0) {
+        const char* name = e->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+
+        // d_type is not filled in by every file system.
+        size_t n = strlen(name);
+        if (os_len + 1 + n >= FILE_MAX_PATH)
+            continue;
+        os_path[os_len] = '/';
+        memcpy(os_path + os_len + 1, name, n + 1);
+
+        struct stat st;
+        int res = stat(os_path, &st);
+        os_path[os_len] = '\0';
+        if (res != 0 || !(S_ISDIR(st.st_mode) || S_ISREG(st.st_mode)))
+            continue;
+
+        status = index_entry(m, name, S_ISDIR(st.st_mode), os_path, os_len, path, len);
+    }
+
+    closedir(dir);
+    return status;
+}
+
+#else
+
+static enum file_status index_dir(struct mount* m, char* os_path, size_t os_len,
+                                  char* path, size_t len)
+{
+    (void)m;
+    (void)os_path;
+    (void)os_len;
+    (void)path;
+    (void)len;
+
+    return FILE_FAILURE;
+}
+
+#endif
+
+// Copies a path without trailing separators and with '\\' turned into '/'.
+static enum file_status copy_dir_path(char* dst, const char* src)
+{
+    size_t n = strlen(src);
+    while (n > 0 && (src[n - 1] == '/' || src[n - 1] == '\\'))
+        --n;
+    if (n >= FILE_MAX_PATH)
+        return FILE_FAILURE;
+
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = src[i] == '\\' ? '/' : src[i];
+    dst[n] = '\0';
+
+    return FILE_OK;
+}
+
+enum file_status file_mount_dir(const char* os_dir, const char* mount_point,
+                                int32_t priority, file_mount_handle* mount)
+{
+    *mount = 0;
+
+    struct mount* m = mount_alloc(priority);
+    if (!m)
+        return FILE_FAILURE;
+    m->type = MOUNT_DIR;
+
+    char os_path[FILE_MAX_PATH];
+    char path[FILE_MAX_PATH];
+    if (copy_dir_path(m->os_dir, os_dir) != FILE_OK
+        || copy_dir_path(m->point, mount_point) != FILE_OK)
+        goto error;
+
+    strcpy(os_path, m->os_dir);
+    strcpy(path, m->point);
+    if (index_dir(m, os_path, strlen(os_path), path, strlen(path)) != FILE_OK)
+        goto error;
+
+    return mount_commit(m, mount);
+
+error:
+    mount_release(m);
+    return FILE_FAILURE;
+}
+
+enum file_status file_mount_pak(const char* path, int32_t priority,
+                                file_mount_handle* mount)
+{
+    *mount = 0;
+
+    struct mount* m = mount_alloc(priority);
+    if (!m)
+        return FILE_FAILURE;
+
+    if (map_file(path, FILE_ACCESS_RANDOM, &m->mapping) != FILE_OK) {
+        mount_release(m);
+        return FILE_FAILURE;
+    }
+    m->type = MOUNT_PAK;
+
+    uint64_t size = m->mapping.size;
+    const struct file_pak_header* h = (const struct file_pak_header*)m->mapping.data;
+    if (size < sizeof(struct file_pak_header) || h->magic != FILE_PAK_MAGIC
+        || h->nslots == 0 || (h->nslots & (h->nslots - 1)) != 0
+        || h->nentries >= h->nslots
+        || size - sizeof(struct file_pak_header) < (uint64_t)h->nslots * sizeof(struct file_pak_entry))
+        goto error;
+
+    m->header = h;
+    m->toc = (const struct file_pak_entry*)(h + 1);
+
+    // Starts reading the entries needed first in the background. On a file
+    // mapping this is what posix_fadvise(POSIX_FADV_WILLNEED) does.
+    uint64_t hot_size = (uint64_t)h->hot_pages * FILE_PAK_ALIGN;
+    if (hot_size != 0)
+        advise(m->mapping.data, hot_size < size ? hot_size : size, FILE_ACCESS_SEQUENTIAL);
+
+    // The lookup table is sized by the entry count, so it must match the
+    // slots actually taken.
+    for (uint32_t i = 0; i < h->nslots; ++i) {
+        const struct file_pak_entry* e = &m->toc[i];
+        if (e->id == 0)
+            continue;
+
+        uint64_t stored = e->packed_size ? e->packed_size : e->size;
+        if (e->offset > size || stored > size - e->offset)
+            goto error;
+        ++m->nentries;
+    }
+
+    if (m->nentries != h->nentries)
+        goto error;
+
+    return mount_commit(m, mount);
+
+error:
+    mount_release(m);
+    return FILE_FAILURE;
+}
+
+enum file_status file_mount_blob(const char* path, const void* data, uint64_t size,
+                                 int32_t priority, file_mount_handle* mount)
+{
+    *mount = 0;
+
+    struct mount* m = mount_alloc(priority);
+    if (!m)
+        return FILE_FAILURE;
+
+    m->type = MOUNT_BLOB;
+    m->blob_id = str_id_hash(path);
+    m->blob = data ? data : (const uint8_t*)"";
+    m->blob_size = size;
+
+    return mount_commit(m, mount);
+}
+
+void file_unmount(file_mount_handle mount)
+{
+    if (mount == 0 || mount > FILE_MAX_MOUNTS || mounts[mount - 1].type == MOUNT_FREE)
+        return;
+
+    mount_release(&mounts[mount - 1]);
+
+    // Only ever shrinks, so there is room.
+    lookup_rebuild();
+}
+
+void file_unmount_all()
+{
+    for (uint32_t i = 0; i < FILE_MAX_MOUNTS; ++i) {
+        if (mounts[i].type != MOUNT_FREE)
+            mount_release(&mounts[i]);
+    }
+
+    file_free(lookup.slots);
+    lookup.slots = 0;
+    lookup.capacity = 0;
+}
+
+static enum file_status resolve(const char* path, struct file_source* src, char* os_path)
+{
+    *src = (struct file_source){};
+
+    const struct lookup_slot* slot = lookup_find(str_id_hash(path));
+    if (slot) {
+        const struct mount* m = &mounts[slot->mount];
+        switch (m->type) {
+        case MOUNT_PAK: {
+            const struct file_pak_entry* e = &m->toc[slot->entry];
+            src->data = m->mapping.data + e->offset;
+            src->size = e->size;
+            src->packed_size = e->packed_size;
+            return FILE_OK;
+        }
+        case MOUNT_BLOB:
+            src->data = m->blob;
+            src->size = m->blob_size;
+            return FILE_OK;
+        case MOUNT_DIR: {
+            // Replaces the mount point with the directory.
+            size_t point_len = strlen(m->point);
+            const char* rest = path + point_len;
+            if (strncmp(path, m->point, point_len) != 0 || (point_len && *rest++ != '/'))
+                break;
+
+            size_t dir_len = strlen(m->os_dir);
+            size_t rest_len = strlen(rest);
+            if (dir_len + 1 + rest_len >= FILE_MAX_PATH)
+                return FILE_FAILURE;
+
+            memcpy(os_path, m->os_dir, dir_len);
+            os_path[dir_len] = '/';
+            memcpy(os_path + dir_len + 1, rest, rest_len + 1);
+            return FILE_OK;
+        }
+        case MOUNT_FREE:
+            break;
+        }
+    }
+
+    if (strlen(path) >= FILE_MAX_PATH)
+        return FILE_FAILURE;
+    strcpy(os_path, path);
+
+    return FILE_OK;
+}
+
+// ---- Async reads ------------------------------------------------------------
+
+static struct {
+    struct file_async_read* waiting; // not submitted yet, in order
+    struct file_async_read* waiting_last;
+
+    uint32_t inflight; // submitted to the ring
+    struct jobs_counter jobs;
+} async;
+
+static void async_finish(struct file_async_read* r, enum file_status status)
+{
+    r->status = status;
+    if (status != FILE_OK)
+        r->size = 0;
+    atomic_store_explicit(&r->done, 1, memory_order_release);
+}
+
+// Opens the file and allocates its buffer. Done on the submitting thread, so
+// the memory hooks are never called from workers.
+static enum file_status async_prepare(struct file_async_read* r)
+{
+    char os_path[FILE_MAX_PATH];
+    struct file_source src;
+    if (resolve(r->path, &src, os_path) != FILE_OK)
+        return FILE_FAILURE;
+
+    if (src.data) {
+        if (src.size > UINT32_MAX)
+            return FILE_FAILURE;
+
+        r->size = (uint32_t)src.size;
+        if (r->size != 0) {
+            r->buf = file_realloc(r->buf, r->size);
+            if (!r->buf)
+                return FILE_FAILURE;
+        }
+
+        r->src = src;
+        trace_range(trace_path(r->path), 0, src.size);
+        return FILE_OK;
+    }
+
+    FILE* f = fopen(os_path, "rb");
+    if (!f)
+        return FILE_FAILURE;
+
+    fseek(f, 0, SEEK_END);
+    long s = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (s < 0 || (unsigned long long)s > UINT32_MAX) {
+        fclose(f);
+        return FILE_FAILURE;
+    }
+
+    r->size = (uint32_t)s;
+    if (r->size != 0) {
+        r->buf = file_realloc(r->buf, r->size);
+        if (!r->buf) {
+            fclose(f);
+            return FILE_FAILURE;
+        }
+    }
+
+    r->file = f;
+    trace_range(trace_path(r->path), 0, r->size);
+    return FILE_OK;
+}
+
+// Faults the pak pages in, or decompresses, on a worker.
+static void async_pak_job(void* data)
+{
+    struct file_async_read* r = data;
+
+    enum file_status status = pak_read(&r->src, r->buf);
+    r->src = (struct file_source){};
+
+    async_finish(r, status);
+}
+
+static void async_read_job(void* data)
+{
+    struct file_async_read* r = data;
+    FILE* f = r->file;
+
+    size_t n = r->size ? fread(r->buf, 1, r->size, f) : 0;
+    fclose(f);
+    r->file = 0;
+
+    async_finish(r, n == r->size ? FILE_OK : FILE_FAILURE);
+}
+
+#if defined(__linux__)
+
+// io_uring through raw syscalls, so no liburing is needed. Requires
+// IORING_OP_READ (Linux 5.6), detected by IORING_FEAT_RW_CUR_POS which came
+// with it.
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+
+static struct file_ring {
+    int fd;
+    uint32_t entries;
+
+    void* sq_ptr;
+    size_t sq_size;
+    void* cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    atomic_uint* sq_head;
+    atomic_uint* sq_tail;
+    uint32_t sq_mask;
+    uint32_t* sq_array;
+
+    atomic_uint* cq_head;
+    atomic_uint* cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe* cqes;
+} ring = { .fd = -1 };
+
+static void ring_deinit()
+{
+    if (ring.sqes)
+        munmap(ring.sqes, ring.sqes_size);
+    if (ring.cq_ptr && ring.cq_ptr != ring.sq_ptr)
+        munmap(ring.cq_ptr, ring.cq_size);
+    if (ring.sq_ptr)
+        munmap(ring.sq_ptr, ring.sq_size);
+    if (ring.fd != -1)
+        close(ring.fd);
+
+    ring = (struct file_ring){ .fd = -1 };
+}
+
+static uint8_t ring_init(uint32_t depth)
+{
+    struct io_uring_params p = {};
+    int fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+    if (fd < 0)
+        return 0;
+
+    ring.fd = fd;
+    if (!(p.features & IORING_FEAT_RW_CUR_POS))
+        goto error;
+
+    ring.entries = p.sq_entries;
+    ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    ring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring.cq_size > ring.sq_size)
+            ring.sq_size = ring.cq_size;
+        ring.cq_size = ring.sq_size;
+    }
+
+    ring.sq_ptr = mmap(0, ring.sq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring.sq_ptr == MAP_FAILED) {
+        ring.sq_ptr = 0;
+        goto error;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring.cq_ptr = ring.sq_ptr;
+    } else {
+        ring.cq_ptr = mmap(0, ring.cq_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring.cq_ptr == MAP_FAILED) {
+            ring.cq_ptr = 0;
+            goto error;
+        }
+    }
+
+    ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = mmap(0, ring.sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) {
+        ring.sqes = 0;
+        goto error;
+    }
+
+    uint8_t* sq = ring.sq_ptr;
+    ring.sq_head = (atomic_uint*)(sq + p.sq_off.head);
+    ring.sq_tail = (atomic_uint*)(sq + p.sq_off.tail);
+    ring.sq_mask = *(uint32_t*)(sq + p.sq_off.ring_mask);
+    ring.sq_array = (uint32_t*)(sq + p.sq_off.array);
+
+    uint8_t* cq = ring.cq_ptr;
+    ring.cq_head = (atomic_uint*)(cq + p.cq_off.head);
+    ring.cq_tail = (atomic_uint*)(cq + p.cq_off.tail);
+    ring.cq_mask = *(uint32_t*)(cq + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    return 1;
+
+error:
+    ring_deinit();
+    return 0;
+}
+
+// Queues the next chunk of the read, submitted by the following ring_enter.
+static void ring_push(struct file_async_read* r)
+{
+    uint32_t tail = atomic_load_explicit(ring.sq_tail, memory_order_relaxed);
+    uint32_t idx = tail & ring.sq_mask;
+
+    uint32_t len = r->size - r->nread;
+    if (len > (1u << 30))
+        len = 1u << 30;
+
+    ring.sqes[idx] = (struct io_uring_sqe){
+        .opcode = IORING_OP_READ,
+        .fd = r->fd,
+        .off = r->nread,
+        .addr = (uint64_t)(uintptr_t)(r->buf + r->nread),
+        .len = len,
+        .user_data = (uint64_t)(uintptr_t)r,
+    };
+    ring.sq_array[idx] = idx;
+
+    atomic_store_explicit(ring.sq_tail, tail + 1, memory_order_release);
+    ++async.inflight;
+}
+
+static void ring_enter(uint32_t wait_nr)
+{
+    if (ring.fd == -1)
+        return;
+
+    uint32_t to_submit = atomic_load_explicit(ring.sq_tail, memory_order_relaxed)
+                         - atomic_load_explicit(ring.sq_head, memory_order_acquire);
+    if (to_submit == 0 && wait_nr == 0)
+        return;
+
+    while (syscall(__NR_io_uring_enter, ring.fd, to_submit, wait_nr,
+                   wait_nr ? IORING_ENTER_GETEVENTS : 0, 0, 0)
+               < 0
+           && errno == EINTR) {
+    }
+}
+
+static void ring_finish(struct file_async_read* r, enum file_status status)
+{
+    close(r->fd);
+    r->fd = -1;
+    async_finish(r, status);
+}
+
+static void ring_reap()
+{
+    if (ring.fd == -1)
+        return;
+
+    uint32_t head = atomic_load_explicit(ring.cq_head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(ring.cq_tail, memory_order_acquire);
+
+    for (; head != tail; ++head) {
+        struct io_uring_cqe* cqe = &ring.cqes[head & ring.cq_mask];
+        struct file_async_read* r = (struct file_async_read*)(uintptr_t)cqe->user_data;
+        --async.inflight;
+
+        if (cqe->res <= 0) {
+            // Error, or the file shrank since it was opened.
+            ring_finish(r, FILE_FAILURE);
+            continue;
+        }
+
+        r->nread += (uint32_t)cqe->res;
+        if (r->nread < r->size)
+            ring_push(r); // short read, go on from where it stopped
+        else
+            ring_finish(r, FILE_OK);
+    }
+
+    atomic_store_explicit(ring.cq_head, head, memory_order_release);
+}
+
+static uint8_t ring_submit(struct file_async_read* r)
+{
+    if (ring.fd == -1)
+        return 0;
+
+    // The FILE is only used for the size, the ring reads from its own fd.
+    r->fd = dup(fileno(r->file));
+    fclose(r->file);
+    r->file = 0;
+
+    if (r->fd == -1) {
+        async_finish(r, FILE_FAILURE);
+        return 1;
+    }
+
+    if (r->size == 0) {
+        ring_finish(r, FILE_OK);
+        return 1;
+    }
+
+    r->nread = 0;
+    ring_push(r);
+    return 1;
+}
+
+#else
+
+static uint8_t ring_init(uint32_t depth)
+{
+    (void)depth;
+    return 0;
+}
+
+static void ring_deinit() {}
+static void ring_enter(uint32_t wait_nr) { (void)wait_nr; }
+static void ring_reap() {}
+static uint8_t ring_submit(struct file_async_read* r)
+{
+    (void)r;
+    return 0;
+}
+
+#endif
+
+static uint32_t ring_capacity;
+
+enum file_status file_async_init(uint32_t queue_depth)
+{
+    async.waiting = 0;
+    async.waiting_last = 0;
+    async.inflight = 0;
+    atomic_init(&async.jobs.pending, 0);
+
+    ring_capacity = ring_init(queue_depth) ? queue_depth : 0;
+
+    return FILE_OK;
+}
+
+void file_async_deinit()
+{
+    file_async_wait();
+    ring_deinit();
+    ring_capacity = 0;
+}
+
+static void async_submit(struct file_async_read* r)
+{
+    if (async_prepare(r) != FILE_OK) {
+        async_finish(r, FILE_FAILURE);
+        return;
+    }
+
+    if (r->src.data)
+        jobs_submit(async_pak_job, r, &async.jobs);
+    else if (!ring_submit(r))
+        jobs_submit(async_read_job, r, &async.jobs);
+}
+
+// Moves waiting reads into the ring as it frees up.
+static void async_pump()
+{
+    while (async.waiting && (ring_capacity == 0 || async.inflight < ring_capacity)) {
+        struct file_async_read* r = async.waiting;
+        async.waiting = r->next;
+        if (!async.waiting)
+            async.waiting_last = 0;
+        r->next = 0;
+
+        async_submit(r);
+    }
+
+    ring_enter(0);
+}
+
+enum file_status file_read_async(struct file_async_read* reads, uint32_t nreads)
+{
+    for (uint32_t i = 0; i < nreads; ++i) {
+        struct file_async_read* r = &reads[i];
+        r->buf = 0;
+        r->size = 0;
+        r->status = FILE_FAILURE;
+        atomic_init(&r->done, 0);
+        r->next = 0;
+        r->src = (struct file_source){};
+        r->file = 0;
+        r->fd = -1;
+        r->nread = 0;
+
+        if (async.waiting_last)
+            async.waiting_last->next = r;
+        else
+            async.waiting = r;
+        async.waiting_last = r;
+    }
+
+    async_pump();
+
+    return FILE_OK;
+}
+
+uint32_t file_async_poll()
+{
+    ring_reap();
+    async_pump();
+
+    uint32_t nwaiting = 0;
+    for (struct file_async_read* r = async.waiting; r; r = r->next)
+        ++nwaiting;
+
+    return nwaiting + async.inflight
+           + atomic_load_explicit(&async.jobs.pending, memory_order_acquire);
+}
+
+void file_async_wait()
+{
+    while (file_async_poll() != 0) {
+        if (async.inflight)
+            ring_enter(1);
+        else
+            jobs_wait(&async.jobs);
+    }
+}
+
+// ---- Streams ----------------------------------------------------------------
+
+#if defined(_WIN32)
+#define stream_seek _fseeki64
+#define stream_tell _ftelli64
+#else
+#define stream_seek fseeko
+#define stream_tell ftello
+#endif
+
+enum file_status file_stream_open(const char* path, uint32_t buffer_size,
+                                  struct file_stream* stream)
+{
+    *stream = (struct file_stream){ .trace_path = trace_path(path) };
+
+    char os_path[FILE_MAX_PATH];
+    struct file_source src;
+    if (resolve(path, &src, os_path) != FILE_OK)
+        return FILE_FAILURE;
+
+    if (src.data) {
+        stream->size = src.size;
+        stream->src = src;
+
+        // Stored sources are read in place.
+        if (src.packed_size == 0)
+            return FILE_OK;
+
+        uint64_t nblocks = pak_nblocks(&src);
+        if (nblocks > src.packed_size / sizeof(uint32_t))
+            return FILE_FAILURE;
+
+        stream->packed_offset = nblocks * sizeof(uint32_t);
+        if (buffer_size < FILE_PAK_BLOCK_SIZE)
+            buffer_size = FILE_PAK_BLOCK_SIZE;
+    } else {
+        FILE* f = fopen(os_path, "rb");
+        if (!f)
+            return FILE_FAILURE;
+        stream->file = f;
+
+        stream_seek(f, 0, SEEK_END);
+        int64_t size = stream_tell(f);
+        stream_seek(f, 0, SEEK_SET);
+
+        if (size < 0)
+            goto error;
+        stream->size = (uint64_t)size;
+    }
+
+    if (buffer_size > (1u << 31))
+        buffer_size = 1u << 31;
+
+    uint32_t capacity = 1;
+    while (capacity < buffer_size)
+        capacity <<= 1;
+
+    stream->ring = file_realloc(0, capacity);
+    if (!stream->ring)
+        goto error;
+    stream->capacity = capacity;
+
+    return FILE_OK;
+
+error:
+    file_stream_close(stream);
+    return FILE_FAILURE;
+}
+
+void file_stream_close(struct file_stream* stream)
+{
+    if (stream->file)
+        fclose(stream->file);
+    file_free(stream->ring);
+
+    *stream = (struct file_stream){};
+}
+
+static uint64_t stream_block_size(const struct file_stream* stream)
+{
+    uint64_t left = stream->size - stream->filled;
+    return left < FILE_PAK_BLOCK_SIZE ? left : FILE_PAK_BLOCK_SIZE;
+}
+
+// Fills the free part of the ring. A compressed source is decoded block by
+// block; since the ring holds a whole number of blocks and they are consumed
+// in order, each one lands in one piece.
+static enum file_status stream_refill(struct file_stream* stream)
+{
+    uint32_t mask = stream->capacity - 1;
+    uint64_t space = stream->capacity - (stream->filled - stream->offset);
+
+    if (stream->src.data) {
+        while (space >= FILE_PAK_BLOCK_SIZE && stream->filled < stream->size) {
+            uint32_t b = (uint32_t)(stream->filled / FILE_PAK_BLOCK_SIZE);
+            uint8_t* dst = stream->ring + (stream->filled & mask);
+            if (pak_decode_block(&stream->src, b, &stream->packed_offset, dst) != FILE_OK)
+                return FILE_FAILURE;
+
+            uint64_t n = stream_block_size(stream);
+            stream->filled += n;
+            space -= n;
+        }
+
+        return FILE_OK;
+    }
+
+    // Up to the end of the ring, then on from its start.
+    for (uint32_t piece = 0; piece < 2 && space != 0; ++piece) {
+        uint32_t pos = (uint32_t)(stream->filled & mask);
+        uint64_t n = stream->capacity - pos;
+        if (n > space)
+            n = space;
+        if (n > stream->size - stream->filled)
+            n = stream->size - stream->filled;
+        if (n == 0)
+            break;
+
+        if (fread(stream->ring + pos, 1, (size_t)n, stream->file) != n)
+            return FILE_FAILURE;
+
+        stream->filled += n;
+        space -= n;
+    }
+
+    return FILE_OK;
+}
+
+enum file_status file_stream_read(struct file_stream* stream, void* dst, uint64_t size)
+{
+    if (size > stream->size - stream->offset)
+        return FILE_FAILURE;
+
+    trace_range(stream->trace_path, stream->offset, size);
+
+    uint8_t* out = dst;
+
+    if (stream->src.data && stream->src.packed_size == 0) {
+        memcpy(out, stream->src.data + stream->offset, (size_t)size);
+        stream->offset += size;
+        return FILE_OK;
+    }
+
+    while (size) {
+        if (stream->offset == stream->filled) {
+            // Large reads go straight to the destination, a whole block at a
+            // time for compressed entries.
+            if (stream->file && size >= stream->capacity) {
+                if (fread(out, 1, (size_t)size, stream->file) != size)
+                    return FILE_FAILURE;
+
+                stream->offset += size;
+                stream->filled = stream->offset;
+                return FILE_OK;
+            }
+
+            if (stream->src.data && size >= stream_block_size(stream)) {
+                uint32_t b = (uint32_t)(stream->filled / FILE_PAK_BLOCK_SIZE);
+                if (pak_decode_block(&stream->src, b, &stream->packed_offset, out) != FILE_OK)
+                    return FILE_FAILURE;
+
+                uint64_t n = stream_block_size(stream);
+                out += n;
+                size -= n;
+                stream->filled += n;
+                stream->offset = stream->filled;
+                continue;
+            }
+
+            if (stream_refill(stream) != FILE_OK)
+                return FILE_FAILURE;
+        }
+
+        uint32_t pos = (uint32_t)(stream->offset & (stream->capacity - 1));
+        uint64_t n = stream->filled - stream->offset;
+        if (n > stream->capacity - pos)
+            n = stream->capacity - pos;
+        if (n > size)
+            n = size;
+
+        memcpy(out, stream->ring + pos, (size_t)n);
+        out += n;
+        size -= n;
+        stream->offset += n;
+    }
+
+    return FILE_OK;
+}
+
+enum file_status file_stream_skip(struct file_stream* stream, uint64_t size)
+{
+    if (size > stream->size - stream->offset)
+        return FILE_FAILURE;
+
+    uint64_t buffered = stream->filled - stream->offset;
+    if (size <= buffered || (stream->src.data && stream->src.packed_size == 0)) {
+        stream->offset += size;
+        return FILE_OK;
+    }
+
+    stream->offset = stream->filled;
+    size -= buffered;
+
+    if (stream->file) {
+        if (stream_seek(stream->file, (int64_t)(stream->offset + size), SEEK_SET) != 0)
+            return FILE_FAILURE;
+
+        stream->offset += size;
+        stream->filled = stream->offset;
+        return FILE_OK;
+    }
+
+    // Whole blocks are passed over without decoding them.
+    const uint32_t* blocks = (const uint32_t*)stream->src.data;
+    while (size >= FILE_PAK_BLOCK_SIZE) {
+        uint32_t b = (uint32_t)(stream->filled / FILE_PAK_BLOCK_SIZE);
+        stream->packed_offset += blocks[b] & ~FILE_PAK_BLOCK_STORED;
+        stream->filled += FILE_PAK_BLOCK_SIZE;
+        stream->offset = stream->filled;
+        size -= FILE_PAK_BLOCK_SIZE;
+    }
+
+    if (size == 0)
+        return FILE_OK;
+
+    if (stream_refill(stream) != FILE_OK)
+        return FILE_FAILURE;
+
+    stream->offset += size;
+    return FILE_OK;
+}
+
+// ---- Access trace -----------------------------------------------------------
+
+#define TRACE_NONE 0xffffffffu
+
+struct trace_record {
+    uint32_t path; // offset in trace.paths
+    uint64_t offset;
+    uint64_t size;
+};
+
+static struct {
+    uint8_t on;
+
+    struct trace_record* records;
+    uint32_t nrecords;
+    uint32_t records_capacity;
+
+    char* paths;
+    uint32_t paths_size;
+    uint32_t paths_capacity;
+} trace;
+
+void file_trace_begin()
+{
+    file_free(trace.records);
+    file_free(trace.paths);
+    memset(&trace, 0, sizeof(trace));
+    trace.on = 1;
+}
+
+static uint32_t trace_path(const char* path)
+{
+    if (!trace.on)
+        return TRACE_NONE;
+
+    for (uint32_t p = 0; p < trace.paths_size; p += (uint32_t)strlen(trace.paths + p) + 1) {
+        if (strcmp(trace.paths + p, path) == 0)
+            return p;
+    }
+
+    uint32_t len = (uint32_t)strlen(path) + 1;
+    if (trace.paths_size + len > trace.paths_capacity) {
+        uint32_t capacity = trace.paths_capacity ? trace.paths_capacity * 2 : 4096;
+        while (capacity < trace.paths_size + len)
+            capacity *= 2;
+
+        char* paths = file_realloc(trace.paths, capacity);
+        if (!paths)
+            return TRACE_NONE;
+        trace.paths = paths;
+        trace.paths_capacity = capacity;
+    }
+
+    uint32_t p = trace.paths_size;
+    memcpy(trace.paths + p, path, len);
+    trace.paths_size += len;
+    return p;
+}
+
+// Reads going on where the last one of the same file stopped grow its record.
+static void trace_range(uint32_t path, uint64_t offset, uint64_t size)
+{
+    if (!trace.on || path >= trace.paths_size)
+        return;
+
+    if (trace.nrecords) {
+        struct trace_record* last = &trace.records[trace.nrecords - 1];
+        if (last->path == path && last->offset + last->size == offset) {
+            last->size += size;
+            return;
+        }
+    }
+
+    if (trace.nrecords == trace.records_capacity) {
+        uint32_t capacity = trace.records_capacity ? trace.records_capacity * 2 : 256;
+        struct trace_record* records = file_realloc(trace.records, capacity * sizeof(struct trace_record));
+        if (!records)
+            return;
+        trace.records = records;
+        trace.records_capacity = capacity;
+    }
+
+    trace.records[trace.nrecords++] = (struct trace_record){
+        .path = path,
+        .offset = offset,
+        .size = size,
+    };
+}
+
+enum file_status file_trace_end(const char* path)
+{
+    enum file_status res = FILE_OK;
+
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        res = FILE_FAILURE;
+    } else {
+        for (uint32_t i = 0; i < trace.nrecords; ++i) {
+            const struct trace_record* r = &trace.records[i];
+            fprintf(f, "%llu %llu %s\n", (unsigned long long)r->offset, (unsigned long long)r->size,
+                    trace.paths + r->path);
+        }
+        if (fclose(f) != 0)
+            res = FILE_FAILURE;
+    }
+
+    file_free(trace.records);
+    file_free(trace.paths);
+    memset(&trace, 0, sizeof(trace));
+    return res;
+}
@@ -1,15 +1,19 @@
 #pragma once
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stddef.h>
 
 // todo:
-// - malloc callbacks
 // - logging
 
 enum file_status { FILE_OK = 0,
                    FILE_FAILURE };
 
+typedef void (*file_free_fptr)(void*);
+typedef void* (*file_realloc_fptr)(void*, size_t);
+void file_set_mem(file_free_fptr f, file_realloc_fptr r);
+
 enum file_status file_load_text(const char* path, const char** buf,
                                 uint32_t* size);
 enum file_status file_save_text(const char* path, const char* buf,
@@ -21,3 +25,178 @@ enum file_status file_load_binary(const char* path, uint8_t** buf,
 enum file_status file_save_binary(const char* path, const uint8_t* buf,
                                   uint32_t size);
 void file_unload_binary(uint8_t** buf);
+
+// ---- Mapping ----
+
+// Read-only view of a whole file, mapped straight from the page cache
+// instead of being read into a buffer. Falls back to reading the file where
+// mapping is not available.
+
+enum file_access { FILE_ACCESS_SEQUENTIAL = 0, // read once, front to back
+                   FILE_ACCESS_RANDOM };       // looked up in place for a while
+
+struct file_mapping {
+    const uint8_t* data;
+    uint64_t size;
+    void* handle; // platform specific
+};
+
+enum file_status file_map(const char* path, enum file_access access,
+                          struct file_mapping* mapping);
+void file_unmap(struct file_mapping* mapping);
+
+// Where a path resolved to, used by the internal fields below.
+struct file_source {
+    const uint8_t* data; // a pak entry or a blob, 0 for a file on disk
+    uint64_t size;
+    uint64_t packed_size; // compressed pak entry when not 0
+};
+
+// ---- Async reads ----
+
+// Whole file reads that run in the background, submitted in batches and
+// completed by polling (e.g. once per frame) or waiting. Uses io_uring where
+// the kernel supports it, and the job pool otherwise, so jobs_init should
+// come first. Without workers reads finish during submission.
+
+struct file_async_read {
+    const char* path;
+
+    // Results, valid once done is set. buf is released with
+    // file_unload_binary.
+    uint8_t* buf;
+    uint32_t size;
+    enum file_status status;
+    atomic_uchar done;
+
+    // Internal
+    struct file_async_read* next;
+    struct file_source src;
+    void* file;
+    int32_t fd;
+    uint32_t nread;
+};
+
+// queue_depth: reads in flight at once, more are queued.
+enum file_status file_async_init(uint32_t queue_depth);
+// Waits for all reads in flight.
+void file_async_deinit();
+
+// The reads must stay in place until done.
+enum file_status file_read_async(struct file_async_read* reads, uint32_t nreads);
+
+// Completes what finished, returns the number of reads still in flight.
+uint32_t file_async_poll();
+void file_async_wait();
+
+// ---- Streams ----
+
+// Sequential reader for files of any size, which only ever holds a fixed size
+// ring buffer of the file in memory. Reads at least as large as the ring go
+// straight into the destination. Offsets and sizes are 64-bit.
+
+struct file_stream {
+    uint64_t size; // of the whole file
+    uint64_t offset; // of the cursor
+
+    // Internal
+    uint8_t* ring;
+    uint32_t capacity; // power of two
+    uint64_t filled; // the ring holds the file up to here
+    void* file;
+    struct file_source src;
+    uint64_t packed_offset; // of the next block of a compressed entry
+    uint32_t trace_path;
+};
+
+// buffer_size is rounded up to a power of two, and to a whole block for
+// compressed pak entries.
+enum file_status file_stream_open(const char* path, uint32_t buffer_size,
+                                  struct file_stream* stream);
+void file_stream_close(struct file_stream* stream);
+
+// Fail past the end of the file.
+enum file_status file_stream_read(struct file_stream* stream, void* dst, uint64_t size);
+enum file_status file_stream_skip(struct file_stream* stream, uint64_t size);
+
+// ---- Pak ----
+
+// Single file archive of assets, built by tools/pak_gen.c and mounted with
+// file_mount_pak. A header, then the table of contents: an open addressing
+// table of nslots entries keyed by the str_id of each path ('/' separated, as
+// passed to the loading calls). The entries follow, each starting on a
+// FILE_PAK_ALIGN boundary, so a mapped pak serves them in place. Those in the
+// access trace the pak was built with come first, in the order they were
+// loaded, and are read ahead on mount.
+//
+// Entries are either stored as is or compressed with lz in blocks of
+// FILE_PAK_BLOCK_SIZE, which decode independently of each other and so are
+// spread over the job pool. A compressed entry starts with the packed size of
+// every block, FILE_PAK_BLOCK_STORED marking those that did not compress,
+// followed by the blocks back to back.
+//
+// file_map returns a view into the pak mapping without copying anything, or
+// a decompressed copy for compressed entries.
+
+#define FILE_PAK_MAGIC 0x314b4150u // "PAK1"
+#define FILE_PAK_ALIGN 4096
+#define FILE_PAK_BLOCK_SIZE (64 * 1024)
+#define FILE_PAK_BLOCK_STORED 0x80000000u
+
+struct file_pak_header {
+    uint32_t magic;
+    uint32_t nentries;
+    uint32_t nslots; // power of two, more than nentries
+    uint32_t hot_pages; // FILE_PAK_ALIGN pages up front with the traced entries
+};
+
+struct file_pak_entry {
+    uint64_t id; // str_id of the path, 0 for a free slot
+    uint64_t offset; // from the start of the pak
+    uint64_t size;
+    uint64_t packed_size; // bytes in the pak, 0 when stored as is
+};
+
+// First slot probed for an id, the following ones are probed in order.
+static inline uint32_t file_pak_slot(uint64_t id, uint32_t nslots)
+{
+    return (uint32_t)(id ^ (id >> 32)) & (nslots - 1);
+}
+
+// ---- Mounts ----
+
+// Virtual file system in front of every call above that takes a path.
+// Directories, paks and blobs in memory are mounted with a priority; where
+// several provide the same path the highest priority wins, the latest mount
+// on a tie, so patch content mounted above the base shadows it.
+//
+// Mounting indexes everything a mount provides by the str_id of its paths,
+// after which resolving a path is a probe of that index and never touches the
+// file system. Paths that no mount provides are opened as they are.
+
+typedef uint32_t file_mount_handle; // 0 is invalid
+
+// Indexes the files under os_dir, which then appear under mount_point (e.g.
+// "res"), or at the root when that is empty. Files created later are only
+// found by their plain path.
+enum file_status file_mount_dir(const char* os_dir, const char* mount_point,
+                                int32_t priority, file_mount_handle* mount);
+enum file_status file_mount_pak(const char* path, int32_t priority,
+                                file_mount_handle* mount);
+// Serves `path` from data, which must stay valid while mounted.
+enum file_status file_mount_blob(const char* path, const void* data, uint64_t size,
+                                 int32_t priority, file_mount_handle* mount);
+
+// Views from file_map into the mount must be unmapped first.
+void file_unmount(file_mount_handle mount);
+void file_unmount_all();
+
+// ---- Access trace ----
+
+// Records the paths that are loaded, in order, with the byte ranges read
+// from them, e.g. over startup. pak_gen --trace lays a pak out in that order,
+// and mounting it then reads the traced part ahead, so a cold start becomes
+// one sequential read. Records main thread loads only.
+void file_trace_begin();
+// Stops recording and writes one "<offset> <size> <path>" line per range.
+enum file_status file_trace_end(const char* path);
@@ -2,15 +2,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "math.h"
 #include "resources.h"
 #include "file.h"
+#include "jobs.h"
+#include "string_id.h"
 #include "memory.h"
 #include "gpu.h"
 #include "graphics.h"
 #include "camera.h"
 #include "scene.h"
+#include "watch.h"
 
 #include "game_log.inl"
 #include "game_state.inl"
@@ -9,6 +9,18 @@ struct game_settings {
     const char* name;
     uint32_t screen_size[2];
     uint32_t max_fps;
+    uint64_t heap_size; // bytes reserved up front for all heap allocations
+    uint32_t slab_mem_size; // part of the heap used for small allocations
+    uint32_t frame_mem_size; // bytes of transient per-frame memory
+    uint64_t load_mem_size; // bytes reserved for loaded resources
+    uint32_t str_id_mem_size; // bytes for interned names and their table
+
+    // File access trace of the first access_trace_frames frames, for
+    // pak_gen --trace. 0 records none.
+    const char* access_trace_path;
+    uint32_t access_trace_frames;
+
+    uint8_t watch_assets; // reload shaders and meshes edited under res
 };
 
 struct game_input {
@@ -24,6 +36,8 @@ struct game_input {
     uint8_t l_down;
     uint8_t u_down;
     uint8_t o_down;
+    uint8_t f5_pressed; // quick save
+    uint8_t f9_pressed; // quick load
 
     int32_t mouse_dx;
     int32_t mouse_dy;
@@ -38,3 +52,10 @@ enum game_status game_init(struct game_state* game, struct game_settings* settin
 void game_deinit(struct game_state* game);
 void game_update(struct game_state* game, uint32_t dt_ms, struct game_input* input);
 void game_draw(struct game_state* game);
+
+// Simulation state snapshots. A snapshot is a plain block of
+// game_snapshot_size bytes that can be stored anywhere and restored into the
+// same game, e.g. for save states, crash repros or rollback.
+uint64_t game_snapshot_size(struct game_state* game);
+void game_snapshot_save(struct game_state* game, void* dst);
+enum game_status game_snapshot_restore(struct game_state* game, const void* src, uint64_t size);
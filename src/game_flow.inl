@@ -1,79 +1,157 @@
-static enum game_status load_meshes(struct game_state* game)
+static enum rsrc_status read_stream(void* stream, void* dst, uint64_t nbytes)
 {
-    uint8_t* buf = 0;
-    uint32_t buf_size = 0;
-    if (file_load_binary("res/meshes/box.mesh", &buf, &buf_size) != FILE_OK)
-        goto error;
+    return file_stream_read(stream, dst, nbytes) == FILE_OK ? RSRC_OK : RSRC_FAILURE;
+}
 
-    if (rsrc_mesh_load(&game->cube_mesh, buf, buf_size) != RSRC_OK)
-        goto error;
+static const char* cube_mesh_path = "res/meshes/box.mesh";
+static const char* buddha_mesh_path = "res/meshes/buddha.mesh";
+
+// Meshes are streamed into their buffers through a small ring, so loading
+// never holds a whole mesh file besides the mesh itself.
+static enum game_status stream_mesh(const char* path, struct rsrc_mesh* mesh)
+{
+    const uint32_t ring_size = 256 * 1024;
 
-    if (file_load_binary("res/meshes/buddha.mesh", &buf, &buf_size) != FILE_OK)
+    struct file_stream stream = {};
+    if (file_stream_open(path, ring_size, &stream) != FILE_OK)
         goto error;
 
-    if (rsrc_mesh_load(&game->buddha_mesh, buf, buf_size) != RSRC_OK)
+    if (rsrc_mesh_load_stream(mesh, read_stream, &stream) != RSRC_OK)
         goto error;
 
-    file_unload_binary(&buf);
+    file_stream_close(&stream);
 
     return GAME_OK;
 
 error:
-    file_unload_binary(&buf);
-    game_log("ERROR: Failed to load meshes.\n");
-
-    rsrc_mesh_unload(&game->cube_mesh);
-    rsrc_mesh_unload(&game->buddha_mesh);
+    file_stream_close(&stream);
 
     return GAME_FAILURE;
 }
 
-static enum game_status load_fonts(struct game_state* game)
+static enum game_status load_meshes(struct game_state* game)
 {
-    uint8_t* buf = 0;
-    uint32_t buf_size = 0;
-    if (file_load_binary("res/fonts/roboto.fnt", &buf, &buf_size) != FILE_OK)
-        goto error;
+    if (stream_mesh(cube_mesh_path, &game->cube_mesh) != GAME_OK
+        || stream_mesh(buddha_mesh_path, &game->buddha_mesh) != GAME_OK) {
+        game_log("ERROR: Failed to load meshes.\n");
+        return GAME_FAILURE;
+    }
+
+    return GAME_OK;
+}
 
-    if (rsrc_font_load(&game->roboto_font, buf, buf_size) != RSRC_OK)
+static enum game_status load_fonts(struct game_state* game, struct file_async_read* file)
+{
+    if (file->status != FILE_OK)
         goto error;
 
-    file_unload_binary(&buf);
+    if (rsrc_font_load(&game->roboto_font, file->buf, file->size) != RSRC_OK)
+        goto error;
 
     return GAME_OK;
 
 error:
-    file_unload_binary(&buf);
-    rsrc_font_unload(&game->roboto_font);
-
     game_log("ERROR: Failed to load fonts.\n");
 
     return GAME_FAILURE;
 }
 
-static enum game_status load_textures(struct game_state* game)
+static enum game_status load_textures(struct game_state* game, struct file_async_read* file)
 {
-    uint8_t* buf = 0;
-    uint32_t buf_size = 0;
-    if (file_load_binary("res/textures/panda.png", &buf, &buf_size) != FILE_OK)
+    if (file->status != FILE_OK)
         goto error;
 
-    if (rsrc_texture_load(&game->panda_tex, buf, buf_size) != RSRC_OK)
+    // stb_image frees its temporaries below the pixels, which the stack
+    // cannot take back, so it decodes on the heap and only the pixels move
+    // to the stack.
+    struct rsrc_texture decoded;
+    if (rsrc_texture_load(&decoded, file->buf, file->size) != RSRC_OK)
         goto error;
 
-    file_unload_binary(&buf);
+    size_t size = (size_t)decoded.width * decoded.height * decoded.ncomps;
+    uint8_t* pixels = mem_stack_alloc(size);
+    if (!pixels) {
+        rsrc_texture_unload(&decoded);
+        goto error;
+    }
+    mem_memcpy(pixels, decoded.data, size);
+
+    game->panda_tex = decoded;
+    game->panda_tex.data = pixels;
+    rsrc_texture_unload(&decoded);
 
     return GAME_OK;
 
 error:
     game_log("ERROR: Failed to load textures.\n");
 
-    file_unload_binary(&buf);
-    rsrc_texture_unload(&game->panda_tex);
-
     return GAME_FAILURE;
 }
 
+// CPU-side resources are allocated back to back on the memory stack, so a
+// failure anywhere in the phase is undone by a single rollback. While
+// watching assets the meshes go to the heap instead: reload_mesh frees them
+// one at a time, which the stack can only do for its topmost block.
+//
+// Textures and fonts are read in the background while the meshes are
+// streamed in.
+static enum game_status load_resources(struct game_state* game)
+{
+    struct mem_stack_marker marker = mem_stack_mark();
+
+    struct file_async_read reads[] = {
+        { .path = "res/textures/panda.png" },
+        { .path = "res/fonts/roboto.fnt" },
+    };
+    file_read_async(reads, sizeof(reads) / sizeof(reads[0]));
+
+    if (!game->watching_assets)
+        rsrc_set_mem(mem_stack_alloc, mem_free, mem_stack_realloc);
+
+    enum game_status status = load_meshes(game);
+
+    rsrc_set_mem(mem_stack_alloc, mem_free, mem_stack_realloc);
+
+    file_async_wait();
+
+    if (status == GAME_OK
+        && load_textures(game, &reads[0]) == GAME_OK
+        && load_fonts(game, &reads[1]) == GAME_OK) {
+        status = GAME_OK;
+    } else {
+        status = GAME_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < sizeof(reads) / sizeof(reads[0]); ++i)
+        file_unload_binary(&reads[i].buf);
+
+    rsrc_set_mem(mem_rsrc_alloc, mem_free, mem_rsrc_realloc);
+
+    if (status != GAME_OK) {
+        // Only frees meshes on the heap, the rollback takes the rest.
+        rsrc_mesh_unload(&game->cube_mesh);
+        rsrc_mesh_unload(&game->buddha_mesh);
+        mem_stack_rollback(marker);
+
+        game->panda_tex = (struct rsrc_texture){};
+        game->roboto_font = (struct rsrc_font){};
+    }
+
+    return status;
+}
+
+// Every program is linked from a vertex and a fragment shader of its name.
+static const struct game_program_files {
+    const char* name;
+    const char* vertex_path;
+    const char* fragment_path;
+} game_programs[] = {
+    { "basic", "res/shaders/basic.vs", "res/shaders/basic.fs" }, // mesh program
+    { "text", "res/shaders/text.vs", "res/shaders/text.fs" },
+};
+
+static const uint32_t game_nprograms = sizeof(game_programs) / sizeof(game_programs[0]);
+
 static enum game_status init_shaders(struct game_state* game)
 {
     const char* v_ssrc = 0;
@@ -83,17 +161,19 @@ static enum game_status init_shaders(struct game_state* game)
 
     struct gfx_shader_def defs[2];
 
-    { // Basic mesh program
-        if (file_load_text("res/shaders/basic.vs", &v_ssrc, &v_ssrc_size) != FILE_OK)
+    for (uint32_t prog_i = 0; prog_i < game_nprograms; ++prog_i) {
+        const struct game_program_files* files = &game_programs[prog_i];
+
+        if (file_load_text(files->vertex_path, &v_ssrc, &v_ssrc_size) != FILE_OK)
             goto error;
-        if (file_load_text("res/shaders/basic.fs", &f_ssrc, &f_ssrc_size) != FILE_OK)
+        if (file_load_text(files->fragment_path, &f_ssrc, &f_ssrc_size) != FILE_OK)
             goto error;
 
-        defs[0] = (struct gfx_shader_def){.name = "basic",
+        defs[0] = (struct gfx_shader_def){.name = files->name,
                                           .source = v_ssrc,
                                           .type = GFX_VERTEX_SHADER };
 
-        defs[1] = (struct gfx_shader_def){.name = "basic",
+        defs[1] = (struct gfx_shader_def){.name = files->name,
                                           .source = f_ssrc,
                                           .type = GFX_FRAGMENT_SHADER };
 
@@ -103,91 +183,171 @@ static enum game_status init_shaders(struct game_state* game)
         file_unload_text(&v_ssrc);
         file_unload_text(&f_ssrc);
 
-        struct gfx_program_def basic_prog_def = (struct gfx_program_def){
-            .name = "basic",
-            .vertex_shader_name = "basic",
-            .fragment_shader_name = "basic"
+        struct gfx_program_def prog_def = (struct gfx_program_def){
+            .name = files->name,
+            .vertex_shader_name = files->name,
+            .fragment_shader_name = files->name
         };
 
-        if (gfx_compile_programs(&game->prog_storage_gfx, &basic_prog_def, 1) != GFX_OK)
+        if (gfx_compile_programs(&game->prog_storage_gfx, &prog_def, 1) != GFX_OK)
             goto error;
     }
 
-    { // Basic text program
-        if (file_load_text("res/shaders/text.vs", &v_ssrc, &v_ssrc_size) != FILE_OK)
-            goto error;
-        if (file_load_text("res/shaders/text.fs", &f_ssrc, &f_ssrc_size) != FILE_OK)
-            goto error;
-
-        defs[0] = (struct gfx_shader_def){.name = "text",
-                                          .source = v_ssrc,
-                                          .type = GFX_VERTEX_SHADER };
+    return GAME_OK;
 
-        defs[1] = (struct gfx_shader_def){.name = "text",
-                                          .source = f_ssrc,
-                                          .type = GFX_FRAGMENT_SHADER };
+error:
+    file_unload_text(&v_ssrc);
+    file_unload_text(&f_ssrc);
 
-        if (gfx_compile_shaders(&game->prog_storage_gfx, defs, 2) != GFX_OK)
-            goto error;
+    return GAME_FAILURE;
+}
 
-        file_unload_text(&v_ssrc);
-        file_unload_text(&f_ssrc);
+// Program handles stay the same, so nothing else needs to know.
+static void reload_program(struct game_state* game, const struct game_program_files* files)
+{
+    const char* v_ssrc = 0;
+    uint32_t v_ssrc_size = 0;
+    const char* f_ssrc = 0;
+    uint32_t f_ssrc_size = 0;
 
-        struct gfx_program_def text_prog_def = (struct gfx_program_def){
-            .name = "text",
-            .vertex_shader_name = "text",
-            .fragment_shader_name = "text"
+    if (file_load_text(files->vertex_path, &v_ssrc, &v_ssrc_size) == FILE_OK
+        && file_load_text(files->fragment_path, &f_ssrc, &f_ssrc_size) == FILE_OK) {
+        struct gfx_shader_def defs[2] = {
+            {.name = files->name, .source = v_ssrc, .type = GFX_VERTEX_SHADER },
+            {.name = files->name, .source = f_ssrc, .type = GFX_FRAGMENT_SHADER },
         };
 
-        if (gfx_compile_programs(&game->prog_storage_gfx, &text_prog_def, 1) != GFX_OK)
-            goto error;
+        if (gfx_reload_shaders(&game->prog_storage_gfx, defs, 2) == GFX_OK)
+            game_log("Reloaded program \"%s\".\n", files->name);
+    } else {
+        game_log("ERROR: Cannot read the shaders of \"%s\".\n", files->name);
     }
 
-    return GAME_OK;
-
-error:
     file_unload_text(&v_ssrc);
     file_unload_text(&f_ssrc);
+}
 
-    return GAME_FAILURE;
+// The old mesh stays until the new one is on the GPU, so a half written or
+// broken file changes nothing. Both are on the heap, see load_resources.
+static void reload_mesh(const char* path, struct rsrc_mesh* mesh, struct gfx_mesh* gfx,
+                        const struct rsrc_texture* textures, uint32_t ntextures)
+{
+    struct rsrc_mesh new_mesh = {};
+    struct gfx_mesh new_gfx;
+    if (stream_mesh(path, &new_mesh) != GAME_OK
+        || gfx_mesh_create(&new_gfx, &new_mesh, textures, ntextures) != GFX_OK) {
+        game_log("ERROR: Cannot reload %s.\n", path);
+        rsrc_mesh_unload(&new_mesh);
+        return;
+    }
+
+    gfx_mesh_destroy(gfx);
+    rsrc_mesh_unload(mesh);
+
+    *mesh = new_mesh;
+    *gfx = new_gfx;
+    game_log("Reloaded %s.\n", path);
+}
+
+// Rebuilds only what was made from the changed file, other files are ignored.
+static void reload_asset(struct game_state* game, const char* path)
+{
+    for (uint32_t prog_i = 0; prog_i < game_nprograms; ++prog_i) {
+        const struct game_program_files* files = &game_programs[prog_i];
+        if (strcmp(path, files->vertex_path) == 0 || strcmp(path, files->fragment_path) == 0)
+            reload_program(game, files);
+    }
+
+    if (strcmp(path, cube_mesh_path) == 0)
+        reload_mesh(path, &game->cube_mesh, &game->cube_gfx, &game->panda_tex, 1);
+    else if (strcmp(path, buddha_mesh_path) == 0)
+        reload_mesh(path, &game->buddha_mesh, &game->buddha_gfx, 0, 0);
 }
 
 enum game_status game_init(struct game_state* game, struct game_settings* settings)
 {
     // Init logging
+    mem_set_log(game_log);
     cam_set_log(game_log);
     rsrc_set_log(game_log);
     gpu_set_log(game_log);
     gfx_set_log(game_log);
+    str_id_set_log(game_log);
+    jobs_set_log(game_log);
+    watch_set_log(game_log);
+
+    // Memory
+    if (mem_heap_init(settings->heap_size) != MEM_OK)
+        goto error;
+    if (mem_slab_init(settings->slab_mem_size) != MEM_OK)
+        goto error;
+    if (mem_frame_init(settings->frame_mem_size) != MEM_OK)
+        goto error;
+    if (mem_stack_init(settings->load_mem_size) != MEM_OK)
+        goto error;
+    file_set_mem(mem_free, mem_realloc);
+    str_id_set_mem(mem_alloc, mem_free);
+    if (!str_id_init(settings->str_id_mem_size))
+        goto error;
+
+    if (settings->access_trace_path) {
+        game->access_trace_path = settings->access_trace_path;
+        game->access_trace_frames = settings->access_trace_frames;
+        file_trace_begin();
+    }
+
+    // Workers and background file reads
+    if (jobs_init(0) != JOBS_OK)
+        goto error;
+    if (file_async_init(64) != FILE_OK)
+        goto error;
+
+    { // Loose files in res, shadowed by the pak, shadowed by patches. While
+      // watching, edits in res win over both.
+        file_mount_handle mount;
+        if (file_mount_dir("res", "res", settings->watch_assets ? 3 : 0, &mount) != FILE_OK)
+            game_log("WARNING: Cannot index res.\n");
+        if (file_mount_pak("data.pak", 1, &mount) != FILE_OK)
+            game_log("WARNING: No data.pak, loading loose files from res.\n");
+        file_mount_dir("patch", "res", 2, &mount); // optional
+    }
+
+    if (settings->watch_assets) {
+        game->watching_assets = watch_init("res") == WATCH_OK;
+        if (!game->watching_assets)
+            game_log("WARNING: Cannot watch res, edited assets are not reloaded.\n");
+    }
+
+    { // Offline string table, runtime interning covers everything without it
+        if (file_map("res/strings.sid", FILE_ACCESS_RANDOM, &game->strings_table) != FILE_OK
+            || !str_id_load_table(game->strings_table.data, game->strings_table.size)) {
+            game_log("WARNING: No offline string table, names are interned at runtime.\n");
+            file_unmap(&game->strings_table);
+        }
+    }
 
     // Resources
     if (rsrc_init() != RSRC_OK)
         goto error;
-    rsrc_set_mem(mem_alloc, mem_free, mem_realloc);
+    rsrc_set_mem(mem_rsrc_alloc, mem_free, mem_rsrc_realloc);
+    rsrc_set_image_mem(mem_stbi_alloc, mem_free, mem_stbi_realloc);
 
     // Graphics
     if (gfx_init(settings->screen_size) != GFX_OK)
         goto error;
-    gfx_set_mem(mem_alloc, mem_free, mem_realloc);
+    gfx_set_mem(mem_gfx_alloc, mem_free, mem_gfx_realloc);
 
-    { // Load resources
-        if (load_meshes(game) != GAME_OK)
-            goto error;
-        if (load_textures(game) != GAME_OK)
-            goto error;
-        if (load_fonts(game) != GAME_OK)
-            goto error;
-    }
+    if (load_resources(game) != GAME_OK)
+        goto error;
 
     if (init_shaders(game) != GAME_OK)
         goto error;
 
-    { // Create render groups
-        struct gfx_program* basic_prog = 0;
-
-        if (gfx_get_program(&game->prog_storage_gfx, "basic", &basic_prog) != GFX_OK)
-            goto error;
+    if (gfx_find_program(&game->prog_storage_gfx, SID(basic), &game->basic_prog) != GFX_OK
+        || gfx_find_program(&game->prog_storage_gfx, SID(text), &game->text_prog) != GFX_OK)
+        goto error;
 
+    { // Create render groups
         if (gfx_mesh_create(&game->buddha_gfx, &game->buddha_mesh, 0, 0)
             != GFX_OK)
             goto error;
@@ -197,11 +357,6 @@ enum game_status game_init(struct game_state* game, struct game_settings* settin
     }
 
     { // Create font for debug rendering
-        struct gfx_program* prog = 0;
-
-        if (gfx_get_program(&game->prog_storage_gfx, "text", &prog) != GFX_OK)
-            goto error;
-
         if (gfx_font_create(&game->gfx_roboto_font, &game->roboto_font) != GFX_OK)
             goto error;
     }
@@ -212,12 +367,42 @@ enum game_status game_init(struct game_state* game, struct game_settings* settin
         }
     }
 
-    { // Init camera
-        cam_noroll_init(&game->camera, (v3){.x = 0.0f, .y = 0.0f, .z = -3.0f },
+    { // Init simulation state
+        uint32_t entities_size = GAME_MAX_ENTITIES * sizeof(struct game_entity);
+        if (mem_rel_init(&game->sim_arena, sizeof(struct game_sim) + entities_size + 64) != MEM_OK)
+            goto error;
+
+        game->sim = mem_rel_alloc(&game->sim_arena, sizeof(struct game_sim));
+        if (!game->sim)
+            goto error;
+
+        struct game_sim* sim = game_sim(game);
+        sim->entities = mem_rel_alloc(&game->sim_arena, entities_size);
+        if (!sim->entities)
+            goto error;
+
+        game->quicksave = mem_alloc(game->sim_arena.capacity);
+        if (!game->quicksave)
+            goto error;
+        game->quicksave_size = 0;
+
+        cam_noroll_init(&sim->camera, (v3){.x = 0.0f, .y = 0.0f, .z = -3.0f },
                         0.017f * 180.0f, 0.0f);
-    }
 
-    game->light_pos = (v3){.x = 0.0f, .y = 0.0f, .z = 0.0f };
+        sim->light_pos = (v3){.x = 0.0f, .y = 0.0f, .z = 0.0f };
+
+        struct game_entity* entities = game_entities(game);
+        entities[sim->nentities++] = (struct game_entity){
+            .position = {.x = 1.0f },
+            .scale = {.x = 1.0f, .y = 1.0f, .z = 1.0f },
+            .mesh = GAME_MESH_CUBE,
+        };
+        entities[sim->nentities++] = (struct game_entity){
+            .position = {.x = -1.0f, .y = -1.0f },
+            .scale = {.x = 0.3f, .y = 0.3f, .z = 0.3f },
+            .mesh = GAME_MESH_BUDDHA,
+        };
+    }
 
     return GAME_OK;
 
@@ -226,8 +411,20 @@ error:
     return GAME_FAILURE;
 }
 
+static void end_access_trace(struct game_state* game)
+{
+    if (!game->access_trace_path)
+        return;
+
+    if (file_trace_end(game->access_trace_path) != FILE_OK)
+        game_log("ERROR: Cannot write access trace %s.\n", game->access_trace_path);
+    game->access_trace_path = 0;
+}
+
 void game_deinit(struct game_state* game)
 {
+    end_access_trace(game);
+
     // Deinit drawables
     gfx_mesh_destroy(&game->cube_gfx);
     gfx_mesh_destroy(&game->buddha_gfx);
@@ -235,19 +432,55 @@ void game_deinit(struct game_state* game)
     gfx_font_destroy(&game->gfx_roboto_font);
     gfx_text_destroy(&game->gfx_fps_txt);
 
+    gfx_program_storage_destroy(&game->prog_storage_gfx);
+
     // Release resources
     rsrc_mesh_unload(&game->cube_mesh);
     rsrc_mesh_unload(&game->buddha_mesh);
 
     rsrc_texture_unload(&game->panda_tex);
     rsrc_font_unload(&game->roboto_font);
+
+    // Release simulation state
+    mem_free(game->quicksave);
+    mem_rel_deinit(&game->sim_arena);
+
+    watch_deinit();
+    file_async_deinit();
+    jobs_deinit();
+
+    str_id_deinit();
+    file_unmap(&game->strings_table);
+    file_unmount_all();
+
+    mem_stack_report();
+    mem_stack_deinit();
+
+    mem_frame_report();
+    mem_frame_deinit();
+    mem_scratch_thread_deinit();
+
+    mem_report();
+    mem_slab_report();
+    mem_slab_deinit();
+    mem_heap_report();
+    mem_heap_deinit();
 }
 
 void game_update(struct game_state* game, uint32_t dt_ms, struct game_input* input)
 {
-    game->dt_ms = dt_ms;
+    game_sim(game)->dt_ms = dt_ms;
     handle_input(game, input);
 
+    if (game->access_trace_path && game->access_trace_frames-- == 0)
+        end_access_trace(game);
+
+    if (game->watching_assets) {
+        const char* path;
+        while ((path = watch_poll()) != 0)
+            reload_asset(game, path);
+    }
+
     { // create the fps text
         static const uint32_t nrecords = 30;
         static uint32_t record_i = 0;
@@ -278,14 +511,16 @@ void game_update(struct game_state* game, uint32_t dt_ms, struct game_input* inp
 void game_draw(struct game_state* game)
 {
     { // Draw meshes
-        struct gfx_program* basic_program;
-        if (gfx_get_program(&game->prog_storage_gfx, "basic", &basic_program) != GFX_OK)
+        struct gfx_program* basic_program = gfx_program_get(&game->prog_storage_gfx, game->basic_prog);
+        if (!basic_program)
             goto error;
 
         gfx_activate_program(basic_program);
 
+        struct game_sim* sim = game_sim(game);
+
         m4 view;
-        m4_view_from_quat(&view, game->camera.orientation, game->camera.position);
+        m4_view_from_quat(&view, sim->camera.orientation, sim->camera.position);
         gfx_update_view(&view, basic_program);
 
         // This can be done once on relevant programs' init.
@@ -296,34 +531,35 @@ void game_draw(struct game_state* game)
 
         {
             gpu_uniform light_pos;
-            gpu_get_uniform(basic_program->program, "light_pos", &light_pos);
+            gfx_get_uniform(basic_program, SID(light_pos), &light_pos);
 
-            gpu_set_uniform_3f(light_pos, game->light_pos.data);
+            gpu_set_uniform_3f(light_pos, sim->light_pos.data);
         }
 
-        m4 cube_model;
-        m4 buddha_model;
-        m4 light_model;
-        m4_unit(&cube_model);
-        m4_unit(&buddha_model);
-        m4_unit(&light_model);
+        struct game_entity* entities = game_entities(game);
+        for (uint32_t i = 0; i < sim->nentities; ++i) {
+            struct game_entity* e = &entities[i];
 
-        m4_set_translation(&light_model, game->light_pos);
-        m4_set_scale(&light_model, (struct v3){.x = 0.1f, .y = 0.1f, .z = 0.1f });
+            m4 model;
+            m4_unit(&model);
+            m4_set_translation(&model, e->position);
+            m4_set_scale(&model, e->scale);
 
-        m4_set_translation(&cube_model, (struct v3){.x = 1.0f });
+            struct gfx_mesh* mesh = e->mesh == GAME_MESH_BUDDHA ? &game->buddha_gfx : &game->cube_gfx;
+            gfx_mesh_draw(mesh, basic_program, &model, 1);
+        }
 
-        m4_set_translation(&buddha_model, (struct v3){.x = -1.0f, .y = -1.0f });
-        m4_set_scale(&buddha_model, (struct v3){.x = 0.3f, .y = 0.3f, .z = 0.3f });
+        m4 light_model;
+        m4_unit(&light_model);
+        m4_set_translation(&light_model, sim->light_pos);
+        m4_set_scale(&light_model, (struct v3){.x = 0.1f, .y = 0.1f, .z = 0.1f });
 
-        gfx_mesh_draw(&game->cube_gfx, basic_program, &cube_model, 1);
-        gfx_mesh_draw(&game->buddha_gfx, basic_program, &buddha_model, 1);
         gfx_mesh_draw(&game->cube_gfx, basic_program, &light_model, 1);
     }
 
     { // Draw on-screen text
-        struct gfx_program* text_program;
-        if (gfx_get_program(&game->prog_storage_gfx, "text", &text_program) != GFX_OK)
+        struct gfx_program* text_program = gfx_program_get(&game->prog_storage_gfx, game->text_prog);
+        if (!text_program)
             goto error;
 
         gfx_activate_program(text_program);
@@ -2,10 +2,14 @@ void game_input_reset(struct game_input* inp)
 {
     inp->mouse_dx = 0;
     inp->mouse_dy = 0;
+    inp->f5_pressed = 0;
+    inp->f9_pressed = 0;
 }
 
 static void handle_input(struct game_state* game, struct game_input* input)
 {
+    struct game_sim* sim = game_sim(game);
+
     uint8_t camera_updated = 0;
     float cam_speed = 0.05f;
     float cam_rot_speed = 0.009f;
@@ -54,30 +58,40 @@ static void handle_input(struct game_state* game, struct game_input* input)
     }
 
     if (camera_updated != 0) {
-        cam_noroll_update(&game->camera, yaw_d, pitch_d, pos_off);
+        cam_noroll_update(&sim->camera, yaw_d, pitch_d, pos_off);
     }
 
     if(input->i_down) {
-        game->light_pos.y += 0.05f;
+        sim->light_pos.y += 0.05f;
     }
 
     if(input->j_down) {
-        game->light_pos.x -= 0.05f;
+        sim->light_pos.x -= 0.05f;
     }
 
     if(input->k_down) {
-        game->light_pos.y -= 0.05f;
+        sim->light_pos.y -= 0.05f;
     }
 
     if(input->l_down) {
-        game->light_pos.x += 0.05f;
+        sim->light_pos.x += 0.05f;
     }
 
     if(input->u_down) {
-        game->light_pos.z += 0.05f;
+        sim->light_pos.z += 0.05f;
     }
 
     if(input->o_down) {
-        game->light_pos.z -= 0.05f;
+        sim->light_pos.z -= 0.05f;
+    }
+
+    if (input->f5_pressed) {
+        game->quicksave_size = game_snapshot_size(game);
+        game_snapshot_save(game, game->quicksave);
+        game_log("Quick saved %llu bytes.\n", (unsigned long long)game->quicksave_size);
+    }
+
+    if (input->f9_pressed && game->quicksave_size) {
+        game_snapshot_restore(game, game->quicksave, game->quicksave_size);
     }
 }
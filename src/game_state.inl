@@ -1,5 +1,27 @@
 static const uint32_t GAME_MAX_ENTITIES = 1024;
 
+enum game_mesh_id { GAME_MESH_CUBE = 0,
+                    GAME_MESH_BUDDHA };
+
+struct game_entity {
+    v3 position;
+    v3 scale;
+    uint32_t mesh; // enum game_mesh_id
+};
+
+// Everything the simulation advances. Lives in game_state.sim_arena and refers
+// to its own data only by arena offsets, so a snapshot of it is one copy.
+struct game_sim {
+    struct cam_noroll camera;
+
+    uint32_t dt_ms;
+
+    v3 light_pos;
+
+    mem_rel_ptr entities; // struct game_entity[GAME_MAX_ENTITIES]
+    uint32_t nentities;
+};
+
 struct game_state {
     // RAM Resources
     struct rsrc_mesh cube_mesh;
@@ -9,6 +31,8 @@ struct game_state {
 
     // Rendering state
     struct gfx_program_storage prog_storage_gfx;
+    gfx_program_handle basic_prog;
+    gfx_program_handle text_prog;
 
     struct gfx_mesh cube_gfx;
     struct gfx_mesh buddha_gfx;
@@ -16,11 +40,50 @@ struct game_state {
     struct gfx_font gfx_roboto_font;
 
     struct gfx_text gfx_fps_txt;
-    
-    struct cam_noroll camera;
 
-    uint32_t dt_ms;
+    struct file_mapping strings_table; // see str_id_load_table
 
-    v3 light_pos;
+    // Simulation state
+    struct mem_rel_arena sim_arena;
+    mem_rel_ptr sim; // struct game_sim
+
+    void* quicksave;
+    uint64_t quicksave_size;
+
+    // File access trace, see game_settings
+    const char* access_trace_path;
+    uint32_t access_trace_frames; // left until it is written
+
+    uint8_t watching_assets; // see game_settings.watch_assets
 };
 const uint64_t game_state_size = sizeof(struct game_state);
+
+static struct game_sim* game_sim(struct game_state* game)
+{
+    return mem_rel_get(&game->sim_arena, game->sim);
+}
+
+static struct game_entity* game_entities(struct game_state* game)
+{
+    return mem_rel_get(&game->sim_arena, game_sim(game)->entities);
+}
+
+uint64_t game_snapshot_size(struct game_state* game)
+{
+    return game->sim_arena.used;
+}
+
+void game_snapshot_save(struct game_state* game, void* dst)
+{
+    mem_rel_save(&game->sim_arena, dst);
+}
+
+enum game_status game_snapshot_restore(struct game_state* game, const void* src, uint64_t size)
+{
+    if (mem_rel_restore(&game->sim_arena, src, (uint32_t)size) != MEM_OK) {
+        game_log("ERROR: Cannot restore game snapshot.\n");
+        return GAME_FAILURE;
+    }
+
+    return GAME_OK;
+}
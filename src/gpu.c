@@ -1,17 +1,13 @@
 #include "gpu.h"
+#include "memory.h"
+
+#include <math.h>
+#include <string.h>
 
 #define GPU_GL_ERROR_CHECK 1
 
 static gpu_log_fptr text_log = NULL;
 
-static void gpu_memcpy(void* dst, const void* src, uint32_t nbytes)
-{
-    uint8_t* d = dst;
-    const uint8_t* s = src;
-    for (; nbytes; --nbytes)
-        *d++ = *s++;
-}
-
 void gpu_set_log(gpu_log_fptr l) { text_log = l; }
 
 static GLenum check_gl_errors(const char* desc)
@@ -84,14 +80,36 @@ enum gpu_status gpu_link_program(GLuint* dst, GLuint vertex_shader,
     if (check_gl_errors("glLinkProgram") != GL_NO_ERROR)
         goto error;
 
+    { // Check program linking
+        GLint success;
+        GLint log_len;
+        char log_buf[1024];
+        glGetProgramiv(p, GL_LINK_STATUS, &success);
+        if (success == GL_FALSE) {
+            glGetProgramiv(p, GL_INFO_LOG_LENGTH, &log_len);
+            if (log_len > 1024)
+                log_len = 1024;
+            glGetProgramInfoLog(p, log_len, 0, log_buf);
+
+            text_log("ERROR [program linking]:\n%s\n", log_buf);
+            goto error;
+        }
+    }
+
     *dst = p;
 
     return GPU_OK;
 
 error:
+    glDeleteProgram(p);
     return GPU_FAILURE;
 }
 
+void gpu_program_destroy(gpu_program p)
+{
+    glDeleteProgram(p);
+}
+
 enum gpu_status gpu_compile_shader(GLuint* dst, GLenum shader_type,
                                    const char* source)
 {
@@ -133,6 +151,7 @@ enum gpu_status gpu_compile_shader(GLuint* dst, GLenum shader_type,
             }
 
             text_log("ERROR [%s compilation]:\n%s\n", shader_type_name, log_buf);
+            glDeleteShader(result);
             return GPU_FAILURE;
         }
     }
@@ -144,6 +163,11 @@ error:
     return GPU_FAILURE;
 }
 
+void gpu_shader_destroy(gpu_shader s)
+{
+    glDeleteShader(s);
+}
+
 enum gpu_status gpu_activate_program(gpu_program p)
 {
     glUseProgram(p);
@@ -177,38 +201,202 @@ uint8_t gpu_pack_verts(void* outbuf, float* positions, float* normals,
         vert_nfloats += 3;
     }
 
-    uint32_t start_offset = 0;
-    if (positions) {
-        float* o = outbuf;
-        o += start_offset;
-        for (uint32_t vert_i = 0; vert_i < nverts; ++vert_i) {
-            gpu_memcpy(o, positions + (vert_i * 3), 3 * sizeof(float));
-            o += vert_nfloats;
+    // A single attribute is already laid out as the vertex buffer wants it.
+    if (vert_nfloats == 3) {
+        float* src = positions ? positions : (normals ? normals : texcoords);
+        mem_memcpy(outbuf, src, (size_t)nverts * 3 * sizeof(float));
+        return res_flags;
+    }
+
+    // Interleave in one pass; the fixed-size copies compile to plain moves.
+    float* o = outbuf;
+    for (uint32_t vert_i = 0; vert_i < nverts; ++vert_i) {
+        if (positions) {
+            memcpy(o, positions + (vert_i * 3), 3 * sizeof(float));
+            o += 3;
+        }
+        if (normals) {
+            memcpy(o, normals + (vert_i * 3), 3 * sizeof(float));
+            o += 3;
+        }
+        if (texcoords) {
+            memcpy(o, texcoords + (vert_i * 3), 3 * sizeof(float));
+            o += 3;
         }
-        start_offset += 3;
     }
 
-    if (normals) {
-        float* o = outbuf;
-        o += start_offset;
-        for (uint32_t vert_i = 0; vert_i < nverts; ++vert_i) {
-            gpu_memcpy(o, normals + (vert_i * 3), 3 * sizeof(float));
-            o += vert_nfloats;
+    return res_flags;
+}
+
+// ---- Quantization ----
+
+// Read back as max(c / 32767, -1) since GL 4.2, and by drivers in general,
+// so 0 and +-1 are exact.
+static int16_t quantize_snorm16(float v)
+{
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return (int16_t)lrintf(v * 32767.0f);
+}
+
+static uint16_t quantize_unorm16(float v)
+{
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint16_t)lrintf(v * 65535.0f);
+}
+
+// Rounds to nearest even; too large values become infinity.
+static uint16_t quantize_half(float v)
+{
+    uint32_t x;
+    memcpy(&x, &v, sizeof(x));
+
+    uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+    uint32_t biased_exp = (x >> 23) & 0xff;
+    uint32_t mantissa = x & 0x7fffff;
+
+    if (biased_exp == 0xff) // inf and nan
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+    int32_t exp = (int32_t)biased_exp - 127 + 15;
+    if (exp >= 31)
+        return sign | 0x7c00;
+
+    uint32_t shift = 13;
+    uint32_t h = ((uint32_t)exp << 10) | (mantissa >> 13);
+    if (exp <= 0) { // denormal
+        if (exp < -10)
+            return sign;
+        mantissa |= 0x800000;
+        shift = (uint32_t)(14 - exp);
+        h = mantissa >> shift;
+    }
+
+    // A carry out of the mantissa correctly bumps the exponent.
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (h & 1)))
+        ++h;
+
+    return sign | (uint16_t)h;
+}
+
+// Projects the normal onto the octahedron |x| + |y| + |z| = 1 and unfolds the
+// lower half over the corners, see basic.vs for the way back.
+static void quantize_oct(const float* n, int16_t* out)
+{
+    float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    float x = l1 > 0.0f ? n[0] / l1 : 0.0f;
+    float y = l1 > 0.0f ? n[1] / l1 : 0.0f;
+
+    if (n[2] < 0.0f) {
+        float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
+
+    out[0] = quantize_snorm16(x);
+    out[1] = quantize_snorm16(y);
+}
+
+gpu_vtx_flags_t gpu_pack_verts_quantized(void* outbuf, const float* positions,
+                                         const float* normals, const float* texcoords,
+                                         uint32_t nverts, gpu_vtx_flags_t encodings,
+                                         const float* position_quant)
+{
+    gpu_vtx_flags_t flags = 0;
+    if (positions) {
+        flags |= GPU_POS;
+        if (encodings & GPU_POS_SNORM16)
+            flags |= GPU_POS_SNORM16; // the finer one, when both are asked for
+        else
+            flags |= encodings & GPU_POS_HALF;
+    }
+    if (normals)
+        flags |= GPU_NORM | (encodings & GPU_NORM_OCT);
+    if (texcoords)
+        flags |= GPU_TEXCOORD | (encodings & GPU_TEXCOORD_UNORM16);
+
+    float scale[3] = { 1.0f, 1.0f, 1.0f };
+    float bias[3] = { 0.0f, 0.0f, 0.0f };
+    if (position_quant) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            scale[i] = position_quant[i] != 0.0f ? 1.0f / position_quant[i] : 0.0f;
+            bias[i] = position_quant[3 + i];
         }
-        start_offset += 3;
     }
 
-    if (texcoords) {
-        float* o = outbuf;
-        o += start_offset;
-        for (uint32_t vert_i = 0; vert_i < nverts; ++vert_i) {
-            gpu_memcpy(o, texcoords + (vert_i * 3), 3 * sizeof(float));
-            o += vert_nfloats;
+    uint8_t* o = outbuf;
+    for (uint32_t vert_i = 0; vert_i < nverts; ++vert_i) {
+        if (positions) {
+            const float* p = positions + (vert_i * 3);
+            if (flags & (GPU_POS_SNORM16 | GPU_POS_HALF)) {
+                uint16_t q[4] = { 0, 0, 0, 0 };
+                for (uint32_t i = 0; i < 3; ++i) {
+                    float v = (p[i] - bias[i]) * scale[i];
+                    q[i] = (flags & GPU_POS_SNORM16) ? (uint16_t)quantize_snorm16(v) : quantize_half(v);
+                }
+                memcpy(o, q, sizeof(q));
+                o += sizeof(q);
+            } else {
+                memcpy(o, p, 3 * sizeof(float));
+                o += 3 * sizeof(float);
+            }
+        }
+
+        if (normals) {
+            if (flags & GPU_NORM_OCT) {
+                int16_t q[2];
+                quantize_oct(normals + (vert_i * 3), q);
+                memcpy(o, q, sizeof(q));
+                o += sizeof(q);
+            } else {
+                memcpy(o, normals + (vert_i * 3), 3 * sizeof(float));
+                o += 3 * sizeof(float);
+            }
+        }
+
+        if (texcoords) {
+            if (flags & GPU_TEXCOORD_UNORM16) {
+                uint16_t q[2] = { quantize_unorm16(texcoords[vert_i * 3]),
+                                  quantize_unorm16(texcoords[vert_i * 3 + 1]) };
+                memcpy(o, q, sizeof(q));
+                o += sizeof(q);
+            } else {
+                memcpy(o, texcoords + (vert_i * 3), 3 * sizeof(float));
+                o += 3 * sizeof(float);
+            }
         }
-        start_offset += 3;
     }
 
-    return res_flags;
+    return flags;
+}
+
+// Bytes of each attribute, 0 when it is left out.
+static uint32_t position_size(gpu_vtx_flags_t flags)
+{
+    if ((flags & GPU_POS) == 0)
+        return 0;
+    return (flags & (GPU_POS_SNORM16 | GPU_POS_HALF)) ? 4 * sizeof(uint16_t) : 3 * sizeof(float);
+}
+
+static uint32_t normal_size(gpu_vtx_flags_t flags)
+{
+    if ((flags & GPU_NORM) == 0)
+        return 0;
+    return (flags & GPU_NORM_OCT) ? 2 * sizeof(int16_t) : 3 * sizeof(float);
+}
+
+static uint32_t texcoord_size(gpu_vtx_flags_t flags)
+{
+    if ((flags & GPU_TEXCOORD) == 0)
+        return 0;
+    return (flags & GPU_TEXCOORD_UNORM16) ? 2 * sizeof(uint16_t) : 3 * sizeof(float);
+}
+
+uint32_t gpu_vertex_size(gpu_vtx_flags_t flags)
+{
+    return position_size(flags) + normal_size(flags) + texcoord_size(flags);
 }
 
 enum gpu_status gpu_vertex_buffer_create(struct gpu_vertex_buffer* buf, const void* vertices, uint8_t vert_flags, const uint32_t* indices, uint32_t nverts, uint32_t nindices)
@@ -224,13 +412,7 @@ enum gpu_status gpu_vertex_buffer_create(struct gpu_vertex_buffer* buf, const vo
     if (check_gl_errors("glGenBuffers") != GL_NO_ERROR)
         goto error;
 
-    uint32_t vert_nbytes = 0;
-    if ((vert_flags & GPU_POS) != 0)
-        vert_nbytes += (3 * sizeof(float));
-    if ((vert_flags & GPU_NORM) != 0)
-        vert_nbytes += (3 * sizeof(float));
-    if ((vert_flags & GPU_TEXCOORD) != 0)
-        vert_nbytes += (3 * sizeof(float));
+    uint32_t vert_nbytes = gpu_vertex_size(vert_flags);
 
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vb);
@@ -244,27 +426,38 @@ enum gpu_status gpu_vertex_buffer_create(struct gpu_vertex_buffer* buf, const vo
     if (check_gl_errors("glBufferData") != GL_NO_ERROR)
         goto error;
 
-    float* stride = NULL;
+    uint8_t* offset = NULL;
 
     // 0: positions
     if ((vert_flags & GPU_POS) != 0) {
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vert_nbytes, 0);
-        stride += 3;
+        if ((vert_flags & GPU_POS_SNORM16) != 0)
+            glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, vert_nbytes, offset);
+        else if ((vert_flags & GPU_POS_HALF) != 0)
+            glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, vert_nbytes, offset);
+        else
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vert_nbytes, offset);
+        offset += position_size(vert_flags);
     }
 
     // 1: normals
     if ((vert_flags & GPU_NORM) != 0) {
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vert_nbytes, stride);
-        stride += 3;
+        if ((vert_flags & GPU_NORM_OCT) != 0)
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, vert_nbytes, offset);
+        else
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vert_nbytes, offset);
+        offset += normal_size(vert_flags);
     }
 
     // 2: texture coordinates
     if ((vert_flags & GPU_TEXCOORD) != 0) {
         glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, vert_nbytes, stride);
-        stride += 3;
+        if ((vert_flags & GPU_TEXCOORD_UNORM16) != 0)
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, vert_nbytes, offset);
+        else
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, vert_nbytes, offset);
+        offset += texcoord_size(vert_flags);
     }
 
     if (check_gl_errors("defining vertex attribute pointers") != GL_NO_ERROR)
@@ -380,6 +573,39 @@ error:
     return GPU_FAILURE;
 }
 
+uint32_t gpu_program_nuniforms(gpu_program program)
+{
+    GLint n = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &n);
+    if (check_gl_errors("getting number of uniforms") != GL_NO_ERROR)
+        return 0;
+
+    return (uint32_t)n;
+}
+
+enum gpu_status gpu_program_uniform(gpu_program program, uint32_t idx,
+                                    char* name, uint32_t name_size,
+                                    gpu_uniform* uniform)
+{
+    GLsizei len = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program, idx, name_size, &len, &size, &type, name);
+    if (check_gl_errors("getting active uniform") != GL_NO_ERROR)
+        goto error;
+
+    if (len > 3 && strcmp(name + len - 3, "[0]") == 0)
+        name[len - 3] = '\0';
+
+    *uniform = glGetUniformLocation(program, name);
+
+    return GPU_OK;
+
+error:
+    text_log("ERROR: Could not retrieve uniform %u.\n", idx);
+    return GPU_FAILURE;
+}
+
 enum gpu_status gpu_set_uniform_i(gpu_uniform uniform, int32_t value)
 {
     glUniform1i(uniform, value);
@@ -494,7 +720,7 @@ enum gpu_status gpu_uniform_buf_update(struct gpu_uniform_buf* ub, void* data,
     if (p == NULL)
         return GPU_FAILURE;
 
-    gpu_memcpy(p, data, nbytes);
+    mem_memcpy(p, data, nbytes);
 
     glUnmapBuffer(GL_UNIFORM_BUFFER);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
@@ -14,9 +14,16 @@ enum gpu_status { GPU_OK = 0,
                   GPU_FAILURE };
 
 enum gpu_vertex_flags {
-    GPU_POS = (1 << 0), // positions; size: 4 * sizeof(float)
+    GPU_POS = (1 << 0), // positions; size: 3 * sizeof(float)
     GPU_NORM = (1 << 1), // normals; size: 3 * sizeof(float)
-    GPU_TEXCOORD = (1 << 2) // texture coords; size: 2 * sizeof(float)
+    GPU_TEXCOORD = (1 << 2), // texture coords; size: 3 * sizeof(float)
+
+    // Quantized encodings, set along with the attribute they replace. At most
+    // one per attribute.
+    GPU_POS_HALF = (1 << 3), // half floats, padded to 4; size: 4 * 2
+    GPU_POS_SNORM16 = (1 << 4), // normalized int16, padded to 4; size: 4 * 2
+    GPU_NORM_OCT = (1 << 5), // octahedral, normalized int16; size: 2 * 2
+    GPU_TEXCOORD_UNORM16 = (1 << 6) // u, v as normalized uint16; size: 2 * 2
 };
 extern const uint32_t gpu_max_vert_bytes;
 
@@ -30,13 +37,28 @@ typedef uint8_t gpu_vtx_flags_t;
 gpu_vtx_flags_t gpu_pack_verts(void* outbuf, float* positions, float* normals,
                                float* texcoords, uint32_t nverts);
 
+// Same as gpu_pack_verts, with the attributes in the quantized encodings
+// asked for in `encodings`. Quantized positions are stored as
+// (position - bias) / scale per axis, with position_quant holding scale xyz
+// then bias xyz, and should fall in [-1, 1]. Normals must be unit length,
+// texture coords in [0, 1]; values outside are clamped.
+gpu_vtx_flags_t gpu_pack_verts_quantized(void* outbuf, const float* positions,
+                                         const float* normals, const float* texcoords,
+                                         uint32_t nverts, gpu_vtx_flags_t encodings,
+                                         const float* position_quant);
+
+// Bytes of one vertex as packed by gpu_pack_verts.
+uint32_t gpu_vertex_size(gpu_vtx_flags_t flags);
+
 // ---- Shaders ----
 
 enum gpu_status gpu_link_program(gpu_program* dst, gpu_shader vertex_shader,
                                  gpu_shader fragment_shader);
+void gpu_program_destroy(gpu_program p);
 
 enum gpu_status gpu_compile_shader(gpu_shader* dst, GLenum shader_type,
                                    const char* source);
+void gpu_shader_destroy(gpu_shader s);
 
 enum gpu_status gpu_activate_program(gpu_program p);
 
@@ -79,6 +101,14 @@ typedef GLint gpu_uniform;
 enum gpu_status gpu_get_uniform(gpu_program program, const char* name,
                                 gpu_uniform* uniform);
 
+// Enumerates the active uniforms of a linked program. Array names are
+// reported without the "[0]" suffix, and uniforms without a location (e.g.
+// in uniform blocks) get -1.
+uint32_t gpu_program_nuniforms(gpu_program program);
+enum gpu_status gpu_program_uniform(gpu_program program, uint32_t idx,
+                                    char* name, uint32_t name_size,
+                                    gpu_uniform* uniform);
+
 enum gpu_status gpu_set_uniform_i(gpu_uniform uniform, int32_t value);
 enum gpu_status gpu_set_uniform_2f(gpu_uniform uniform, const float* values);
 enum gpu_status gpu_set_uniform_3f(gpu_uniform uniform, const float* values);
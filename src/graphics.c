@@ -1,10 +1,6 @@
 #include "graphics.h"
 
-static const char* model_uni_name = "model";
-static const char* projection_uni_name = "projection";
-static const char* view_uni_name = "view";
-
-static const char* text_position_uni_name = "position";
+#include "memory.h"
 
 static const char* tex0_sampler_name = "tex0";
 
@@ -39,23 +35,102 @@ void gfx_set_mem(gfx_malloc_fptr m, gfx_free_fptr f, gfx_realloc_fptr r)
     gfx_realloc = r;
 }
 
+#define GFX_INDEX_MIN_CAPACITY 64
+
+static uint64_t shader_key(str_id id, enum gfx_shader_type type)
+{
+    uint64_t key = id ^ ((uint64_t)type * 0x9e3779b97f4a7c15ull);
+    return key ? key : 1;
+}
+
+// Slot holding the key, or the empty slot where it would go.
+static uint32_t index_slot(const struct gfx_index* index, uint64_t key)
+{
+    uint32_t mask = index->capacity - 1;
+    uint32_t idx = (uint32_t)(key ^ (key >> 32)) & mask;
+    while (index->keys[idx] != 0 && index->keys[idx] != key)
+        idx = (idx + 1) & mask;
+
+    return idx;
+}
+
+static enum gfx_status index_find(const struct gfx_index* index, uint64_t key, uint32_t* value)
+{
+    if (index->capacity == 0)
+        return GFX_FAILURE;
+
+    uint32_t slot = index_slot(index, key);
+    if (index->keys[slot] != key)
+        return GFX_FAILURE;
+
+    *value = index->values[slot];
+    return GFX_OK;
+}
+
+static enum gfx_status index_insert(struct gfx_index* index, uint64_t key, uint32_t value)
+{
+    if ((index->count + 1) * 2 > index->capacity) { // Keep at most half full
+        struct gfx_index grown = {};
+        grown.capacity = index->capacity ? index->capacity * 2 : GFX_INDEX_MIN_CAPACITY;
+        grown.keys = gfx_malloc(sizeof(uint64_t) * grown.capacity);
+        grown.values = gfx_malloc(sizeof(uint32_t) * grown.capacity);
+        if (!grown.keys || !grown.values) {
+            gfx_free(grown.keys);
+            gfx_free(grown.values);
+            return GFX_FAILURE;
+        }
+
+        for (uint32_t i = 0; i < grown.capacity; ++i)
+            grown.keys[i] = 0;
+
+        for (uint32_t i = 0; i < index->capacity; ++i) {
+            if (index->keys[i] != 0) {
+                uint32_t slot = index_slot(&grown, index->keys[i]);
+                grown.keys[slot] = index->keys[i];
+                grown.values[slot] = index->values[i];
+            }
+        }
+
+        grown.count = index->count;
+        gfx_free(index->keys);
+        gfx_free(index->values);
+        *index = grown;
+    }
+
+    uint32_t slot = index_slot(index, key);
+    if (index->keys[slot] == key)
+        return GFX_FAILURE; // already there
+
+    index->keys[slot] = key;
+    index->values[slot] = value;
+    ++index->count;
+
+    return GFX_OK;
+}
+
+static void index_destroy(struct gfx_index* index)
+{
+    gfx_free(index->keys);
+    gfx_free(index->values);
+    *index = (struct gfx_index){};
+}
+
 enum gfx_status gfx_compile_shaders(struct gfx_program_storage* storage,
                                     const struct gfx_shader_def* defs,
                                     uint32_t ndefs)
 {
-    uint32_t curr_i = storage->nshaders;
-
-    storage->nshaders += ndefs;
-    storage->shaders = gfx_realloc(storage->shaders,
-                                   sizeof(struct gfx_shader) * storage->nshaders);
-    if (!storage->shaders)
+    struct gfx_shader* shaders = gfx_realloc(storage->shaders,
+                                             sizeof(struct gfx_shader) * (storage->nshaders + ndefs));
+    if (!shaders)
         goto error;
+    storage->shaders = shaders;
 
     for (uint32_t def_i = 0; def_i < ndefs; ++def_i) {
         const struct gfx_shader_def* curr_def = &defs[def_i];
 
-        struct gfx_shader* curr_shader = &storage->shaders[curr_i];
+        struct gfx_shader* curr_shader = &storage->shaders[storage->nshaders];
         curr_shader->name = curr_def->name;
+        curr_shader->id = str_id_hash(curr_def->name);
         curr_shader->type = curr_def->type;
 
         if (gpu_compile_shader(&curr_shader->shader,
@@ -64,7 +139,14 @@ enum gfx_status gfx_compile_shaders(struct gfx_program_storage* storage,
             goto error;
         }
 
-        ++curr_i;
+        if (index_insert(&storage->shader_index, shader_key(curr_shader->id, curr_shader->type),
+                         storage->nshaders) != GFX_OK) {
+            text_log("ERROR: Cannot add shader \"%s\", its name is taken or memory ran out.\n",
+                     curr_shader->name);
+            goto error;
+        }
+
+        ++storage->nshaders;
     }
 
     return GFX_OK;
@@ -72,53 +154,65 @@ error:
     return GFX_FAILURE;
 }
 
-static uint8_t compare_strings(const char* a, const char* b)
+static gpu_shader find_shader(const struct gfx_program_storage* storage,
+                              str_id id, enum gfx_shader_type type)
 {
-    while (*a && *b && *a == *b) {
-        ++a;
-        ++b;
+    uint32_t shader_i;
+    if (index_find(&storage->shader_index, shader_key(id, type), &shader_i) != GFX_OK)
+        return 0;
+
+    const struct gfx_shader* s = &storage->shaders[shader_i];
+    return s->id == id && s->type == type ? s->shader : 0;
+}
+
+static enum gfx_status cache_uniforms(struct gfx_program* prog)
+{
+    uint32_t nuniforms = gpu_program_nuniforms(prog->program);
+    for (uint32_t uni_i = 0; uni_i < nuniforms; ++uni_i) {
+        char name[64];
+        gpu_uniform location;
+        if (gpu_program_uniform(prog->program, uni_i, name, sizeof(name), &location) != GPU_OK)
+            return GFX_FAILURE;
+
+        if (location == -1)
+            continue;
+
+        if (prog->nuniforms == GFX_MAX_PROGRAM_UNIFORMS) {
+            text_log("ERROR: Program \"%s\" has more than %u uniforms.\n",
+                     prog->name, GFX_MAX_PROGRAM_UNIFORMS);
+            return GFX_FAILURE;
+        }
+
+        prog->uniform_ids[prog->nuniforms] = str_id_hash(name);
+        prog->uniforms[prog->nuniforms] = location;
+        ++prog->nuniforms;
     }
 
-    return (*a == 0 && *b == 0);
+    return GFX_OK;
 }
 
 enum gfx_status gfx_compile_programs(struct gfx_program_storage* storage,
                                      const struct gfx_program_def* defs,
                                      uint32_t ndefs)
 {
-    uint32_t curr_i = storage->nprograms;
-
-    storage->nprograms += ndefs;
-    storage->programs = gfx_realloc(storage->programs,
-                                    sizeof(struct gfx_program) * storage->nprograms);
-    if (!storage->programs)
+    struct gfx_program* programs = gfx_realloc(storage->programs,
+                                               sizeof(struct gfx_program) * (storage->nprograms + ndefs));
+    if (!programs)
         goto error;
+    storage->programs = programs;
 
     for (uint32_t def_i = 0; def_i < ndefs; ++def_i) {
         const struct gfx_program_def* curr_def = &defs[def_i];
-        struct gfx_program* curr_prog = &storage->programs[curr_i];
+        struct gfx_program* curr_prog = &storage->programs[storage->nprograms];
 
+        *curr_prog = (struct gfx_program){};
         curr_prog->name = curr_def->name;
+        curr_prog->id = str_id_hash(curr_def->name);
+        curr_prog->vertex_shader = str_id_hash(curr_def->vertex_shader_name);
+        curr_prog->fragment_shader = str_id_hash(curr_def->fragment_shader_name);
 
-        // Find the relevant shaders
-        gpu_shader vs = 0;
-        gpu_shader fs = 0;
-        for (uint32_t shader_i = 0; shader_i < storage->nshaders; ++shader_i) {
-            struct gfx_shader* s = &storage->shaders[shader_i];
-
-            if (vs == 0 && compare_strings(curr_def->vertex_shader_name, s->name)) {
-                if (s->type == GFX_VERTEX_SHADER) {
-                    vs = s->shader;
-                }
-            }
-
-            if (fs == 0 && compare_strings(curr_def->fragment_shader_name, s->name)) {
-                if (s->type == GFX_FRAGMENT_SHADER) {
-                    fs = s->shader;
-                }
-            }
-        }
-
+        gpu_shader vs = find_shader(storage, curr_prog->vertex_shader, GFX_VERTEX_SHADER);
+        gpu_shader fs = find_shader(storage, curr_prog->fragment_shader, GFX_FRAGMENT_SHADER);
         if (vs == 0 || fs == 0) {
             text_log("ERROR: Could not find shaders to compile program \"%s\".\n",
                      curr_def->name);
@@ -131,7 +225,16 @@ enum gfx_status gfx_compile_programs(struct gfx_program_storage* storage,
             goto error;
         }
 
-        ++curr_i;
+        if (cache_uniforms(curr_prog) != GFX_OK)
+            goto error;
+
+        if (index_insert(&storage->program_index, curr_prog->id, storage->nprograms) != GFX_OK) {
+            text_log("ERROR: Cannot add program \"%s\", its name is taken or memory ran out.\n",
+                     curr_def->name);
+            goto error;
+        }
+
+        ++storage->nprograms;
     }
 
     return GFX_OK;
@@ -142,24 +245,157 @@ error:
     return GFX_FAILURE;
 }
 
-enum gfx_status gfx_get_program(struct gfx_program_storage* storage, const char* program_name,
-                                struct gfx_program** program)
+// New shaders and programs are built next to the old ones, which are only
+// replaced once all of them compiled and linked.
+enum gfx_status gfx_reload_shaders(struct gfx_program_storage* storage,
+                                   const struct gfx_shader_def* defs,
+                                   uint32_t ndefs)
 {
-    struct gfx_program* found = 0;
+    gpu_shader* shaders = gfx_malloc(sizeof(gpu_shader) * ndefs);
+    uint32_t* shader_is = gfx_malloc(sizeof(uint32_t) * ndefs);
+    uint32_t nshaders = 0;
+
+    struct gfx_program* programs = gfx_malloc(sizeof(struct gfx_program) * (storage->nprograms + 1));
+    uint32_t* program_is = gfx_malloc(sizeof(uint32_t) * (storage->nprograms + 1));
+    uint32_t nprograms = 0;
+
+    if (!shaders || !shader_is || !programs || !program_is)
+        goto error;
+
+    for (uint32_t def_i = 0; def_i < ndefs; ++def_i) {
+        const struct gfx_shader_def* curr_def = &defs[def_i];
+
+        uint32_t shader_i;
+        if (index_find(&storage->shader_index, shader_key(str_id_hash(curr_def->name), curr_def->type),
+                       &shader_i) != GFX_OK) {
+            text_log("ERROR: There is no shader \"%s\" to reload.\n", curr_def->name);
+            goto error;
+        }
+
+        if (gpu_compile_shader(&shaders[nshaders], curr_def->type, curr_def->source) != GPU_OK) {
+            text_log("ERROR: Failed to load shader \"%s\".\n", curr_def->name);
+            goto error;
+        }
+        shader_is[nshaders++] = shader_i;
+    }
+
     for (uint32_t prog_i = 0; prog_i < storage->nprograms; ++prog_i) {
-        struct gfx_program* p = &storage->programs[prog_i];
-        if (compare_strings(program_name, p->name)) {
-            found = p;
-            break;
+        const struct gfx_program* old_prog = &storage->programs[prog_i];
+
+        gpu_shader vs = 0;
+        gpu_shader fs = 0;
+        for (uint32_t i = 0; i < nshaders; ++i) {
+            const struct gfx_shader* s = &storage->shaders[shader_is[i]];
+            if (s->type == GFX_VERTEX_SHADER && s->id == old_prog->vertex_shader)
+                vs = shaders[i];
+            if (s->type == GFX_FRAGMENT_SHADER && s->id == old_prog->fragment_shader)
+                fs = shaders[i];
         }
+
+        if (vs == 0 && fs == 0)
+            continue;
+        if (vs == 0)
+            vs = find_shader(storage, old_prog->vertex_shader, GFX_VERTEX_SHADER);
+        if (fs == 0)
+            fs = find_shader(storage, old_prog->fragment_shader, GFX_FRAGMENT_SHADER);
+
+        struct gfx_program* curr_prog = &programs[nprograms];
+        *curr_prog = (struct gfx_program){
+            .name = old_prog->name,
+            .id = old_prog->id,
+            .vertex_shader = old_prog->vertex_shader,
+            .fragment_shader = old_prog->fragment_shader,
+        };
+
+        if (gpu_link_program(&curr_prog->program, vs, fs) != GPU_OK) {
+            text_log("ERROR: Could not link program \"%s\".\n", curr_prog->name);
+            goto error;
+        }
+        program_is[nprograms++] = prog_i;
+
+        if (cache_uniforms(curr_prog) != GFX_OK)
+            goto error;
     }
 
-    *program = found;
-    if (found) {
-        return GFX_OK;
-    } else {
+    for (uint32_t i = 0; i < nshaders; ++i) {
+        gpu_shader_destroy(storage->shaders[shader_is[i]].shader);
+        storage->shaders[shader_is[i]].shader = shaders[i];
+    }
+
+    for (uint32_t i = 0; i < nprograms; ++i) {
+        gpu_program_destroy(storage->programs[program_is[i]].program);
+        storage->programs[program_is[i]] = programs[i];
+    }
+
+    gfx_free(shaders);
+    gfx_free(shader_is);
+    gfx_free(programs);
+    gfx_free(program_is);
+
+    return GFX_OK;
+
+error:
+    text_log("ERROR: Could not reload shaders, keeping the old ones.\n");
+
+    for (uint32_t i = 0; i < nprograms; ++i)
+        gpu_program_destroy(programs[i].program);
+    for (uint32_t i = 0; i < nshaders; ++i)
+        gpu_shader_destroy(shaders[i]);
+
+    gfx_free(shaders);
+    gfx_free(shader_is);
+    gfx_free(programs);
+    gfx_free(program_is);
+
+    return GFX_FAILURE;
+}
+
+void gfx_program_storage_destroy(struct gfx_program_storage* storage)
+{
+    gfx_free(storage->shaders);
+    gfx_free(storage->programs);
+    index_destroy(&storage->shader_index);
+    index_destroy(&storage->program_index);
+
+    *storage = (struct gfx_program_storage){};
+}
+
+enum gfx_status gfx_find_program(const struct gfx_program_storage* storage, str_id program_name,
+                                 gfx_program_handle* handle)
+{
+    uint32_t prog_i;
+    if (index_find(&storage->program_index, program_name, &prog_i) != GFX_OK) {
+        *handle = 0;
         return GFX_FAILURE;
     }
+
+    *handle = prog_i + 1;
+    return GFX_OK;
+}
+
+enum gfx_status gfx_get_program(struct gfx_program_storage* storage, str_id program_name,
+                                struct gfx_program** program)
+{
+    gfx_program_handle handle;
+    enum gfx_status status = gfx_find_program(storage, program_name, &handle);
+
+    *program = gfx_program_get(storage, handle);
+    return status;
+}
+
+enum gfx_status gfx_get_uniform(const struct gfx_program* program, str_id uniform_name,
+                                gpu_uniform* uniform)
+{
+    for (uint32_t uni_i = 0; uni_i < program->nuniforms; ++uni_i) {
+        if (program->uniform_ids[uni_i] == uniform_name) {
+            *uniform = program->uniforms[uni_i];
+            return GFX_OK;
+        }
+    }
+
+    text_log("ERROR: Program \"%s\" has no uniform with id 0x%016llx.\n",
+             program->name, (unsigned long long)uniform_name);
+    return GFX_FAILURE;
 }
 
 enum gfx_status gfx_activate_program(struct gfx_program* program)
@@ -176,7 +412,7 @@ enum gfx_status gfx_activate_program(struct gfx_program* program)
 enum gfx_status gfx_update_view(const m4* view, struct gfx_program* program)
 {
     gpu_uniform view_uni;
-    if(gpu_get_uniform(program->program, view_uni_name, &view_uni) != GPU_OK)
+    if(gfx_get_uniform(program, SID(view), &view_uni) != GFX_OK)
         goto error;
     if(gpu_set_uniform_m4(view_uni, (float*)view) != GPU_OK)
         goto error;
@@ -191,7 +427,7 @@ error:
 enum gfx_status gfx_update_projection(const m4* projection, struct gfx_program* program)
 {
     gpu_uniform projection_uni;
-    if(gpu_get_uniform(program->program, projection_uni_name, &projection_uni) != GPU_OK)
+    if(gfx_get_uniform(program, SID(projection), &projection_uni) != GFX_OK)
         goto error;
     if(gpu_set_uniform_m4(projection_uni, (float*)projection) != GPU_OK)
         goto error;
@@ -218,9 +454,37 @@ static const char* texture_unit_sampler_name(uint32_t tex_i)
 static enum gfx_status create_gpu_mesh(struct gfx_mesh* mesh,
                                         const struct rsrc_mesh* resource)
 {
-    void* tmp_buf = 0;
+    // Stored ready for upload, nothing to pack.
+    if (resource->vertices) {
+        if (resource->vertex_size != gpu_vertex_size(resource->vertex_layout)) {
+            text_log("ERROR: Mesh vertices do not match their layout.\n");
+            return GFX_FAILURE;
+        }
 
-    tmp_buf = gfx_malloc(resource->nverts * gpu_max_vert_bytes);
+        uint8_t quantized = (resource->vertex_layout & (GPU_POS_SNORM16 | GPU_POS_HALF)) != 0;
+        if (quantized && !resource->position_quant) {
+            text_log("ERROR: Mesh positions are quantized but have no scale and bias.\n");
+            return GFX_FAILURE;
+        }
+
+        if (gpu_vertex_buffer_create(&mesh->vertex_buffer, resource->vertices, resource->vertex_layout,
+                                     resource->indices, resource->nverts, resource->nindices) != GPU_OK) {
+            text_log("ERROR: Couldn't create GPU meshes.\n");
+            return GFX_FAILURE;
+        }
+
+        if (quantized) {
+            mem_memcpy(mesh->position_scale, resource->position_quant, 3 * sizeof(float));
+            mem_memcpy(mesh->position_bias, resource->position_quant + 3, 3 * sizeof(float));
+        }
+        mesh->octahedral_normals = (resource->vertex_layout & GPU_NORM_OCT) != 0;
+
+        return GFX_OK;
+    }
+
+    struct mem_scratch scratch = mem_scratch_begin();
+
+    void* tmp_buf = mem_scratch_alloc(resource->nverts * gpu_max_vert_bytes);
     if (!tmp_buf)
         goto error;
 
@@ -229,13 +493,12 @@ static enum gfx_status create_gpu_mesh(struct gfx_mesh* mesh,
 
     if(gpu_vertex_buffer_create(&mesh->vertex_buffer, tmp_buf, flags, resource->indices, resource->nverts, resource->nindices) != GPU_OK) goto error;
 
-    gfx_free(tmp_buf);
-
+    mem_scratch_end(scratch);
     return GFX_OK;
 
 error:
+    mem_scratch_end(scratch);
     text_log("ERROR: Couldn't create GPU meshes.\n");
-    gfx_free(tmp_buf);
     return GFX_FAILURE;
 }
 
@@ -267,7 +530,9 @@ error:
 
 enum gfx_status gfx_mesh_create(struct gfx_mesh* mesh, const struct rsrc_mesh* resource, const struct rsrc_texture* tex_rsrcs, uint32_t ntextures)
 {
-    *mesh = (struct gfx_mesh){};
+    *mesh = (struct gfx_mesh){
+        .position_scale = { 1.0f, 1.0f, 1.0f },
+    };
 
     { // Create gpu_meshes
         if (create_gpu_mesh(mesh, resource) != GFX_OK)
@@ -313,9 +578,20 @@ enum gfx_status gfx_mesh_draw(struct gfx_mesh* mesh, const struct gfx_program* a
             goto error;
     }
 
-    gpu_uniform model;
-    if(gpu_get_uniform(active_program->program, model_uni_name, &model) != GPU_OK)
+    gpu_uniform model, position_scale, position_bias, octahedral_normals;
+    if(gfx_get_uniform(active_program, SID(model), &model) != GFX_OK
+       || gfx_get_uniform(active_program, SID(position_scale), &position_scale) != GFX_OK
+       || gfx_get_uniform(active_program, SID(position_bias), &position_bias) != GFX_OK
+       || gfx_get_uniform(active_program, SID(octahedral_normals), &octahedral_normals) != GFX_OK)
+        goto error;
+
+    if(gpu_set_uniform_3f(position_scale, mesh->position_scale) != GPU_OK
+       || gpu_set_uniform_3f(position_bias, mesh->position_bias) != GPU_OK
+       || gpu_set_uniform_i(octahedral_normals, mesh->octahedral_normals) != GPU_OK)
+    {
+        text_log("ERROR: Cannot set vertex decoding.\n");
         goto error;
+    }
 
     for(uint32_t trans_i = 0; trans_i < ntransforms; ++trans_i)
     {
@@ -365,6 +641,8 @@ enum gfx_status gfx_text_create(struct gfx_text* txt, const char* text_ansi, str
     uint32_t* indices = 0;
     void* packed_verts = 0;
 
+    struct mem_scratch scratch = mem_scratch_begin();
+
     txt->text_ansi = text_ansi;
     txt->font = font;
 
@@ -390,13 +668,13 @@ enum gfx_status gfx_text_create(struct gfx_text* txt, const char* text_ansi, str
         }
 
         // 4 vertices times 3 floats each for each character
-        positions = gfx_malloc(sizeof(float) * 12 * text_len );
+        positions = mem_scratch_alloc(sizeof(float) * 12 * text_len );
         // 4 vertices times 3 floats each for each character
-        texcoords = gfx_malloc(sizeof(float) * 12 * text_len );
+        texcoords = mem_scratch_alloc(sizeof(float) * 12 * text_len );
         // 6 indices for each character
-        indices = gfx_malloc(sizeof(uint32_t) * 6 * text_len );
+        indices = mem_scratch_alloc(sizeof(uint32_t) * 6 * text_len );
 
-        packed_verts = gfx_malloc(text_len * 4 * gpu_max_vert_bytes);
+        packed_verts = mem_scratch_alloc(text_len * 4 * gpu_max_vert_bytes);
 
         if( positions == 0 || texcoords == 0 || indices == 0 || 
             packed_verts == 0)
@@ -515,18 +793,11 @@ enum gfx_status gfx_text_create(struct gfx_text* txt, const char* text_ansi, str
         gpu_vertex_buffer_create(&txt->quads, packed_verts, flags, indices, nverts, nindices );
     }
 
-    gfx_free(packed_verts);
-    gfx_free(positions);
-    gfx_free(texcoords);
-    gfx_free(indices);
-
+    mem_scratch_end(scratch);
     return GFX_OK;
 
 error:
-    gfx_free(packed_verts);
-    gfx_free(positions);
-    gfx_free(texcoords);
-    gfx_free(indices);
+    mem_scratch_end(scratch);
     gpu_vertex_buffer_destroy(&txt->quads);
 
     *txt = (struct gfx_text){};
@@ -548,7 +819,7 @@ enum gfx_status gfx_text_draw(struct gfx_text* txt, const struct gfx_program* ac
 
     struct gfx_font* font = txt->font;
    
-    if (gpu_get_uniform(active_program->program, text_position_uni_name, &position_uni) != GPU_OK)
+    if (gfx_get_uniform(active_program, SID(position), &position_uni) != GFX_OK)
         goto error;
 
     { // Draw text
@@ -2,6 +2,7 @@
 
 #include "gpu.h"
 #include "math.h"
+#include "string_id.h"
 
 // todo remove this dependency
 // resources should be managed by the user, and only already uploaded gpu
@@ -42,23 +43,52 @@ struct gfx_program_def {
 
 struct gfx_shader {
     const char* name;
+    str_id id;
     enum gfx_shader_type type;
     gpu_shader shader;
 };
 
+#define GFX_MAX_PROGRAM_UNIFORMS 16
+
 struct gfx_program {
     const char* name;
+    str_id id;
     gpu_program program;
+
+    str_id vertex_shader; // name ids of the shaders it is linked from
+    str_id fragment_shader;
+
+    // Locations of the active uniforms by name id, filled on link so lookups
+    // only compare integers.
+    str_id uniform_ids[GFX_MAX_PROGRAM_UNIFORMS];
+    gpu_uniform uniforms[GFX_MAX_PROGRAM_UNIFORMS];
+    uint32_t nuniforms;
 };
 
+// Open addressing map from a 64-bit key to an array index.
+struct gfx_index {
+    uint64_t* keys; // 0 for empty slots
+    uint32_t* values;
+    uint32_t capacity; // power of two
+    uint32_t count;
+};
+
+// Programs are referred to by stable handles, valid for the lifetime of the
+// storage even as more programs are added. 0 is never a valid handle.
+typedef uint32_t gfx_program_handle;
+
 struct gfx_program_storage {
     struct gfx_shader* shaders;
     uint32_t nshaders;
+    struct gfx_index shader_index; // name id and type -> shader
 
     struct gfx_program* programs;
     uint32_t nprograms;
+    struct gfx_index program_index; // name id -> program
 };
 
+void gfx_program_storage_destroy(struct gfx_program_storage* storage);
+
 enum gfx_status gfx_compile_shaders(struct gfx_program_storage* storage,
                                  const struct gfx_shader_def* defs,
                                  uint32_t ndefs);
@@ -67,9 +97,31 @@ enum gfx_status gfx_compile_programs(struct gfx_program_storage* storage,
                                      const struct gfx_program_def* defs,
                                      uint32_t ndefs);
 
-enum gfx_status gfx_get_program(struct gfx_program_storage* storage, const char* program_name,
+// Recompiles already compiled shaders from new sources and relinks the
+// programs using them in place, so their handles stay valid. When any of them
+// fails to compile or link, everything keeps its old version.
+enum gfx_status gfx_reload_shaders(struct gfx_program_storage* storage,
+                                   const struct gfx_shader_def* defs,
+                                   uint32_t ndefs);
+
+// Programs and uniforms are looked up by name id, usually a SID constant.
+// Resolve a handle once with gfx_find_program, then get the program from it
+// in O(1) every frame.
+enum gfx_status gfx_find_program(const struct gfx_program_storage* storage, str_id program_name,
+                                 gfx_program_handle* handle);
+
+static inline struct gfx_program* gfx_program_get(const struct gfx_program_storage* storage,
+                                                  gfx_program_handle handle)
+{
+    return handle && handle <= storage->nprograms ? &storage->programs[handle - 1] : 0;
+}
+
+enum gfx_status gfx_get_program(struct gfx_program_storage* storage, str_id program_name,
                                 struct gfx_program** program);
 
+enum gfx_status gfx_get_uniform(const struct gfx_program* program, str_id uniform_name,
+                                gpu_uniform* uniform);
+
 enum gfx_status gfx_activate_program(struct gfx_program* program);
 
 // ---- Perspective and view ----
@@ -84,6 +136,11 @@ struct gfx_mesh
   struct gpu_vertex_buffer vertex_buffer;
   struct gpu_texture* textures; // owned
   uint32_t ntextures;
+
+  // Decode quantized vertices in the vertex shader, see basic.vs.
+  float position_scale[3];
+  float position_bias[3];
+  int32_t octahedral_normals;
 };
 
 enum gfx_status gfx_mesh_create(struct gfx_mesh* mesh, const struct rsrc_mesh* resource, const struct rsrc_texture* tex_rsrcs, uint32_t ntextures);
@@ -0,0 +1,245 @@
+// sysconf core count and sched_yield are hidden by -std=c11 otherwise.
+#define _DEFAULT_SOURCE
+
+#include "jobs.h"
+
+#include <stddef.h>
+
+#define JOBS_MAX_THREADS 64
+#define JOBS_QUEUE_SIZE 1024 // power of two
+
+static jobs_log_fptr text_log = NULL;
+
+void jobs_set_log(jobs_log_fptr l) { text_log = l; }
+
+struct job {
+    jobs_fptr fn;
+    void* data;
+    struct jobs_counter* counter;
+};
+
+// ---- Threads ----------------------------------------------------------------
+
+#if defined(_WIN32)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+typedef HANDLE jobs_thread;
+
+static SRWLOCK queue_lock = SRWLOCK_INIT;
+static CONDITION_VARIABLE queue_cv = CONDITION_VARIABLE_INIT;
+
+static void lock() { AcquireSRWLockExclusive(&queue_lock); }
+static void unlock() { ReleaseSRWLockExclusive(&queue_lock); }
+static void wait_for_work() { SleepConditionVariableSRW(&queue_cv, &queue_lock, INFINITE, 0); }
+static void wake_one() { WakeConditionVariable(&queue_cv); }
+static void wake_all() { WakeAllConditionVariable(&queue_cv); }
+static void yield() { SwitchToThread(); }
+
+static uint32_t ncores()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+static void worker_main();
+
+static DWORD WINAPI worker_entry(LPVOID arg)
+{
+    (void)arg;
+    worker_main();
+    return 0;
+}
+
+static uint8_t thread_start(jobs_thread* t)
+{
+    *t = CreateThread(0, 0, worker_entry, 0, 0, 0);
+    return *t != 0;
+}
+
+static void thread_join(jobs_thread t)
+{
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+
+#else
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+typedef pthread_t jobs_thread;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cv = PTHREAD_COND_INITIALIZER;
+
+static void lock() { pthread_mutex_lock(&queue_lock); }
+static void unlock() { pthread_mutex_unlock(&queue_lock); }
+static void wait_for_work() { pthread_cond_wait(&queue_cv, &queue_lock); }
+static void wake_one() { pthread_cond_signal(&queue_cv); }
+static void wake_all() { pthread_cond_broadcast(&queue_cv); }
+static void yield() { sched_yield(); }
+
+static uint32_t ncores()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t)n : 1;
+}
+
+static void worker_main();
+
+static void* worker_entry(void* arg)
+{
+    (void)arg;
+    worker_main();
+    return 0;
+}
+
+static uint8_t thread_start(jobs_thread* t)
+{
+    return pthread_create(t, 0, worker_entry, 0) == 0;
+}
+
+static void thread_join(jobs_thread t)
+{
+    pthread_join(t, 0);
+}
+
+#endif
+
+// ---- Queue ------------------------------------------------------------------
+
+static struct {
+    struct job jobs[JOBS_QUEUE_SIZE];
+    uint32_t head; // next to run
+    uint32_t tail; // next free
+
+    uint8_t quit;
+
+    jobs_thread threads[JOBS_MAX_THREADS];
+    uint32_t nthreads;
+} queue;
+
+static void run(struct job job)
+{
+    job.fn(job.data);
+    atomic_fetch_sub_explicit(&job.counter->pending, 1, memory_order_acq_rel);
+}
+
+// Needs the lock.
+static uint8_t pop(struct job* job)
+{
+    if (queue.head == queue.tail)
+        return 0;
+
+    *job = queue.jobs[queue.head & (JOBS_QUEUE_SIZE - 1)];
+    ++queue.head;
+    return 1;
+}
+
+static void worker_main()
+{
+    for (;;) {
+        struct job job;
+
+        lock();
+        while (!pop(&job)) {
+            if (queue.quit) {
+                unlock();
+                return;
+            }
+            wait_for_work();
+        }
+        unlock();
+
+        run(job);
+    }
+}
+
+enum jobs_status jobs_init(uint32_t nthreads)
+{
+    if (nthreads == 0) {
+        uint32_t cores = ncores();
+        nthreads = cores > 1 ? cores - 1 : 0;
+    }
+    if (nthreads > JOBS_MAX_THREADS)
+        nthreads = JOBS_MAX_THREADS;
+
+    queue.head = 0;
+    queue.tail = 0;
+    queue.quit = 0;
+    queue.nthreads = 0;
+
+    for (uint32_t i = 0; i < nthreads; ++i) {
+        if (!thread_start(&queue.threads[i])) {
+            text_log("ERROR: Cannot start job thread %u.\n", i);
+            jobs_deinit();
+            return JOBS_FAILURE;
+        }
+        ++queue.nthreads;
+    }
+
+    return JOBS_OK;
+}
+
+void jobs_deinit()
+{
+    lock();
+    queue.quit = 1;
+    wake_all();
+    unlock();
+
+    for (uint32_t i = 0; i < queue.nthreads; ++i)
+        thread_join(queue.threads[i]);
+
+    queue.nthreads = 0;
+    queue.quit = 0;
+}
+
+uint32_t jobs_nthreads()
+{
+    return queue.nthreads;
+}
+
+void jobs_submit(jobs_fptr fn, void* data, struct jobs_counter* counter)
+{
+    struct job job = { .fn = fn, .data = data, .counter = counter };
+    atomic_fetch_add_explicit(&counter->pending, 1, memory_order_relaxed);
+
+    if (queue.nthreads == 0) {
+        run(job);
+        return;
+    }
+
+    lock();
+    if (queue.tail - queue.head == JOBS_QUEUE_SIZE) {
+        // Full, do it here rather than wait for room.
+        unlock();
+        run(job);
+        return;
+    }
+
+    queue.jobs[queue.tail & (JOBS_QUEUE_SIZE - 1)] = job;
+    ++queue.tail;
+    wake_one();
+    unlock();
+}
+
+void jobs_wait(struct jobs_counter* counter)
+{
+    while (!jobs_done(counter)) {
+        struct job job;
+
+        lock();
+        uint8_t found = pop(&job);
+        unlock();
+
+        if (found)
+            run(job);
+        else
+            yield();
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Pool of worker threads running small jobs from one shared queue. Jobs must
+// not touch the heap or other single threaded modules; they work on memory
+// handed to them, or on mem_scratch.
+
+typedef void (*jobs_log_fptr)(const char*, ...);
+void jobs_set_log(jobs_log_fptr l);
+
+enum jobs_status { JOBS_OK = 0,
+                   JOBS_FAILURE };
+
+// nthreads 0 picks one worker per core but the calling one. Without workers
+// (or before init) jobs run right away on the submitting thread.
+enum jobs_status jobs_init(uint32_t nthreads);
+// Finishes all submitted jobs first.
+void jobs_deinit();
+
+uint32_t jobs_nthreads();
+
+typedef void (*jobs_fptr)(void* data);
+
+// Counts unfinished jobs of a batch, zero initialize before use.
+struct jobs_counter {
+    atomic_uint pending;
+};
+
+void jobs_submit(jobs_fptr job, void* data, struct jobs_counter* counter);
+
+static inline uint8_t jobs_done(struct jobs_counter* counter)
+{
+    return atomic_load_explicit(&counter->pending, memory_order_acquire) == 0;
+}
+
+// Runs queued jobs on the calling thread until the batch is done.
+void jobs_wait(struct jobs_counter* counter);
@@ -0,0 +1,176 @@
+#include "lz.h"
+
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 // the block always ends with this many literals
+#define LZ_MATCH_LIMIT 12 // no match starts closer than this to the end
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+#define LZ_SKIP_SHIFT 6 // misses before the search starts striding
+
+static uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Lengths past the 15 that fit in the token go on in bytes of 255.
+static uint8_t* write_length(uint8_t* out, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *out++ = 255;
+    *out++ = (uint8_t)len;
+
+    return out;
+}
+
+// match_len 0 writes the closing literals-only sequence.
+static uint8_t* write_sequence(uint8_t* out, const uint8_t* literals, size_t nliterals,
+                               size_t offset, size_t match_len)
+{
+    uint8_t* token = out++;
+    *token = (uint8_t)((nliterals < 15 ? nliterals : 15) << 4);
+    if (nliterals >= 15)
+        out = write_length(out, nliterals - 15);
+
+    memcpy(out, literals, nliterals);
+    out += nliterals;
+
+    if (match_len == 0)
+        return out;
+
+    out[0] = (uint8_t)offset;
+    out[1] = (uint8_t)(offset >> 8);
+    out += 2;
+
+    size_t len = match_len - LZ_MIN_MATCH;
+    *token |= (uint8_t)(len < 15 ? len : 15);
+    if (len >= 15)
+        out = write_length(out, len - 15);
+
+    return out;
+}
+
+size_t lz_compress(const uint8_t* src, size_t size, uint8_t* dst)
+{
+    const uint8_t* end = src + size;
+    const uint8_t* anchor = src;
+    uint8_t* out = dst;
+
+    if (size > LZ_MATCH_LIMIT) {
+        // Positions of the last sequence with each hash, false hits are
+        // caught by comparing.
+        uint32_t table[1 << LZ_HASH_BITS];
+        memset(table, 0, sizeof(table));
+
+        const uint8_t* ip = src + 1;
+        const uint8_t* search_end = end - LZ_MATCH_LIMIT;
+        const uint8_t* match_end = end - LZ_LAST_LITERALS;
+        uint32_t misses = 0;
+
+        while (ip <= search_end) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash(seq);
+            const uint8_t* ref = src + table[h];
+            table[h] = (uint32_t)(ip - src);
+
+            if (ip - ref > LZ_MAX_OFFSET || read32(ref) != seq) {
+                // Incompressible data is skipped faster and faster.
+                ip += 1 + (misses++ >> LZ_SKIP_SHIFT);
+                continue;
+            }
+            misses = 0;
+
+            size_t len = LZ_MIN_MATCH;
+            while (ip + len < match_end && ip[len] == ref[len])
+                ++len;
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+                ++len;
+            }
+
+            out = write_sequence(out, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), len);
+            ip += len;
+            anchor = ip;
+        }
+    }
+
+    out = write_sequence(out, anchor, (size_t)(end - anchor), 0, 0);
+
+    return (size_t)(out - dst);
+}
+
+static uint8_t read_length(const uint8_t** in, const uint8_t* end, size_t* len)
+{
+    uint8_t b;
+    do {
+        if (*in == end)
+            return 0;
+        b = *(*in)++;
+        *len += b;
+    } while (b == 255);
+
+    return 1;
+}
+
+enum lz_status lz_decompress(const uint8_t* src, size_t size,
+                             uint8_t* dst, size_t dst_size)
+{
+    const uint8_t* in = src;
+    const uint8_t* in_end = src + size;
+    uint8_t* out = dst;
+    uint8_t* out_end = dst + dst_size;
+
+    while (in < in_end) {
+        uint8_t token = *in++;
+
+        size_t nliterals = token >> 4;
+        if (nliterals == 15 && !read_length(&in, in_end, &nliterals))
+            return LZ_FAILURE;
+        if ((size_t)(in_end - in) < nliterals || (size_t)(out_end - out) < nliterals)
+            return LZ_FAILURE;
+
+        memcpy(out, in, nliterals);
+        in += nliterals;
+        out += nliterals;
+
+        // The last sequence has no match.
+        if (in == in_end)
+            break;
+
+        if (in_end - in < 2)
+            return LZ_FAILURE;
+        size_t offset = (size_t)in[0] | (size_t)in[1] << 8;
+        in += 2;
+
+        size_t len = token & 15;
+        if (len == 15 && !read_length(&in, in_end, &len))
+            return LZ_FAILURE;
+        len += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(out - dst) || (size_t)(out_end - out) < len)
+            return LZ_FAILURE;
+
+        const uint8_t* ref = out - offset;
+        if (offset >= len) {
+            memcpy(out, ref, len);
+            out += len;
+        } else {
+            // Overlapping, repeats the last `offset` bytes.
+            for (size_t i = 0; i < len; ++i)
+                out[i] = ref[i];
+            out += len;
+        }
+    }
+
+    return out == out_end ? LZ_OK : LZ_FAILURE;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte oriented LZ77 codec writing the LZ4 block format: literal runs and
+// back references of at least 4 bytes up to 64 KiB back, with no entropy
+// stage, so decoding is little more than memcpy. Compression is a single
+// greedy pass over a hash of 4 byte sequences.
+
+enum lz_status { LZ_OK = 0,
+                 LZ_FAILURE };
+
+// Largest compressed size of `size` input bytes.
+static inline size_t lz_compress_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// Returns the compressed size; dst holds lz_compress_bound(size) bytes.
+size_t lz_compress(const uint8_t* src, size_t size, uint8_t* dst);
+
+// Fails unless src decodes to exactly dst_size bytes. Checks every length and
+// offset, so corrupt input is safe.
+enum lz_status lz_decompress(const uint8_t* src, size_t size,
+                             uint8_t* dst, size_t dst_size);
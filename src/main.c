@@ -1,11 +1,13 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "GL/gl3w.h"
 #include "SDL2/SDL.h"
 
 #include "game.h"
+#include "memory.h"
 
 #define ARR_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
 
@@ -18,6 +20,21 @@ int main(int argc, char* argv[])
         settings.name = "game00";
         settings.screen_size[0] = 1366;
         settings.screen_size[1] = 768;
+        settings.heap_size = (uint64_t)256 << 20;
+        settings.slab_mem_size = 1 << 20;
+        settings.frame_mem_size = 1 << 20;
+        settings.load_mem_size = (uint64_t)128 << 20;
+        settings.str_id_mem_size = 1 << 20;
+
+        settings.access_trace_path = 0;
+        settings.access_trace_frames = 300;
+        settings.watch_assets = 0;
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+                settings.access_trace_path = argv[i + 1];
+            else if (strcmp(argv[i], "--watch") == 0)
+                settings.watch_assets = 1;
+        }
     }
 
     SDL_Window* window;
@@ -160,6 +177,14 @@ int main(int argc, char* argv[])
                     else
                         input.o_down = 0;
                 } break;
+                case SDLK_F5: {
+                    if (event.key.state == SDL_PRESSED && !event.key.repeat)
+                        input.f5_pressed = 1;
+                } break;
+                case SDLK_F9: {
+                    if (event.key.state == SDL_PRESSED && !event.key.repeat)
+                        input.f9_pressed = 1;
+                } break;
             };
             } else if (event.type == SDL_MOUSEMOTION) {
                 input.mouse_dx = event.motion.x - prev_mouse_x;
@@ -175,7 +200,9 @@ int main(int argc, char* argv[])
         game_draw(game);
 
         SDL_GL_SwapWindow(window);
-        
+
+        mem_frame_reset();
+
         last_time = current_time;
     }
 
@@ -1,26 +1,1819 @@
+// MAP_ANONYMOUS and madvise are hidden by -std=c11 otherwise.
+#define _DEFAULT_SOURCE
+
 #include "memory.h"
 
-#include <stdlib.h>
-#include <stdint.h>
-#include <stddef.h>
-#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Tags every heap allocation with a subsystem and call site and keeps live,
+// peak and per-frame statistics. Costs a 16 byte header per allocation.
+#ifndef MEM_TRACKING
+#define MEM_TRACKING 0
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define MEM_CALL_SITE() _ReturnAddress()
+#else
+#define MEM_CALL_SITE() __builtin_return_address(0)
+#endif
+
+static mem_log_fptr text_log = NULL;
+
+void mem_set_log(mem_log_fptr l) { text_log = l; }
+
+static size_t align_up(size_t v, size_t align)
+{
+    return (v + align - 1) & ~(align - 1);
+}
+
+// ---- Pages ------------------------------------------------------------------
+
+// Large regions come straight from the OS. On Linux explicitly reserved huge
+// pages (MAP_HUGETLB) are tried first; when none are available the region is
+// mapped 2 MiB aligned with normal pages and marked for transparent huge
+// pages, which the kernel may or may not honour. Windows tries large pages,
+// which need the "Lock pages in memory" privilege.
+
+#define MEM_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+#if defined(__linux__)
+
+#include <stdio.h>
+#include <sys/mman.h>
+
+enum mem_status mem_pages_reserve(struct mem_pages* pages, size_t size)
+{
+    *pages = (struct mem_pages){};
+    size = align_up(size, MEM_HUGE_PAGE_SIZE);
+
+    void* p = mmap(0, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        pages->base = p;
+        pages->size = size;
+        pages->huge = 1;
+        return MEM_OK;
+    }
+
+    // Over-reserve so that the region can start on a huge page boundary.
+    size_t mapped = size + MEM_HUGE_PAGE_SIZE;
+    uint8_t* m = mmap(0, mapped, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED)
+        return MEM_FAILURE;
+
+    uint8_t* base = (uint8_t*)align_up((uintptr_t)m, MEM_HUGE_PAGE_SIZE);
+    size_t head = base - m;
+    size_t tail = mapped - head - size;
+    if (head)
+        munmap(m, head);
+    if (tail)
+        munmap(base + size, tail);
+
+#ifdef MADV_HUGEPAGE
+    madvise(base, size, MADV_HUGEPAGE);
+#endif
+
+    pages->base = base;
+    pages->size = size;
+    return MEM_OK;
+}
+
+void mem_pages_release(struct mem_pages* pages)
+{
+    if (pages->base)
+        munmap(pages->base, pages->size);
+    *pages = (struct mem_pages){};
+}
+
+void mem_pages_report(const struct mem_pages* pages, const char* name)
+{
+    if (!pages->base)
+        return;
+
+    if (pages->huge) {
+        text_log("%s: %zu bytes in %zu kB huge pages (MAP_HUGETLB).\n",
+                 name, pages->size, MEM_HUGE_PAGE_SIZE >> 10);
+        return;
+    }
+
+    // Sum resident and transparent huge page memory over the mappings that
+    // overlap the region. Neighbouring mappings may have been merged into the
+    // same entry, so this is an upper bound.
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f) {
+        text_log("%s: %zu bytes, page sizes unknown.\n", name, pages->size);
+        return;
+    }
+
+    uintptr_t begin = (uintptr_t)pages->base;
+    uintptr_t end = begin + pages->size;
+    uint8_t inside = 0;
+    size_t rss_kb = 0;
+    size_t huge_kb = 0;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long lo, hi;
+        size_t kb;
+        if (sscanf(line, "%llx-%llx ", &lo, &hi) == 2) {
+            inside = lo < end && hi > begin;
+        } else if (inside && sscanf(line, "Rss: %zu kB", &kb) == 1) {
+            rss_kb += kb;
+        } else if (inside && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+            huge_kb += kb;
+        }
+    }
+    fclose(f);
+
+    text_log("%s: %zu bytes, %zu kB resident, %zu kB of it in transparent "
+             "huge pages, %zu kB in 4 kB pages.\n",
+             name, pages->size, rss_kb, huge_kb,
+             rss_kb > huge_kb ? rss_kb - huge_kb : 0);
+}
+
+#elif defined(_WIN32)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+enum mem_status mem_pages_reserve(struct mem_pages* pages, size_t size)
+{
+    *pages = (struct mem_pages){};
+
+    size_t large = GetLargePageMinimum();
+    if (large) {
+        size_t large_size = align_up(size, large);
+        void* p = VirtualAlloc(0, large_size,
+                               MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                               PAGE_READWRITE);
+        if (p) {
+            pages->base = p;
+            pages->size = large_size;
+            pages->huge = 1;
+            return MEM_OK;
+        }
+    }
+
+    size = align_up(size, 4096);
+    void* p = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!p)
+        return MEM_FAILURE;
+
+    pages->base = p;
+    pages->size = size;
+    return MEM_OK;
+}
+
+void mem_pages_release(struct mem_pages* pages)
+{
+    if (pages->base)
+        VirtualFree(pages->base, 0, MEM_RELEASE);
+    *pages = (struct mem_pages){};
+}
+
+void mem_pages_report(const struct mem_pages* pages, const char* name)
+{
+    if (!pages->base)
+        return;
+
+    text_log("%s: %zu bytes in %s pages.\n", name, pages->size,
+             pages->huge ? "large" : "4 kB");
+}
+
+#else
+
+enum mem_status mem_pages_reserve(struct mem_pages* pages, size_t size)
+{
+    *pages = (struct mem_pages){};
+
+    void* p = malloc(size);
+    if (!p)
+        return MEM_FAILURE;
+
+    pages->base = p;
+    pages->size = size;
+    return MEM_OK;
+}
+
+void mem_pages_release(struct mem_pages* pages)
+{
+    free(pages->base);
+    *pages = (struct mem_pages){};
+}
+
+void mem_pages_report(const struct mem_pages* pages, const char* name)
+{
+    if (pages->base)
+        text_log("%s: %zu bytes, page sizes unknown.\n", name, pages->size);
+}
+
+#endif
+
+// ---- TLSF heap --------------------------------------------------------------
+
+// Two-level segregated fit allocator over a single region reserved by
+// mem_heap_init. Free blocks are binned by size: the first level splits by
+// power of two, the second level linearly into TLSF_SL_COUNT classes. Two
+// bitmaps make finding a fitting bin a pair of bit scans, so alloc and free
+// are O(1) regardless of heap state.
+
+#define TLSF_ALIGN_LOG2 4
+#define TLSF_ALIGN (1 << TLSF_ALIGN_LOG2)
+#define TLSF_SL_LOG2 5
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_FL_MAX 40 // largest block: 1 TiB
+#define TLSF_FL_COUNT (TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+#define TLSF_SMALL_BLOCK (1 << TLSF_FL_SHIFT)
+
+#define TLSF_BLOCK_FREE 1
+#define TLSF_PREV_FREE 2
+
+// Payload follows the header. Free blocks keep their free list links in the
+// first bytes of the payload, hence the minimum payload size.
+struct tlsf_block {
+    struct tlsf_block* prev_phys; // valid only if TLSF_PREV_FREE
+    size_t size; // payload size | flags
+};
+
+struct tlsf_links {
+    struct tlsf_block* next_free;
+    struct tlsf_block* prev_free;
+};
+
+#define TLSF_HEADER (align_up(sizeof(struct tlsf_block), TLSF_ALIGN))
+#define TLSF_MIN_PAYLOAD (align_up(sizeof(struct tlsf_links), TLSF_ALIGN))
+
+static struct {
+    struct mem_pages pages;
+    uint8_t* base;
+    size_t capacity;
+
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[TLSF_FL_COUNT];
+    struct tlsf_block* free_lists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+    size_t used_bytes;
+    size_t peak_used_bytes;
+} heap;
+
+static uint32_t bit_lowest(uint32_t v)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, v);
+    return idx;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+static uint32_t bit_highest(uint64_t v)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return idx;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static size_t tlsf_size(const struct tlsf_block* b) { return b->size & ~(size_t)3; }
+
+static uint8_t* tlsf_payload(struct tlsf_block* b) { return (uint8_t*)b + TLSF_HEADER; }
+
+static struct tlsf_block* tlsf_from_payload(void* p)
+{
+    return (struct tlsf_block*)((uint8_t*)p - TLSF_HEADER);
+}
+
+static struct tlsf_block* tlsf_next(struct tlsf_block* b)
+{
+    return (struct tlsf_block*)(tlsf_payload(b) + tlsf_size(b));
+}
+
+static struct tlsf_links* tlsf_links(struct tlsf_block* b)
+{
+    return (struct tlsf_links*)tlsf_payload(b);
+}
+
+static void tlsf_mapping(size_t size, uint32_t* fl, uint32_t* sl)
+{
+    if (size < TLSF_SMALL_BLOCK) {
+        *fl = 0;
+        *sl = (uint32_t)(size / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT));
+    } else {
+        uint32_t f = bit_highest(size);
+        *sl = (uint32_t)(size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+        *fl = f - (TLSF_FL_SHIFT - 1);
+    }
+}
+
+// Like tlsf_mapping, but rounds up to the next class so that any block in the
+// resulting bin is large enough.
+static void tlsf_mapping_search(size_t size, uint32_t* fl, uint32_t* sl)
+{
+    if (size >= TLSF_SMALL_BLOCK)
+        size += ((size_t)1 << (bit_highest(size) - TLSF_SL_LOG2)) - 1;
+    tlsf_mapping(size, fl, sl);
+}
+
+static void tlsf_insert(struct tlsf_block* b)
+{
+    uint32_t fl, sl;
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+
+    struct tlsf_block* head = heap.free_lists[fl][sl];
+    tlsf_links(b)->next_free = head;
+    tlsf_links(b)->prev_free = 0;
+    if (head)
+        tlsf_links(head)->prev_free = b;
+
+    heap.free_lists[fl][sl] = b;
+    heap.fl_bitmap |= (1u << fl);
+    heap.sl_bitmap[fl] |= (1u << sl);
+}
+
+static void tlsf_remove(struct tlsf_block* b)
+{
+    uint32_t fl, sl;
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+
+    struct tlsf_block* next = tlsf_links(b)->next_free;
+    struct tlsf_block* prev = tlsf_links(b)->prev_free;
+    if (next)
+        tlsf_links(next)->prev_free = prev;
+    if (prev)
+        tlsf_links(prev)->next_free = next;
+
+    if (heap.free_lists[fl][sl] == b) {
+        heap.free_lists[fl][sl] = next;
+        if (!next) {
+            heap.sl_bitmap[fl] &= ~(1u << sl);
+            if (!heap.sl_bitmap[fl])
+                heap.fl_bitmap &= ~(1u << fl);
+        }
+    }
+}
+
+static void tlsf_mark_free(struct tlsf_block* b)
+{
+    b->size |= TLSF_BLOCK_FREE;
+    struct tlsf_block* next = tlsf_next(b);
+    next->size |= TLSF_PREV_FREE;
+    next->prev_phys = b;
+}
+
+static void tlsf_mark_used(struct tlsf_block* b)
+{
+    b->size &= ~(size_t)TLSF_BLOCK_FREE;
+    tlsf_next(b)->size &= ~(size_t)TLSF_PREV_FREE;
+}
+
+// Cuts the tail of a used block off into a new free block if it is big enough
+// to hold one.
+static void tlsf_trim(struct tlsf_block* b, size_t size)
+{
+    size_t bsize = tlsf_size(b);
+    if (bsize < size + TLSF_HEADER + TLSF_MIN_PAYLOAD)
+        return;
+
+    struct tlsf_block* rest = (struct tlsf_block*)(tlsf_payload(b) + size);
+    rest->size = bsize - size - TLSF_HEADER;
+    b->size = size | (b->size & TLSF_PREV_FREE);
+
+    tlsf_mark_free(rest);
+    rest->size &= ~(size_t)TLSF_PREV_FREE;
+
+    // Coalesce with a following free block to keep the heap canonical.
+    struct tlsf_block* next = tlsf_next(rest);
+    if (next->size & TLSF_BLOCK_FREE) {
+        tlsf_remove(next);
+        rest->size += tlsf_size(next) + TLSF_HEADER;
+        tlsf_mark_free(rest);
+    }
+
+    tlsf_insert(rest);
+}
+
+static size_t tlsf_adjust(size_t size)
+{
+    size = align_up(size, TLSF_ALIGN);
+    return size < TLSF_MIN_PAYLOAD ? TLSF_MIN_PAYLOAD : size;
+}
+
+static void* tlsf_alloc(size_t size)
+{
+    size = tlsf_adjust(size);
+
+    uint32_t fl, sl;
+    tlsf_mapping_search(size, &fl, &sl);
+    if (fl >= TLSF_FL_COUNT)
+        return 0;
+
+    uint32_t sl_map = heap.sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint32_t fl_map = (fl + 1 < 32) ? heap.fl_bitmap & (~0u << (fl + 1)) : 0;
+        if (!fl_map)
+            return 0;
+        fl = bit_lowest(fl_map);
+        sl_map = heap.sl_bitmap[fl];
+    }
+    sl = bit_lowest(sl_map);
+
+    struct tlsf_block* b = heap.free_lists[fl][sl];
+    tlsf_remove(b);
+    tlsf_mark_used(b);
+    tlsf_trim(b, size);
+
+    heap.used_bytes += tlsf_size(b);
+    if (heap.used_bytes > heap.peak_used_bytes)
+        heap.peak_used_bytes = heap.used_bytes;
+
+    return tlsf_payload(b);
+}
+
+static void tlsf_free(void* ptr)
+{
+    struct tlsf_block* b = tlsf_from_payload(ptr);
+    heap.used_bytes -= tlsf_size(b);
+
+    if (b->size & TLSF_PREV_FREE) {
+        struct tlsf_block* prev = b->prev_phys;
+        tlsf_remove(prev);
+        prev->size += tlsf_size(b) + TLSF_HEADER;
+        b = prev;
+    }
+
+    struct tlsf_block* next = tlsf_next(b);
+    if (next->size & TLSF_BLOCK_FREE) {
+        tlsf_remove(next);
+        b->size += tlsf_size(next) + TLSF_HEADER;
+    }
+
+    tlsf_mark_free(b);
+    tlsf_insert(b);
+}
+
+static void* tlsf_realloc(void* ptr, size_t size)
+{
+    struct tlsf_block* b = tlsf_from_payload(ptr);
+    size_t old_size = tlsf_size(b);
+    size_t adjusted = tlsf_adjust(size);
+
+    // Grow in place by swallowing the following free block.
+    if (adjusted > old_size) {
+        struct tlsf_block* next = tlsf_next(b);
+        size_t combined = old_size + TLSF_HEADER + tlsf_size(next);
+        if ((next->size & TLSF_BLOCK_FREE) && combined >= adjusted) {
+            tlsf_remove(next);
+            b->size += tlsf_size(next) + TLSF_HEADER;
+            tlsf_mark_used(b);
+        } else {
+            void* p = tlsf_alloc(size);
+            if (!p)
+                return 0;
+            memcpy(p, ptr, old_size);
+            tlsf_free(ptr);
+            return p;
+        }
+    }
+
+    heap.used_bytes -= old_size;
+    tlsf_trim(b, adjusted);
+    heap.used_bytes += tlsf_size(b);
+    if (heap.used_bytes > heap.peak_used_bytes)
+        heap.peak_used_bytes = heap.used_bytes;
+
+    return ptr;
+}
+
+static uint8_t tlsf_owns(const void* ptr)
+{
+    const uint8_t* p = ptr;
+    return p >= heap.base && p < heap.base + heap.capacity;
+}
+
+enum mem_status mem_heap_init(size_t capacity)
+{
+    capacity = align_up(capacity, TLSF_ALIGN);
+    if (capacity < 2 * TLSF_HEADER + TLSF_MIN_PAYLOAD)
+        return MEM_FAILURE;
+
+    struct mem_pages pages;
+    if (mem_pages_reserve(&pages, capacity) != MEM_OK) {
+        text_log("ERROR: Cannot reserve heap of %zu bytes.\n", capacity);
+        return MEM_FAILURE;
+    }
+
+    memset(&heap, 0, sizeof(heap));
+    heap.pages = pages;
+    heap.base = pages.base;
+    heap.capacity = pages.size;
+
+    // One free block spanning the region, followed by a zero-sized used
+    // sentinel so that tlsf_next never walks off the end.
+    struct tlsf_block* b = (struct tlsf_block*)heap.base;
+    b->prev_phys = 0;
+    b->size = heap.capacity - 2 * TLSF_HEADER;
+
+    struct tlsf_block* sentinel = tlsf_next(b);
+    sentinel->size = 0;
+
+    tlsf_mark_free(b);
+    tlsf_insert(b);
+
+    return MEM_OK;
+}
+
+void mem_heap_deinit()
+{
+    mem_pages_release(&heap.pages);
+    memset(&heap, 0, sizeof(heap));
+}
+
+void mem_heap_stats(struct mem_heap_stats* stats)
+{
+    *stats = (struct mem_heap_stats){};
+    if (!heap.base)
+        return;
+
+    stats->capacity = heap.capacity;
+    stats->peak_used_bytes = heap.peak_used_bytes;
+
+    struct tlsf_block* b = (struct tlsf_block*)heap.base;
+    for (; tlsf_size(b) != 0; b = tlsf_next(b)) {
+        size_t size = tlsf_size(b);
+        if (b->size & TLSF_BLOCK_FREE) {
+            stats->free_bytes += size;
+            stats->nfree_blocks += 1;
+            if (size > stats->largest_free_block)
+                stats->largest_free_block = size;
+        } else {
+            stats->used_bytes += size;
+            stats->nused_blocks += 1;
+        }
+    }
+
+    if (stats->free_bytes > 0)
+        stats->fragmentation = 1.0f - (float)stats->largest_free_block / (float)stats->free_bytes;
+}
+
+void mem_heap_report()
+{
+    struct mem_heap_stats s;
+    mem_heap_stats(&s);
+
+    text_log("Heap: %zu bytes, used %zu in %u blocks (peak %zu), free %zu in %u blocks, "
+             "largest free %zu, fragmentation %.1f%%.\n",
+             s.capacity, s.used_bytes, s.nused_blocks, s.peak_used_bytes,
+             s.free_bytes, s.nfree_blocks, s.largest_free_block,
+             100.0f * s.fragmentation);
+    mem_pages_report(&heap.pages, "Heap pages");
+}
+
+// Once the heap is reserved, all new allocations come from it; memory
+// obtained from libc before that is still returned to libc.
+
+static void* heap_alloc(size_t size)
+{
+    if (!heap.base)
+        return malloc(size);
+
+    void* p = tlsf_alloc(size);
+    if (!p)
+        text_log("ERROR: Heap exhausted allocating %zu bytes.\n", size);
+    return p;
+}
+
+static void heap_free(void* ptr)
+{
+    if (ptr && tlsf_owns(ptr))
+        tlsf_free(ptr);
+    else
+        free(ptr);
+}
+
+static void* heap_realloc(void* ptr, size_t size)
+{
+    if (!ptr)
+        return heap_alloc(size);
+
+    if (size == 0) {
+        heap_free(ptr);
+        return 0;
+    }
+
+    if (!heap.base || !tlsf_owns(ptr))
+        return realloc(ptr, size);
+
+    void* p = tlsf_realloc(ptr, size);
+    if (!p)
+        text_log("ERROR: Heap exhausted reallocating %zu bytes.\n", size);
+    return p;
+}
+
+// ---- Slab allocator ---------------------------------------------------------
+
+// Small allocations are carved from fixed-size slabs taken from one region.
+// Every slab holds chunks of a single size class and starts on a cache line
+// (slabs are SLAB_SIZE aligned). Free chunks of a class form an intrusive
+// singly linked list, and a chunk's class is found from its slab index, so
+// alloc and free are O(1). Slabs are not returned to the region once assigned
+// to a class.
+
+#define SLAB_SIZE_LOG2 14
+#define SLAB_SIZE (1 << SLAB_SIZE_LOG2)
+#define SLAB_NCLASSES 8
+#define SLAB_CLASS_STEP 16
+
+static const uint32_t slab_class_sizes[SLAB_NCLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, MEM_SLAB_MAX_SIZE
+};
+
+// Size in SLAB_CLASS_STEP units (rounded up) to size class.
+static uint8_t slab_class_lookup[MEM_SLAB_MAX_SIZE / SLAB_CLASS_STEP + 1];
+
+struct slab_chunk {
+    struct slab_chunk* next;
+};
+
+struct slab_class {
+    struct slab_chunk* free_list;
+
+    // Chunks not yet handed out in the slab most recently assigned to this
+    // class; carved lazily so that taking a new slab is O(1) too.
+    uint8_t* carve;
+    uint8_t* carve_end;
+
+    uint32_t nslabs;
+    uint64_t live_chunks;
+    uint64_t peak_chunks;
+};
+
+static struct {
+    void* region; // as allocated, base is aligned up from it
+    uint8_t* base;
+    uint32_t nslabs;
+    uint32_t next_slab;
+
+    uint8_t* slab_class; // class index per slab
+    struct slab_class classes[SLAB_NCLASSES];
+} slabs;
+
+static uint8_t slab_owns(const void* ptr)
+{
+    const uint8_t* p = ptr;
+    return p >= slabs.base && p < slabs.base + ((size_t)slabs.nslabs << SLAB_SIZE_LOG2);
+}
+
+static void* slab_alloc(size_t size)
+{
+    uint32_t class_i = slab_class_lookup[(size + SLAB_CLASS_STEP - 1) / SLAB_CLASS_STEP];
+    struct slab_class* c = &slabs.classes[class_i];
+
+    struct slab_chunk* chunk = c->free_list;
+    if (chunk) {
+        c->free_list = chunk->next;
+    } else {
+        uint32_t chunk_size = slab_class_sizes[class_i];
+        if (c->carve + chunk_size > c->carve_end) {
+            if (slabs.next_slab == slabs.nslabs)
+                return 0;
+
+            uint32_t slab_i = slabs.next_slab++;
+            slabs.slab_class[slab_i] = (uint8_t)class_i;
+            c->carve = slabs.base + ((size_t)slab_i << SLAB_SIZE_LOG2);
+            c->carve_end = c->carve + SLAB_SIZE;
+            c->nslabs += 1;
+        }
+
+        chunk = (struct slab_chunk*)c->carve;
+        c->carve += chunk_size;
+    }
+
+    c->live_chunks += 1;
+    if (c->live_chunks > c->peak_chunks)
+        c->peak_chunks = c->live_chunks;
+
+    return chunk;
+}
+
+static void slab_free(void* ptr)
+{
+    uint32_t slab_i = (uint32_t)(((uint8_t*)ptr - slabs.base) >> SLAB_SIZE_LOG2);
+    struct slab_class* c = &slabs.classes[slabs.slab_class[slab_i]];
+
+    struct slab_chunk* chunk = ptr;
+    chunk->next = c->free_list;
+    c->free_list = chunk;
+    c->live_chunks -= 1;
+}
+
+static size_t slab_chunk_size(const void* ptr)
+{
+    uint32_t slab_i = (uint32_t)(((const uint8_t*)ptr - slabs.base) >> SLAB_SIZE_LOG2);
+    return slab_class_sizes[slabs.slab_class[slab_i]];
+}
+
+enum mem_status mem_slab_init(size_t capacity)
+{
+    uint32_t nslabs = (uint32_t)(align_up(capacity, SLAB_SIZE) >> SLAB_SIZE_LOG2);
+
+    void* region = heap_alloc(((size_t)nslabs << SLAB_SIZE_LOG2) + SLAB_SIZE);
+    uint8_t* slab_class = heap_alloc(nslabs);
+    if (!region || !slab_class) {
+        text_log("ERROR: Cannot reserve %u slabs.\n", nslabs);
+        heap_free(region);
+        heap_free(slab_class);
+        return MEM_FAILURE;
+    }
+
+    memset(&slabs, 0, sizeof(slabs));
+    slabs.region = region;
+    slabs.base = (uint8_t*)align_up((uintptr_t)region, SLAB_SIZE);
+    slabs.nslabs = nslabs;
+    slabs.slab_class = slab_class;
+
+    uint32_t class_i = 0;
+    for (uint32_t step_i = 0; step_i < sizeof(slab_class_lookup); ++step_i) {
+        while (slab_class_sizes[class_i] < step_i * SLAB_CLASS_STEP)
+            ++class_i;
+        slab_class_lookup[step_i] = (uint8_t)class_i;
+    }
+
+    return MEM_OK;
+}
+
+void mem_slab_deinit()
+{
+    heap_free(slabs.region);
+    heap_free(slabs.slab_class);
+    memset(&slabs, 0, sizeof(slabs));
+}
+
+void mem_slab_report()
+{
+    text_log("Slabs: %u of %u in use (%u bytes each).\n",
+             slabs.next_slab, slabs.nslabs, SLAB_SIZE);
+
+    for (uint32_t class_i = 0; class_i < SLAB_NCLASSES; ++class_i) {
+        const struct slab_class* c = &slabs.classes[class_i];
+        if (c->nslabs == 0)
+            continue;
+        text_log("  %3u bytes: %u slabs, %llu live chunks, peak %llu\n",
+                 slab_class_sizes[class_i], c->nslabs,
+                 (unsigned long long)c->live_chunks,
+                 (unsigned long long)c->peak_chunks);
+    }
+}
+
+// Backing allocator for everything below: slabs for small sizes, the heap
+// for the rest and whenever the slab region runs out.
+
+static void* raw_alloc(size_t size)
+{
+    if (slabs.base && size <= MEM_SLAB_MAX_SIZE) {
+        void* p = slab_alloc(size);
+        if (p)
+            return p;
+    }
+
+    return heap_alloc(size);
+}
+
+static void raw_free(void* ptr)
+{
+    if (slab_owns(ptr))
+        slab_free(ptr);
+    else
+        heap_free(ptr);
+}
+
+static void* raw_realloc(void* ptr, size_t size)
+{
+    if (!ptr)
+        return raw_alloc(size);
+
+    if (!slab_owns(ptr))
+        return heap_realloc(ptr, size);
+
+    if (size == 0) {
+        slab_free(ptr);
+        return 0;
+    }
+
+    size_t chunk_size = slab_chunk_size(ptr);
+    if (size <= chunk_size && (size > chunk_size / 2 || chunk_size == SLAB_CLASS_STEP))
+        return ptr;
+
+    void* p = raw_alloc(size);
+    if (!p)
+        return 0;
+
+    memcpy(p, ptr, size < chunk_size ? size : chunk_size);
+    slab_free(ptr);
+
+    return p;
+}
+
+// ---- Tracking ---------------------------------------------------------------
+
+#if MEM_TRACKING
+
+#define MEM_MAX_SITES 512 // power of two
+#define MEM_REPORT_TOP_SITES 10
+
+static const char* tag_names[MEM_TAG_COUNT] = {
+    "game",
+    "rsrc",
+    "gfx",
+    "stbi"
+};
+
+struct alloc_header {
+    size_t size;
+    uint32_t tag;
+    uint32_t site; // index into track.sites
+};
+
+#define HEADER_SIZE (align_up(sizeof(struct alloc_header), 16))
+
+struct tag_stats {
+    size_t live_bytes;
+    size_t peak_bytes;
+    uint64_t live_count;
+    uint64_t nallocs;
+    uint64_t frame_nallocs;
+    uint64_t max_frame_nallocs;
+};
+
+struct site_stats {
+    void* address; // 0 - slot unused
+    uint32_t tag;
+    uint64_t nallocs;
+    uint64_t nbytes;
+};
+
+static struct {
+    struct tag_stats tags[MEM_TAG_COUNT];
+    struct site_stats sites[MEM_MAX_SITES];
+
+    size_t live_bytes;
+    size_t peak_bytes;
+
+    uint64_t frame_nallocs;
+    uint64_t max_frame_nallocs;
+    uint64_t total_frame_nallocs;
+    uint64_t nframes;
+} track;
+
+static uint32_t site_index(void* address, enum mem_tag tag)
+{
+    uintptr_t a = (uintptr_t)address;
+    uint32_t idx = (uint32_t)((a >> 2) ^ (a >> 17)) & (MEM_MAX_SITES - 1);
+
+    for (uint32_t probe = 0; probe < MEM_MAX_SITES; ++probe) {
+        struct site_stats* s = &track.sites[idx];
+        if (s->address == address)
+            return idx;
+        if (s->address == 0) {
+            s->address = address;
+            s->tag = tag;
+            return idx;
+        }
+        idx = (idx + 1) & (MEM_MAX_SITES - 1);
+    }
+
+    // Table full, account to whatever slot the address hashed to.
+    return idx;
+}
+
+static void track_add(struct alloc_header* h, size_t size, enum mem_tag tag,
+                      void* site)
+{
+    h->size = size;
+    h->tag = tag;
+    h->site = site_index(site, tag);
+
+    struct tag_stats* t = &track.tags[tag];
+    t->live_bytes += size;
+    t->live_count += 1;
+    t->nallocs += 1;
+    t->frame_nallocs += 1;
+    if (t->live_bytes > t->peak_bytes)
+        t->peak_bytes = t->live_bytes;
+
+    track.live_bytes += size;
+    if (track.live_bytes > track.peak_bytes)
+        track.peak_bytes = track.live_bytes;
+    track.frame_nallocs += 1;
+
+    struct site_stats* s = &track.sites[h->site];
+    s->nallocs += 1;
+    s->nbytes += size;
+}
+
+static void track_remove(const struct alloc_header* h)
+{
+    struct tag_stats* t = &track.tags[h->tag];
+    t->live_bytes -= h->size;
+    t->live_count -= 1;
+    track.live_bytes -= h->size;
+}
+
+static void* tracked_alloc(size_t size, enum mem_tag tag, void* site)
+{
+    struct alloc_header* h = raw_alloc(HEADER_SIZE + size);
+    if (!h)
+        return 0;
+
+    track_add(h, size, tag, site);
+
+    return (uint8_t*)h + HEADER_SIZE;
+}
+
+static void tracked_free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    struct alloc_header* h = (struct alloc_header*)((uint8_t*)ptr - HEADER_SIZE);
+    track_remove(h);
+    raw_free(h);
+}
+
+static void* tracked_realloc(void* ptr, size_t size, enum mem_tag tag, void* site)
+{
+    if (!ptr)
+        return tracked_alloc(size, tag, site);
+
+    if (size == 0) {
+        tracked_free(ptr);
+        return 0;
+    }
+
+    struct alloc_header* h = (struct alloc_header*)((uint8_t*)ptr - HEADER_SIZE);
+    struct alloc_header old = *h;
+
+    struct alloc_header* nh = raw_realloc(h, HEADER_SIZE + size);
+    if (!nh)
+        return 0;
+
+    track_remove(&old);
+    track_add(nh, size, tag, site);
+
+    return (uint8_t*)nh + HEADER_SIZE;
+}
+
+static void track_frame_end()
+{
+    for (uint32_t tag_i = 0; tag_i < MEM_TAG_COUNT; ++tag_i) {
+        struct tag_stats* t = &track.tags[tag_i];
+        if (t->frame_nallocs > t->max_frame_nallocs)
+            t->max_frame_nallocs = t->frame_nallocs;
+        t->frame_nallocs = 0;
+    }
+
+    // The first frame includes game_init, which would hide the steady state.
+    if (track.nframes > 0) {
+        if (track.frame_nallocs > track.max_frame_nallocs)
+            track.max_frame_nallocs = track.frame_nallocs;
+        track.total_frame_nallocs += track.frame_nallocs;
+    }
+
+    track.frame_nallocs = 0;
+    ++track.nframes;
+}
+
+void mem_report()
+{
+    text_log("Memory: live %zu bytes, peak %zu bytes.\n",
+             track.live_bytes, track.peak_bytes);
+
+    for (uint32_t tag_i = 0; tag_i < MEM_TAG_COUNT; ++tag_i) {
+        const struct tag_stats* t = &track.tags[tag_i];
+        text_log("  %-5s live %zu bytes in %llu blocks, peak %zu bytes, "
+                 "%llu allocations, max %llu in a frame\n",
+                 tag_names[tag_i], t->live_bytes,
+                 (unsigned long long)t->live_count, t->peak_bytes,
+                 (unsigned long long)t->nallocs,
+                 (unsigned long long)t->max_frame_nallocs);
+    }
+
+    if (track.nframes > 1) {
+        uint64_t nframes = track.nframes - 1;
+        text_log("  allocations per frame (excluding init): avg %.2f, max %llu\n",
+                 (double)track.total_frame_nallocs / (double)nframes,
+                 (unsigned long long)track.max_frame_nallocs);
+    }
+
+    // Partial selection sort of call sites by allocation count.
+    uint32_t top[MEM_REPORT_TOP_SITES];
+    uint32_t ntop = 0;
+    for (; ntop < MEM_REPORT_TOP_SITES; ++ntop) {
+        int64_t best = -1;
+        for (uint32_t site_i = 0; site_i < MEM_MAX_SITES; ++site_i) {
+            const struct site_stats* s = &track.sites[site_i];
+            if (s->address == 0)
+                continue;
+
+            uint8_t taken = 0;
+            for (uint32_t top_i = 0; top_i < ntop; ++top_i)
+                taken |= (top[top_i] == site_i);
+            if (taken)
+                continue;
+
+            if (best < 0 || s->nallocs > track.sites[best].nallocs)
+                best = site_i;
+        }
+
+        if (best < 0)
+            break;
+        top[ntop] = (uint32_t)best;
+    }
+
+    text_log("  top call sites by allocation count:\n");
+    for (uint32_t top_i = 0; top_i < ntop; ++top_i) {
+        const struct site_stats* s = &track.sites[top[top_i]];
+        text_log("    %p %-5s %llu allocations, %llu bytes\n",
+                 s->address, tag_names[s->tag],
+                 (unsigned long long)s->nallocs,
+                 (unsigned long long)s->nbytes);
+    }
+}
+
+#define MEM_TAGGED_ALLOC(size, tag) tracked_alloc(size, tag, MEM_CALL_SITE())
+#define MEM_TAGGED_REALLOC(ptr, size, tag) tracked_realloc(ptr, size, tag, MEM_CALL_SITE())
+#define MEM_TAGGED_FREE(ptr) tracked_free(ptr)
+
+#else
+
+static void track_frame_end() {}
+
+void mem_report()
+{
+    text_log("Memory: tracking disabled, build with MEM_TRACKING=1.\n");
+}
+
+#define MEM_TAGGED_ALLOC(size, tag) raw_alloc(size)
+#define MEM_TAGGED_REALLOC(ptr, size, tag) raw_realloc(ptr, size)
+#define MEM_TAGGED_FREE(ptr) raw_free(ptr)
+
+#endif // MEM_TRACKING
+
+// ---- Stack ------------------------------------------------------------------
+
+// Every allocation is preceded by a header that links it to the previous one,
+// so that freeing or growing the topmost allocation works in place. Anything
+// else is only released by rolling back to a marker.
+
+#define MEM_STACK_ALIGN 16
+
+struct stack_header {
+    size_t size;
+    size_t prev_last; // header offset of the allocation below
+};
+
+#define STACK_HEADER_SIZE (align_up(sizeof(struct stack_header), MEM_STACK_ALIGN))
+#define STACK_NONE ((size_t)-1)
+
+static struct {
+    struct mem_pages pages;
+    uint8_t* base;
+    size_t capacity;
+
+    size_t top;
+    size_t last; // header offset of the topmost allocation, or STACK_NONE
+    size_t high_water;
+} stack;
+
+static uint8_t stack_owns(const void* ptr)
+{
+    const uint8_t* p = ptr;
+    return p >= stack.base && p < stack.base + stack.capacity;
+}
+
+static struct stack_header* stack_header(void* ptr)
+{
+    return (struct stack_header*)((uint8_t*)ptr - STACK_HEADER_SIZE);
+}
+
+enum mem_status mem_stack_init(size_t capacity)
+{
+    struct mem_pages pages;
+    if (mem_pages_reserve(&pages, capacity) != MEM_OK) {
+        text_log("ERROR: Cannot reserve stack of %zu bytes.\n", capacity);
+        return MEM_FAILURE;
+    }
+
+    stack.pages = pages;
+    stack.base = pages.base;
+    stack.capacity = pages.size;
+    stack.top = 0;
+    stack.last = STACK_NONE;
+    stack.high_water = 0;
+
+    return MEM_OK;
+}
+
+void mem_stack_deinit()
+{
+    mem_pages_release(&stack.pages);
+    memset(&stack, 0, sizeof(stack));
+}
+
+void* mem_stack_alloc(size_t size)
+{
+    size_t header = stack.top;
+    size_t end = header + STACK_HEADER_SIZE + align_up(size, MEM_STACK_ALIGN);
+    if (end > stack.capacity || end < header) {
+        text_log("ERROR: Stack exhausted allocating %zu bytes.\n", size);
+        return 0;
+    }
+
+    struct stack_header* h = (struct stack_header*)(stack.base + header);
+    h->size = size;
+    h->prev_last = stack.last;
+
+    stack.last = header;
+    stack.top = end;
+    if (end > stack.high_water)
+        stack.high_water = end;
+
+    return (uint8_t*)h + STACK_HEADER_SIZE;
+}
+
+void* mem_stack_realloc(void* ptr, size_t size)
+{
+    if (!ptr)
+        return mem_stack_alloc(size);
+
+    struct stack_header* h = stack_header(ptr);
+    size_t header = (uint8_t*)h - stack.base;
+
+    if (header == stack.last) {
+        size_t end = header + STACK_HEADER_SIZE + align_up(size, MEM_STACK_ALIGN);
+        if (end > stack.capacity) {
+            text_log("ERROR: Stack exhausted reallocating %zu bytes.\n", size);
+            return 0;
+        }
+
+        h->size = size;
+        stack.top = end;
+        if (end > stack.high_water)
+            stack.high_water = end;
+
+        return ptr;
+    }
+
+    if (size <= h->size) {
+        h->size = size;
+        return ptr;
+    }
+
+    void* p = mem_stack_alloc(size);
+    if (p)
+        mem_memcpy(p, ptr, h->size);
+
+    return p;
+}
+
+void mem_stack_free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    struct stack_header* h = stack_header(ptr);
+    size_t header = (uint8_t*)h - stack.base;
+    if (header != stack.last)
+        return;
+
+    stack.top = header;
+    stack.last = h->prev_last;
+}
+
+struct mem_stack_marker mem_stack_mark()
+{
+    return (struct mem_stack_marker){.top = stack.top, .last = stack.last };
+}
+
+void mem_stack_rollback(struct mem_stack_marker marker)
+{
+    stack.top = marker.top;
+    stack.last = marker.last;
+}
+
+void mem_stack_report()
+{
+    text_log("Stack: %zu bytes, used %zu, high water %zu.\n",
+             stack.capacity, stack.top, stack.high_water);
+    mem_pages_report(&stack.pages, "Stack pages");
+}
+
+// ---- Heap -------------------------------------------------------------------
 
 void* mem_alloc(size_t size)
 {
-    return malloc(size);
+    return MEM_TAGGED_ALLOC(size, MEM_TAG_GAME);
 }
 
 void mem_free(void* ptr)
 {
-    return free(ptr);
+    if (stack_owns(ptr))
+        mem_stack_free(ptr);
+    else
+        MEM_TAGGED_FREE(ptr);
 }
 
+// Stack memory handed to a heap entry point stays on the stack.
+#define MEM_DISPATCH_REALLOC(ptr, size, tag)         \
+    (stack_owns(ptr) ? mem_stack_realloc(ptr, size) \
+                     : MEM_TAGGED_REALLOC(ptr, size, tag))
+
 void* mem_realloc(void* ptr, size_t size)
 {
-    return realloc(ptr, size);
+    return MEM_DISPATCH_REALLOC(ptr, size, MEM_TAG_GAME);
+}
+
+void* mem_rsrc_alloc(size_t size) { return MEM_TAGGED_ALLOC(size, MEM_TAG_RSRC); }
+void* mem_rsrc_realloc(void* ptr, size_t size) { return MEM_DISPATCH_REALLOC(ptr, size, MEM_TAG_RSRC); }
+
+void* mem_gfx_alloc(size_t size) { return MEM_TAGGED_ALLOC(size, MEM_TAG_GFX); }
+void* mem_gfx_realloc(void* ptr, size_t size) { return MEM_DISPATCH_REALLOC(ptr, size, MEM_TAG_GFX); }
+
+void* mem_stbi_alloc(size_t size) { return MEM_TAGGED_ALLOC(size, MEM_TAG_STBI); }
+void* mem_stbi_realloc(void* ptr, size_t size) { return MEM_DISPATCH_REALLOC(ptr, size, MEM_TAG_STBI); }
+
+// ---- Copy and fill ----------------------------------------------------------
+
+// Vector loops for x86-64, picked once at runtime from what the CPU supports:
+// AVX2 when available, otherwise SSE2, which every x86-64 CPU has. Destination
+// stores are aligned; blocks of MEM_STREAM_THRESHOLD bytes or more use
+// non-temporal stores so that bulk copies do not evict the working set.
+// Other architectures use the C library.
+
+#define MEM_STREAM_THRESHOLD (4 << 20)
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define MEM_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define MEM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static uint8_t cpu_has_avx2()
+{
+    uint32_t regs[4];
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    __cpuid((int*)regs, 0);
+    if (regs[0] < 7)
+        return 0;
+    __cpuid((int*)regs, 1);
+#else
+    if (__get_cpuid_max(0, 0) < 7)
+        return 0;
+    __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+    // AVX support in the CPU and YMM state saving enabled by the OS.
+    uint8_t osxsave = (regs[2] >> 27) & 1;
+    uint8_t avx = (regs[2] >> 28) & 1;
+    if (!osxsave || !avx)
+        return 0;
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    uint64_t xcr0 = _xgetbv(0);
+    __cpuidex((int*)regs, 7, 0);
+#else
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    uint64_t xcr0 = ((uint64_t)xcr0_hi << 32) | xcr0_lo;
+    __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+    if ((xcr0 & 6) != 6)
+        return 0;
+
+    return (regs[1] >> 5) & 1;
+}
+
+static void copy_sse2(uint8_t* d, const uint8_t* s, size_t n)
+{
+    uint8_t* d_end = d + n;
+    const uint8_t* s_end = s + n;
+
+    // Unaligned head, then continue from the first aligned destination byte.
+    _mm_storeu_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+    size_t skip = 16 - ((uintptr_t)d & 15);
+    d += skip;
+    s += skip;
+    n -= skip;
+
+    if (n >= MEM_STREAM_THRESHOLD) {
+        for (; n >= 64; n -= 64, d += 64, s += 64) {
+            __m128i a = _mm_loadu_si128((const __m128i*)s);
+            __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+            __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+            __m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+            _mm_stream_si128((__m128i*)d, a);
+            _mm_stream_si128((__m128i*)(d + 16), b);
+            _mm_stream_si128((__m128i*)(d + 32), c);
+            _mm_stream_si128((__m128i*)(d + 48), e);
+        }
+        _mm_sfence();
+    } else {
+        for (; n >= 64; n -= 64, d += 64, s += 64) {
+            __m128i a = _mm_loadu_si128((const __m128i*)s);
+            __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+            __m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+            __m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+            _mm_store_si128((__m128i*)d, a);
+            _mm_store_si128((__m128i*)(d + 16), b);
+            _mm_store_si128((__m128i*)(d + 32), c);
+            _mm_store_si128((__m128i*)(d + 48), e);
+        }
+    }
+
+    for (; n >= 16; n -= 16, d += 16, s += 16)
+        _mm_store_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+
+    // Unaligned tail, overlapping bytes already copied.
+    _mm_storeu_si128((__m128i*)(d_end - 16), _mm_loadu_si128((const __m128i*)(s_end - 16)));
+}
+
+MEM_TARGET_AVX2 static void copy_avx2(uint8_t* d, const uint8_t* s, size_t n)
+{
+    uint8_t* d_end = d + n;
+    const uint8_t* s_end = s + n;
+
+    _mm256_storeu_si256((__m256i*)d, _mm256_loadu_si256((const __m256i*)s));
+    size_t skip = 32 - ((uintptr_t)d & 31);
+    d += skip;
+    s += skip;
+    n -= skip;
+
+    if (n >= MEM_STREAM_THRESHOLD) {
+        for (; n >= 128; n -= 128, d += 128, s += 128) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)s);
+            __m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+            __m256i c = _mm256_loadu_si256((const __m256i*)(s + 64));
+            __m256i e = _mm256_loadu_si256((const __m256i*)(s + 96));
+            _mm256_stream_si256((__m256i*)d, a);
+            _mm256_stream_si256((__m256i*)(d + 32), b);
+            _mm256_stream_si256((__m256i*)(d + 64), c);
+            _mm256_stream_si256((__m256i*)(d + 96), e);
+        }
+        _mm_sfence();
+    } else {
+        for (; n >= 128; n -= 128, d += 128, s += 128) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)s);
+            __m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+            __m256i c = _mm256_loadu_si256((const __m256i*)(s + 64));
+            __m256i e = _mm256_loadu_si256((const __m256i*)(s + 96));
+            _mm256_store_si256((__m256i*)d, a);
+            _mm256_store_si256((__m256i*)(d + 32), b);
+            _mm256_store_si256((__m256i*)(d + 64), c);
+            _mm256_store_si256((__m256i*)(d + 96), e);
+        }
+    }
+
+    for (; n >= 32; n -= 32, d += 32, s += 32)
+        _mm256_store_si256((__m256i*)d, _mm256_loadu_si256((const __m256i*)s));
+
+    _mm256_storeu_si256((__m256i*)(d_end - 32), _mm256_loadu_si256((const __m256i*)(s_end - 32)));
+}
+
+static void fill_sse2(uint8_t* d, uint8_t value, size_t n)
+{
+    __m128i v = _mm_set1_epi8((char)value);
+    uint8_t* d_end = d + n;
+
+    _mm_storeu_si128((__m128i*)d, v);
+    size_t skip = 16 - ((uintptr_t)d & 15);
+    d += skip;
+    n -= skip;
+
+    if (n >= MEM_STREAM_THRESHOLD) {
+        for (; n >= 64; n -= 64, d += 64) {
+            _mm_stream_si128((__m128i*)d, v);
+            _mm_stream_si128((__m128i*)(d + 16), v);
+            _mm_stream_si128((__m128i*)(d + 32), v);
+            _mm_stream_si128((__m128i*)(d + 48), v);
+        }
+        _mm_sfence();
+    }
+
+    for (; n >= 16; n -= 16, d += 16)
+        _mm_store_si128((__m128i*)d, v);
+
+    _mm_storeu_si128((__m128i*)(d_end - 16), v);
+}
+
+MEM_TARGET_AVX2 static void fill_avx2(uint8_t* d, uint8_t value, size_t n)
+{
+    __m256i v = _mm256_set1_epi8((char)value);
+    uint8_t* d_end = d + n;
+
+    _mm256_storeu_si256((__m256i*)d, v);
+    size_t skip = 32 - ((uintptr_t)d & 31);
+    d += skip;
+    n -= skip;
+
+    if (n >= MEM_STREAM_THRESHOLD) {
+        for (; n >= 128; n -= 128, d += 128) {
+            _mm256_stream_si256((__m256i*)d, v);
+            _mm256_stream_si256((__m256i*)(d + 32), v);
+            _mm256_stream_si256((__m256i*)(d + 64), v);
+            _mm256_stream_si256((__m256i*)(d + 96), v);
+        }
+        _mm_sfence();
+    }
+
+    for (; n >= 32; n -= 32, d += 32)
+        _mm256_store_si256((__m256i*)d, v);
+
+    _mm256_storeu_si256((__m256i*)(d_end - 32), v);
+}
+
+typedef void (*copy_fptr)(uint8_t*, const uint8_t*, size_t);
+typedef void (*fill_fptr)(uint8_t*, uint8_t, size_t);
+
+static copy_fptr copy_impl = NULL;
+static fill_fptr fill_impl = NULL;
+
+static void select_impl()
+{
+    if (cpu_has_avx2()) {
+        copy_impl = copy_avx2;
+        fill_impl = fill_avx2;
+    } else {
+        copy_impl = copy_sse2;
+        fill_impl = fill_sse2;
+    }
+}
+
+// Below this the C library's inlined small-size paths win over the setup of
+// the vector loops.
+#define MEM_VECTOR_MIN_SIZE 64
+
+void mem_memcpy(void* dst, const void* src, size_t size)
+{
+    if (size < MEM_VECTOR_MIN_SIZE) {
+        memcpy(dst, src, size);
+        return;
+    }
+
+    if (!copy_impl)
+        select_impl();
+    copy_impl(dst, src, size);
+}
+
+void mem_memset(void* dst, uint8_t value, size_t size)
+{
+    if (size < MEM_VECTOR_MIN_SIZE) {
+        memset(dst, value, size);
+        return;
+    }
+
+    if (!fill_impl)
+        select_impl();
+    fill_impl(dst, value, size);
 }
 
+#else
+
 void mem_memcpy(void* dst, const void* src, size_t size)
 {
     memcpy(dst, src, size);
 }
+
+void mem_memset(void* dst, uint8_t value, size_t size)
+{
+    memset(dst, value, size);
+}
+
+#endif
+
+// ---- Frame arena ------------------------------------------------------------
+
+#define MEM_FRAME_ALIGN 16
+
+struct frame_overflow {
+    struct frame_overflow* next;
+    size_t size;
+};
+
+static struct {
+    uint8_t* base;
+    size_t capacity;
+    size_t used;
+
+    struct frame_overflow* overflow; // released on reset
+    size_t overflow_used;
+
+    size_t high_water;
+    uint64_t nframes;
+    uint64_t noverflow_frames;
+} frame_arena;
+
+enum mem_status mem_frame_init(size_t capacity)
+{
+    capacity = align_up(capacity, MEM_FRAME_ALIGN);
+
+    uint8_t* base = raw_alloc(capacity);
+    if (!base) {
+        text_log("ERROR: Cannot allocate frame arena of %zu bytes.\n", capacity);
+        return MEM_FAILURE;
+    }
+
+    frame_arena.base = base;
+    frame_arena.capacity = capacity;
+    frame_arena.used = 0;
+    frame_arena.overflow = 0;
+    frame_arena.overflow_used = 0;
+    frame_arena.high_water = 0;
+    frame_arena.nframes = 0;
+    frame_arena.noverflow_frames = 0;
+
+    return MEM_OK;
+}
+
+static void frame_release_overflow()
+{
+    struct frame_overflow* o = frame_arena.overflow;
+    while (o) {
+        struct frame_overflow* next = o->next;
+        raw_free(o);
+        o = next;
+    }
+
+    frame_arena.overflow = 0;
+    frame_arena.overflow_used = 0;
+}
+
+void mem_frame_deinit()
+{
+    frame_release_overflow();
+    raw_free(frame_arena.base);
+    frame_arena.base = 0;
+    frame_arena.capacity = 0;
+}
+
+void* mem_frame_alloc(size_t size)
+{
+    size = align_up(size, MEM_FRAME_ALIGN);
+
+    if (frame_arena.capacity - frame_arena.used >= size) {
+        void* res = frame_arena.base + frame_arena.used;
+        frame_arena.used += size;
+        return res;
+    }
+
+    // Out of arena space, fall back to the system heap until the next reset.
+    size_t header_size = align_up(sizeof(struct frame_overflow), MEM_FRAME_ALIGN);
+    struct frame_overflow* o = raw_alloc(header_size + size);
+    if (!o)
+        return 0;
+
+    o->next = frame_arena.overflow;
+    o->size = size;
+    frame_arena.overflow = o;
+    frame_arena.overflow_used += size;
+
+    return (uint8_t*)o + header_size;
+}
+
+void mem_frame_reset()
+{
+    size_t total = frame_arena.used + frame_arena.overflow_used;
+    if (total > frame_arena.high_water)
+        frame_arena.high_water = total;
+
+    if (frame_arena.overflow)
+        ++frame_arena.noverflow_frames;
+
+    frame_release_overflow();
+    frame_arena.used = 0;
+    ++frame_arena.nframes;
+
+    track_frame_end();
+}
+
+size_t mem_frame_high_water()
+{
+    size_t total = frame_arena.used + frame_arena.overflow_used;
+    return total > frame_arena.high_water ? total : frame_arena.high_water;
+}
+
+void mem_frame_report()
+{
+    text_log("Frame arena: capacity %zu bytes, high water %zu bytes, "
+             "%llu of %llu frames overflowed.\n",
+             frame_arena.capacity, mem_frame_high_water(),
+             (unsigned long long)frame_arena.noverflow_frames,
+             (unsigned long long)frame_arena.nframes);
+}
+
+// ---- Scratch ----------------------------------------------------------------
+
+#if defined(_MSC_VER)
+#define MEM_THREAD_LOCAL __declspec(thread)
+#else
+#define MEM_THREAD_LOCAL _Thread_local
+#endif
+
+#define MEM_SCRATCH_ALIGN 16
+#define MEM_SCRATCH_BLOCK_SIZE (256 << 10)
+
+// Each block is a page reservation of its own, as mem_pages_reserve is safe
+// to call from any thread while the heap must not be touched off the main
+// thread. Blocks are made once per thread and then reused. Reservations are
+// rounded up (to 2 MiB on Linux), and a block uses all of it.
+struct scratch_block {
+    struct scratch_block* prev;
+    struct scratch_block* next; // already made, reused before making new ones
+    size_t capacity;
+    size_t used;
+    struct mem_pages pages; // holding the block itself
+};
+
+static MEM_THREAD_LOCAL struct scratch_block* scratch_current;
+
+static size_t scratch_header_size()
+{
+    return align_up(sizeof(struct scratch_block), MEM_SCRATCH_ALIGN);
+}
+
+static struct scratch_block* scratch_make_block(struct scratch_block* prev, size_t size)
+{
+    size_t capacity = size > MEM_SCRATCH_BLOCK_SIZE ? size : MEM_SCRATCH_BLOCK_SIZE;
+    struct mem_pages pages;
+    if (mem_pages_reserve(&pages, scratch_header_size() + capacity) != MEM_OK)
+        return 0;
+
+    struct scratch_block* b = pages.base;
+    *b = (struct scratch_block){
+        .prev = prev,
+        .capacity = pages.size - scratch_header_size(),
+        .pages = pages,
+    };
+    return b;
+}
+
+static void scratch_free_block(struct scratch_block* b)
+{
+    struct mem_pages pages = b->pages; // goes away with the block
+    mem_pages_release(&pages);
+}
+
+struct mem_scratch mem_scratch_begin()
+{
+    if (!scratch_current)
+        scratch_current = scratch_make_block(0, 0);
+
+    if (!scratch_current)
+        return (struct mem_scratch){};
+
+    return (struct mem_scratch){ .block = scratch_current, .used = scratch_current->used };
+}
+
+void* mem_scratch_alloc(size_t size)
+{
+    size = align_up(size, MEM_SCRATCH_ALIGN);
+
+    struct scratch_block* b = scratch_current;
+    if (!b) {
+        b = scratch_current = scratch_make_block(0, size);
+        if (!b)
+            return 0;
+    }
+
+    while (b->capacity - b->used < size) {
+        struct scratch_block* next = b->next;
+        if (next && next->capacity < size) {
+            // Too small to ever be reused for this size, replace it.
+            b->next = next->next;
+            if (b->next)
+                b->next->prev = b;
+            scratch_free_block(next);
+            continue;
+        }
+
+        if (!next) {
+            next = scratch_make_block(b, size);
+            if (!next)
+                return 0;
+            b->next = next;
+        }
+
+        next->used = 0;
+        b = scratch_current = next;
+    }
+
+    void* res = (uint8_t*)b + scratch_header_size() + b->used;
+    b->used += size;
+    return res;
+}
+
+void mem_scratch_end(struct mem_scratch scope)
+{
+    if (!scope.block)
+        return;
+
+    scratch_current = scope.block;
+    scratch_current->used = scope.used;
+}
+
+void mem_scratch_thread_deinit()
+{
+    struct scratch_block* b = scratch_current;
+    while (b && b->prev)
+        b = b->prev;
+
+    while (b) {
+        struct scratch_block* next = b->next;
+        scratch_free_block(b);
+        b = next;
+    }
+
+    scratch_current = 0;
+}
+
+// ---- Relocatable arena ------------------------------------------------------
+
+#define MEM_REL_ALIGN 16
+
+enum mem_status mem_rel_init(struct mem_rel_arena* arena, uint32_t capacity)
+{
+    capacity = (uint32_t)align_up(capacity, MEM_REL_ALIGN);
+
+    uint8_t* base = raw_alloc(capacity);
+    if (!base) {
+        text_log("ERROR: Cannot allocate relocatable arena of %u bytes.\n", capacity);
+        return MEM_FAILURE;
+    }
+
+    // Offset 0 is reserved for the null pointer.
+    *arena = (struct mem_rel_arena){
+        .base = base,
+        .capacity = capacity,
+        .used = MEM_REL_ALIGN,
+    };
+    mem_memset(base, 0, MEM_REL_ALIGN);
+
+    return MEM_OK;
+}
+
+void mem_rel_deinit(struct mem_rel_arena* arena)
+{
+    raw_free(arena->base);
+    *arena = (struct mem_rel_arena){};
+}
+
+mem_rel_ptr mem_rel_alloc(struct mem_rel_arena* arena, uint32_t size)
+{
+    size = (uint32_t)align_up(size, MEM_REL_ALIGN);
+    if (arena->capacity - arena->used < size) {
+        text_log("ERROR: Relocatable arena out of memory (%u of %u bytes used, "
+                 "%u requested).\n",
+                 arena->used, arena->capacity, size);
+        return 0;
+    }
+
+    mem_rel_ptr res = arena->used;
+    arena->used += size;
+    mem_memset(arena->base + res, 0, size);
+
+    return res;
+}
+
+void mem_rel_save(const struct mem_rel_arena* arena, void* dst)
+{
+    mem_memcpy(dst, arena->base, arena->used);
+}
+
+enum mem_status mem_rel_restore(struct mem_rel_arena* arena, const void* src, uint32_t size)
+{
+    if (size < MEM_REL_ALIGN || size > arena->capacity) {
+        text_log("ERROR: Cannot restore %u bytes into relocatable arena of %u bytes.\n",
+                 size, arena->capacity);
+        return MEM_FAILURE;
+    }
+
+    mem_memcpy(arena->base, src, size);
+    arena->used = size;
+
+    return MEM_OK;
+}
@@ -1,8 +1,202 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
+typedef void (*mem_log_fptr)(const char*, ...);
+void mem_set_log(mem_log_fptr l);
+
+enum mem_status { MEM_OK = 0,
+                  MEM_FAILURE };
+
+// ---- Pages ----
+
+// Address space reserved directly from the OS, backed by huge pages when the
+// system provides them and by normal pages otherwise. Backs the heap, the
+// stack, where large resource payloads live, and scratch blocks. Safe to
+// call from any thread.
+
+struct mem_pages {
+    void* base;
+    size_t size;
+    uint8_t huge; // explicitly reserved huge/large pages
+};
+
+enum mem_status mem_pages_reserve(struct mem_pages* pages, size_t size);
+void mem_pages_release(struct mem_pages* pages);
+
+// Logs the mix of page sizes the region is actually resident in.
+void mem_pages_report(const struct mem_pages* pages, const char* name);
+
+// ---- Heap ----
+
+// Reserves a single region of `capacity` bytes and serves every following
+// heap allocation from it with a TLSF allocator (O(1) alloc and free).
+// Allocations fail once the region is exhausted.
+//
+// Before it is called the system heap is used, and pointers obtained from
+// it are freed and grown there later. This is the one deliberate use of
+// malloc: it serves tools that never reserve a heap. The game reserves the
+// heap before allocating anything, so it never mallocs after init.
+enum mem_status mem_heap_init(size_t capacity);
+void mem_heap_deinit();
+
+struct mem_heap_stats {
+    size_t capacity;
+    size_t used_bytes;
+    size_t peak_used_bytes;
+    size_t free_bytes;
+    size_t largest_free_block;
+    uint32_t nused_blocks;
+    uint32_t nfree_blocks;
+    float fragmentation; // 1 - largest_free_block / free_bytes
+};
+
+// Walks the whole heap, meant for diagnostics.
+void mem_heap_stats(struct mem_heap_stats* stats);
+void mem_heap_report();
+
+// Carves `capacity` bytes out of the heap for a slab allocator that then
+// serves all allocations up to MEM_SLAB_MAX_SIZE bytes in O(1) from size
+// classes. Falls back to the heap when the slabs run out.
+#define MEM_SLAB_MAX_SIZE 256
+
+enum mem_status mem_slab_init(size_t capacity);
+void mem_slab_deinit();
+void mem_slab_report();
+
+enum mem_tag {
+    MEM_TAG_GAME = 0,
+    MEM_TAG_RSRC,
+    MEM_TAG_GFX,
+    MEM_TAG_STBI,
+
+    MEM_TAG_COUNT
+};
+
+// Allocations through mem_alloc/mem_realloc are accounted to MEM_TAG_GAME.
 void* mem_alloc(size_t size);
 void mem_free(void* ptr);
 void* mem_realloc(void* ptr, size_t size);
+
+// Subsystem entry points for the *_set_mem hooks. Memory from any of them is
+// released with mem_free.
+void* mem_rsrc_alloc(size_t size);
+void* mem_rsrc_realloc(void* ptr, size_t size);
+void* mem_gfx_alloc(size_t size);
+void* mem_gfx_realloc(void* ptr, size_t size);
+void* mem_stbi_alloc(size_t size);
+void* mem_stbi_realloc(void* ptr, size_t size);
+
+// Logs live/peak bytes per subsystem, allocations per frame and the busiest
+// call sites. Needs MEM_TRACKING, otherwise only says it is disabled.
+void mem_report();
+
+// ---- Stack ----
+
+// Linear allocator for load phases, in its own huge page backed region so
+// that large resource payloads are covered by few TLB entries. Allocations sit
+// back to back, and a whole phase is undone in one step by rolling back to
+// a marker taken before it. Only the topmost allocation can be freed or
+// grown in place; mem_free on any stack pointer is allowed and does just
+// that.
+
+struct mem_stack_marker {
+    size_t top;
+    size_t last;
+};
+
+enum mem_status mem_stack_init(size_t capacity);
+void mem_stack_deinit();
+
+void* mem_stack_alloc(size_t size);
+void* mem_stack_realloc(void* ptr, size_t size);
+void mem_stack_free(void* ptr);
+
+struct mem_stack_marker mem_stack_mark();
+void mem_stack_rollback(struct mem_stack_marker marker);
+
+void mem_stack_report();
+
+// ---- Copy and fill ----
+
+// SIMD copy and fill, dispatched at runtime on CPU features. Ranges must not
+// overlap.
 void mem_memcpy(void* dst, const void* src, size_t size);
+void mem_memset(void* dst, uint8_t value, size_t size);
+
+// ---- Frame arena ----
+
+// Linear allocator for transient work. Everything allocated with
+// mem_frame_alloc stays valid until the next mem_frame_reset, which the main
+// loop calls once at the end of every frame. There is no per-allocation free.
+//
+// When a frame needs more than the arena capacity, the excess is served from
+// overflow blocks taken from the heap and released on reset. The high water
+// mark includes overflow, so it is the capacity a scene actually needs.
+
+enum mem_status mem_frame_init(size_t capacity);
+void mem_frame_deinit();
+
+void* mem_frame_alloc(size_t size);
+void mem_frame_reset();
+
+size_t mem_frame_high_water();
+void mem_frame_report();
+
+// ---- Scratch ----
+
+// Per-thread linear memory for temporaries in code that may run on worker
+// threads, so it never takes the heap (which is not thread safe) nor a global
+// lock. Every thread lazily gets its own blocks, reserved from the OS like
+// mem_pages, which are kept for reuse.
+//
+// Temporaries live in scopes: mem_scratch_begin returns the current position,
+// and mem_scratch_end with it releases everything allocated since. Scopes
+// nest, and must be ended in reverse order on the thread that began them.
+
+struct mem_scratch {
+    void* block;
+    size_t used;
+};
+
+struct mem_scratch mem_scratch_begin();
+void* mem_scratch_alloc(size_t size);
+void mem_scratch_end(struct mem_scratch scope);
+
+// Returns the calling thread's blocks to the system. Call before a thread
+// that used scratch memory exits.
+void mem_scratch_thread_deinit();
+
+// ---- Relocatable arena ----
+
+// Fixed size block whose contents refer to each other only by offsets from
+// the block base, never by address. The used part can therefore be copied
+// anywhere and stays valid, so saving or restoring everything that lives in
+// the arena is a single memcpy.
+
+// Offset from the arena base; 0 is the null pointer.
+typedef uint32_t mem_rel_ptr;
+
+struct mem_rel_arena {
+    uint8_t* base;
+    uint32_t capacity;
+    uint32_t used;
+};
+
+enum mem_status mem_rel_init(struct mem_rel_arena* arena, uint32_t capacity);
+void mem_rel_deinit(struct mem_rel_arena* arena);
+
+// Zeroed memory, returns 0 when the arena is full.
+mem_rel_ptr mem_rel_alloc(struct mem_rel_arena* arena, uint32_t size);
+
+static inline void* mem_rel_get(const struct mem_rel_arena* arena, mem_rel_ptr ptr)
+{
+    return ptr ? arena->base + ptr : 0;
+}
+
+// Copies the used part of the arena to dst, which must hold arena->used bytes.
+void mem_rel_save(const struct mem_rel_arena* arena, void* dst);
+// Replaces the arena contents with `size` bytes previously saved from an
+// arena with the same layout.
+enum mem_status mem_rel_restore(struct mem_rel_arena* arena, const void* src, uint32_t size);
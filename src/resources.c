@@ -1,7 +1,9 @@
 #include "resources.h"
+#include "memory.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 static rsrc_log_fptr text_log = NULL;
 
@@ -9,29 +11,25 @@ static rsrc_malloc_fptr rsrc_malloc = NULL;
 static rsrc_free_fptr rsrc_free = NULL;
 static rsrc_realloc_fptr rsrc_realloc = NULL;
 
+static rsrc_malloc_fptr rsrc_image_malloc = NULL;
+static rsrc_free_fptr rsrc_image_free = NULL;
+static rsrc_realloc_fptr rsrc_image_realloc = NULL;
+
 #define STB_IMAGE_IMPLEMENTATION
-#define STBI_MALLOC(sz) rsrc_malloc(sz)
-#define STBI_FREE(p) rsrc_free(p)
-#define STBI_REALLOC(p, sz) rsrc_realloc(p, sz)
+#define STBI_MALLOC(sz) rsrc_image_malloc(sz)
+#define STBI_FREE(p) rsrc_image_free(p)
+#define STBI_REALLOC(p, sz) rsrc_image_realloc(p, sz)
 #include "stb_image.h"
 
 // ---- Serialization ----------------------------------------------------------
 
-static void rsrc_memcpy(void* dst, const void* src, size_t nbytes)
-{
-    uint8_t* d = dst;
-    const uint8_t* s = src;
-    for (; nbytes; --nbytes)
-        *d++ = *s++;
-}
-
 static enum rsrc_status write_bytes(const void* src, uint32_t nbytes, uint8_t** buffer,
                                     uint32_t* rem_size)
 {
     if (*rem_size < nbytes)
         return RSRC_FAILURE;
 
-    rsrc_memcpy(*buffer, src, nbytes);
+    mem_memcpy(*buffer, src, nbytes);
 
     *rem_size -= nbytes;
     *buffer += nbytes;
@@ -45,7 +43,7 @@ static enum rsrc_status read_bytes(void* dst, uint32_t nbytes, const uint8_t** b
     if (*rem_size < nbytes)
         return RSRC_FAILURE;
 
-    rsrc_memcpy(dst, *buffer, nbytes);
+    mem_memcpy(dst, *buffer, nbytes);
 
     *rem_size -= nbytes;
     *buffer += nbytes;
@@ -67,6 +65,13 @@ void rsrc_set_mem(rsrc_malloc_fptr m, rsrc_free_fptr f, rsrc_realloc_fptr r)
     rsrc_realloc = r;
 }
 
+void rsrc_set_image_mem(rsrc_malloc_fptr m, rsrc_free_fptr f, rsrc_realloc_fptr r)
+{
+    rsrc_image_malloc = m;
+    rsrc_image_free = f;
+    rsrc_image_realloc = r;
+}
+
 enum rsrc_status rsrc_init()
 {
     stbi_set_flip_vertically_on_load(1);
@@ -81,81 +86,93 @@ enum vertex_flags
     VTX_NORMALS = 1 << 1,
 };
 
+struct buffer_reader {
+    const uint8_t* buf;
+    uint32_t size;
+};
+
+static enum rsrc_status read_buffer(void* reader, void* dst, uint64_t nbytes)
+{
+    struct buffer_reader* r = reader;
+    if (nbytes > r->size)
+        return RSRC_FAILURE;
+
+    return read_bytes(dst, (uint32_t)nbytes, &r->buf, &r->size);
+}
+
 enum rsrc_status rsrc_mesh_load(struct rsrc_mesh* res, const uint8_t* buf,
                                 uint32_t bufnb)
 {
-    uint8_t version;
+    struct buffer_reader reader = { .buf = buf, .size = bufnb };
+    return rsrc_mesh_load_stream(res, read_buffer, &reader);
+}
 
+// Version 0 only knows arrays of three floats, back to back.
+static enum rsrc_status load_stream_v0(struct rsrc_mesh* res, rsrc_read_fptr read,
+                                       void* reader)
+{
     uint8_t* buffer = 0;
 
-    if (read_bytes(&version, sizeof(version), &buf, &bufnb) != RSRC_OK)
-        goto error;
-
-    if (version != rsrc_mesh_version) {
-        text_log("ERROR: Mesh version mismatch (compiled: %d, loading: %d).\n",
-                 rsrc_font_version, version);
-        goto error;
-    }
-
     uint32_t nverts;
     uint32_t nindices;
-    if(read_bytes(&nverts, sizeof(nverts), &buf, &bufnb) != RSRC_OK)
+    if (read(reader, &nverts, sizeof(nverts)) != RSRC_OK)
         goto error;
-    if(read_bytes(&nindices, sizeof(nindices), &buf, &bufnb) != RSRC_OK)
+    if (read(reader, &nindices, sizeof(nindices)) != RSRC_OK)
         goto error;
 
     uint8_t flags;
-    if(read_bytes(&flags, sizeof(flags), &buf, &bufnb) != RSRC_OK)
+    if (read(reader, &flags, sizeof(flags)) != RSRC_OK)
         goto error;
 
-    uint32_t positions_bytes = nverts * sizeof(float) * 3;
-    uint32_t index_bytes = nindices * sizeof(uint32_t);
-
-    uint32_t texcoords_bytes = 0;
-    if( ( flags & VTX_TEXCOORDS ) != 0 )
-    {
-        texcoords_bytes = nverts * sizeof(float) * 3;
-    }
+    uint64_t positions_bytes = (uint64_t)nverts * sizeof(float) * 3;
+    uint64_t index_bytes = (uint64_t)nindices * sizeof(uint32_t);
+    uint64_t texcoords_bytes = (flags & VTX_TEXCOORDS) ? positions_bytes : 0;
+    uint64_t normals_bytes = (flags & VTX_NORMALS) ? positions_bytes : 0;
 
-    uint32_t normals_bytes = 0;
-    if( ( flags & VTX_NORMALS ) != 0 )
-    {
-        normals_bytes = nverts * sizeof(float) * 3;
+    uint64_t total_bytes = positions_bytes + texcoords_bytes + normals_bytes + index_bytes;
+    if (total_bytes > SIZE_MAX) {
+        text_log("ERROR: Mesh too large.\n");
+        goto error;
     }
 
-    buffer = rsrc_malloc(positions_bytes + texcoords_bytes + normals_bytes + index_bytes);
-    if( !buffer )
-    {
+    buffer = rsrc_malloc((size_t)total_bytes);
+    if (!buffer) {
         text_log("ERROR: Out of memory.\n");
         goto error;
     }
 
-    float* positions = (float*) buffer;
-    if(read_bytes(positions, positions_bytes, &buf, &bufnb) != RSRC_OK) goto error;
+    // Every array is read straight into its final place.
+    float* positions = (float*)buffer;
+    if (read(reader, positions, positions_bytes) != RSRC_OK)
+        goto error;
 
     float* texcoords = 0;
-    if( texcoords_bytes != 0 )
-    {
-        texcoords = (float*) (buffer + positions_bytes);
-        if(read_bytes(texcoords, texcoords_bytes, &buf, &bufnb) != RSRC_OK) goto error;
+    if (texcoords_bytes != 0) {
+        texcoords = (float*)(buffer + positions_bytes);
+        if (read(reader, texcoords, texcoords_bytes) != RSRC_OK)
+            goto error;
     }
 
     float* normals = 0;
-    if( normals_bytes != 0 )
-    {
-        normals = (float*) (buffer + positions_bytes + texcoords_bytes);
-        if(read_bytes(normals, normals_bytes, &buf, &bufnb) != RSRC_OK) goto error;
+    if (normals_bytes != 0) {
+        normals = (float*)(buffer + positions_bytes + texcoords_bytes);
+        if (read(reader, normals, normals_bytes) != RSRC_OK)
+            goto error;
     }
 
-    uint32_t* indices = (uint32_t*) (buffer + positions_bytes + texcoords_bytes + normals_bytes);
-    if(read_bytes(indices, index_bytes, &buf, &bufnb) != RSRC_OK) goto error;
+    uint32_t* indices = (uint32_t*)(buffer + positions_bytes + texcoords_bytes + normals_bytes);
+    if (read(reader, indices, index_bytes) != RSRC_OK)
+        goto error;
 
-    res->nverts = nverts;
-    res->nindices = nindices;
-    res->positions = positions;
-    res->texcoords = texcoords;
-    res->normals = normals;
-    res->indices = indices;
+    *res = (struct rsrc_mesh){
+        .positions = positions,
+        .normals = normals,
+        .texcoords = texcoords,
+        .indices = indices,
+        .nverts = nverts,
+        .nindices = nindices,
+        .data = buffer,
+    };
 
     return RSRC_OK;
 
@@ -164,64 +181,235 @@ error:
     return RSRC_FAILURE;
 }
 
-void rsrc_mesh_unload(struct rsrc_mesh* res)
+static uint64_t section_size(uint32_t id, uint32_t nverts, uint32_t nindices,
+                             uint32_t vertex_size)
 {
-    rsrc_free(res->positions);
-    res->nverts = 0;
-    res->nindices = 0;
+    switch (id) {
+    case RSRC_MESH_POSITIONS:
+    case RSRC_MESH_NORMALS:
+    case RSRC_MESH_TEXCOORDS:
+        return (uint64_t)nverts * sizeof(float) * 3;
+    case RSRC_MESH_INDICES:
+        return (uint64_t)nindices * sizeof(uint32_t);
+    case RSRC_MESH_VERTICES:
+        return (uint64_t)nverts * vertex_size;
+    case RSRC_MESH_POSITION_QUANT:
+        return 6 * sizeof(float);
+    default:
+        return 0;
+    }
 }
 
-enum rsrc_status rsrc_mesh_save(const struct rsrc_mesh* res, uint8_t* buf,
-                                uint32_t bufnb)
+// Sections must be aligned, after the header and inside the file, and hold
+// exactly their arrays. Ones this version does not know are skipped.
+static enum rsrc_status check_header(const struct rsrc_mesh_header* h)
 {
-    if (bufnb < rsrc_mesh_buf_size(res))
+    if (h->size < sizeof(*h))
+        return RSRC_FAILURE;
+
+    uint8_t interleaved = h->sections[RSRC_MESH_VERTICES].offset != 0;
+    if (interleaved && h->vertex_size == 0)
         return RSRC_FAILURE;
 
-    if (write_bytes(&rsrc_mesh_version, sizeof(rsrc_mesh_version), &buf,
-                    &bufnb) != RSRC_OK) goto error;
-    if (write_bytes(&res->nverts, sizeof(res->nverts), &buf, &bufnb) != RSRC_OK)
+    for (uint32_t id = 0; id < RSRC_MESH_MAX_SECTIONS; ++id) {
+        const struct rsrc_mesh_section* sec = &h->sections[id];
+        uint64_t size = section_size(id, h->nverts, h->nindices, h->vertex_size);
+
+        // Vertices come either interleaved or as separate arrays.
+        if (sec->offset == 0) {
+            if (size != 0 && ((id == RSRC_MESH_POSITIONS && !interleaved) || id == RSRC_MESH_INDICES))
+                return RSRC_FAILURE;
+            continue;
+        }
+
+        if (sec->offset % RSRC_MESH_ALIGN != 0 || sec->offset < sizeof(*h)
+            || sec->offset > h->size || sec->size > h->size - sec->offset)
+            return RSRC_FAILURE;
+
+        if (id < RSRC_MESH_KNOWN_SECTIONS && sec->size != size)
+            return RSRC_FAILURE;
+    }
+
+    return RSRC_OK;
+}
+
+// data holds the file from data_offset on.
+static void point_into(struct rsrc_mesh* res, const struct rsrc_mesh_header* h,
+                       uint8_t* data, uint64_t data_offset)
+{
+    uint8_t* sections[RSRC_MESH_KNOWN_SECTIONS];
+    for (uint32_t id = 0; id < RSRC_MESH_KNOWN_SECTIONS; ++id) {
+        uint64_t offset = h->sections[id].offset;
+        sections[id] = offset != 0 ? data + (offset - data_offset) : 0;
+    }
+
+    *res = (struct rsrc_mesh){
+        .positions = (float*)sections[RSRC_MESH_POSITIONS],
+        .normals = (float*)sections[RSRC_MESH_NORMALS],
+        .texcoords = (float*)sections[RSRC_MESH_TEXCOORDS],
+        .indices = (uint32_t*)sections[RSRC_MESH_INDICES],
+        .nverts = h->nverts,
+        .nindices = h->nindices,
+        .vertices = sections[RSRC_MESH_VERTICES],
+        .vertex_layout = sections[RSRC_MESH_VERTICES] ? h->vertex_layout : 0,
+        .vertex_size = sections[RSRC_MESH_VERTICES] ? h->vertex_size : 0,
+        .position_quant = (float*)sections[RSRC_MESH_POSITION_QUANT],
+    };
+}
+
+enum rsrc_status rsrc_mesh_load_stream(struct rsrc_mesh* res, rsrc_read_fptr read,
+                                       void* reader)
+{
+    struct rsrc_mesh_header header;
+    uint8_t* data = 0;
+
+    if (read(reader, &header.version, sizeof(header.version)) != RSRC_OK)
         goto error;
-    if (write_bytes(&res->nindices, sizeof(res->nindices), &buf, &bufnb) != RSRC_OK)
+
+    if (header.version == 0)
+        return load_stream_v0(res, read, reader);
+
+    if (header.version != rsrc_mesh_version) {
+        text_log("ERROR: Mesh version mismatch (compiled: %d, loading: %d).\n",
+                 rsrc_mesh_version, header.version);
         goto error;
+    }
 
-    uint8_t flags = 0;
-    if(res->texcoords != 0) flags |= VTX_TEXCOORDS;
-    if(res->normals != 0) flags |= VTX_NORMALS;
-    if (write_bytes(&flags, sizeof(flags), &buf, &bufnb) != RSRC_OK) 
+    if (read(reader, (uint8_t*)&header + sizeof(header.version),
+             sizeof(header) - sizeof(header.version)) != RSRC_OK)
         goto error;
 
-    if (write_bytes(res->positions, res->nverts * 3 * sizeof(float), &buf, &bufnb) != RSRC_OK) 
+    if (check_header(&header) != RSRC_OK) {
+        text_log("ERROR: Corrupt mesh header.\n");
         goto error;
+    }
 
-    if(res->texcoords != 0)
-    {
-        if (write_bytes(res->texcoords, res->nverts * 3 * sizeof(float), &buf, &bufnb) != RSRC_OK) 
-            goto error;
+    uint64_t data_size = header.size - sizeof(header);
+    if (data_size > SIZE_MAX) {
+        text_log("ERROR: Mesh too large.\n");
+        goto error;
     }
 
-    if(res->normals != 0)
-    {
-        if (write_bytes(res->normals, res->nverts * 3 * sizeof(float), &buf, &bufnb) != RSRC_OK) 
-            goto error;
+    // The rest of the file is read in one go and used where it lands. The
+    // header is a multiple of RSRC_MESH_ALIGN, so sections stay aligned.
+    data = rsrc_malloc((size_t)data_size);
+    if (!data) {
+        text_log("ERROR: Out of memory.\n");
+        goto error;
     }
 
-    if (write_bytes(res->indices, res->nindices * sizeof(uint32_t), &buf, &bufnb) != RSRC_OK) 
+    if (read(reader, data, data_size) != RSRC_OK)
+        goto error;
+
+    point_into(res, &header, data, sizeof(header));
+    res->data = data;
+
+    return RSRC_OK;
+
+error:
+    rsrc_free(data);
+    return RSRC_FAILURE;
+}
+
+enum rsrc_status rsrc_mesh_load_in_place(struct rsrc_mesh* res, const uint8_t* buf,
+                                         uint64_t bufnb)
+{
+    struct rsrc_mesh_header header;
+    if (bufnb < sizeof(header) || (uintptr_t)buf % RSRC_MESH_ALIGN != 0)
+        goto error;
+
+    mem_memcpy(&header, buf, sizeof(header));
+    if (header.version != rsrc_mesh_version || check_header(&header) != RSRC_OK
+        || header.size > bufnb)
         goto error;
 
+    // Read-only memory, e.g. a mapping, is never written through the mesh.
+    point_into(res, &header, (uint8_t*)buf, 0);
+
     return RSRC_OK;
 
 error:
+    text_log("ERROR: Cannot load mesh in place, it needs an aligned version %d file.\n",
+             rsrc_mesh_version);
     return RSRC_FAILURE;
 }
 
+void rsrc_mesh_unload(struct rsrc_mesh* res)
+{
+    rsrc_free(res->data);
+    *res = (struct rsrc_mesh){};
+}
+
+static uint64_t align_section(uint64_t offset)
+{
+    return (offset + RSRC_MESH_ALIGN - 1) & ~(uint64_t)(RSRC_MESH_ALIGN - 1);
+}
+
+// Where every array of the mesh goes in a version 1 file.
+static void mesh_layout(const struct rsrc_mesh* res, struct rsrc_mesh_header* h,
+                        const void* arrays[RSRC_MESH_KNOWN_SECTIONS])
+{
+    *h = (struct rsrc_mesh_header){
+        .version = rsrc_mesh_version,
+        .nverts = res->nverts,
+        .nindices = res->nindices,
+    };
+
+    if (res->vertices) {
+        h->vertex_layout = res->vertex_layout;
+        h->vertex_size = res->vertex_size;
+    }
+
+    arrays[RSRC_MESH_POSITIONS] = res->positions;
+    arrays[RSRC_MESH_NORMALS] = res->normals;
+    arrays[RSRC_MESH_TEXCOORDS] = res->texcoords;
+    arrays[RSRC_MESH_INDICES] = res->indices;
+    arrays[RSRC_MESH_VERTICES] = res->vertices;
+    arrays[RSRC_MESH_POSITION_QUANT] = res->position_quant;
+
+    uint64_t offset = sizeof(*h);
+    for (uint32_t id = 0; id < RSRC_MESH_KNOWN_SECTIONS; ++id) {
+        uint8_t required = id == RSRC_MESH_INDICES || (id == RSRC_MESH_POSITIONS && !res->vertices);
+        if (!arrays[id] && !required)
+            continue;
+
+        h->sections[id].offset = align_section(offset);
+        h->sections[id].size = section_size(id, res->nverts, res->nindices, h->vertex_size);
+        offset = h->sections[id].offset + h->sections[id].size;
+    }
+
+    h->size = offset;
+}
+
+enum rsrc_status rsrc_mesh_save(const struct rsrc_mesh* res, uint8_t* buf,
+                                uint32_t bufnb)
+{
+    struct rsrc_mesh_header header;
+    const void* arrays[RSRC_MESH_KNOWN_SECTIONS];
+    mesh_layout(res, &header, arrays);
+
+    if (bufnb < header.size)
+        return RSRC_FAILURE;
+
+    // Zeroes the padding between sections too.
+    memset(buf, 0, (size_t)header.size);
+    mem_memcpy(buf, &header, sizeof(header));
+
+    for (uint32_t id = 0; id < RSRC_MESH_KNOWN_SECTIONS; ++id) {
+        if (header.sections[id].size != 0)
+            mem_memcpy(buf + header.sections[id].offset, arrays[id], (size_t)header.sections[id].size);
+    }
+
+    return RSRC_OK;
+}
+
 uint64_t rsrc_mesh_buf_size(const struct rsrc_mesh* res)
 {
-    uint64_t metadata_size = sizeof(rsrc_mesh_version) + sizeof(res->nindices) + sizeof(res->nverts) + sizeof(uint8_t);
-    uint64_t positions_bytes = sizeof(float) * 3 * res->nverts;
-    uint64_t texcoords_bytes = res->texcoords == 0 ? 0 : sizeof(float) * 3 * res->nverts;
-    uint64_t normals_bytes = res->normals == 0 ? 0 : sizeof(float) * 3 * res->nverts;
-    uint64_t indices_bytes = sizeof(uint32_t) * res->nindices;
-    return metadata_size + positions_bytes + texcoords_bytes + normals_bytes + indices_bytes;
+    struct rsrc_mesh_header header;
+    const void* arrays[RSRC_MESH_KNOWN_SECTIONS];
+    mesh_layout(res, &header, arrays);
+
+    return header.size;
 }
 
 // ---- Texture-----------------------------------------------------------------
@@ -19,12 +19,50 @@ typedef void* (*rsrc_malloc_fptr)(size_t);
 typedef void (*rsrc_free_fptr)(void*);
 typedef void* (*rsrc_realloc_fptr)(void*, size_t);
 void rsrc_set_mem(rsrc_malloc_fptr m, rsrc_free_fptr f, rsrc_realloc_fptr r);
+// Memory used by the image decoder, including decoded texture data.
+void rsrc_set_image_mem(rsrc_malloc_fptr m, rsrc_free_fptr f, rsrc_realloc_fptr r);
 
 enum rsrc_status rsrc_init();
 
 // ---- Mesh -------------------------------------------------------------------
 
-static const uint8_t rsrc_mesh_version = 0;
+// Version 0 is a packed header followed by the arrays back to back. Version 1
+// starts with struct rsrc_mesh_header and keeps every array in its own
+// aligned section, so a file in memory only needs its pointers fixed up.
+// Both load, meshes are saved in the latest.
+static const uint8_t rsrc_mesh_version = 1;
+
+#define RSRC_MESH_ALIGN 16 // of every section, in the file and in memory
+
+enum rsrc_mesh_section_id {
+    RSRC_MESH_POSITIONS = 0,
+    RSRC_MESH_NORMALS,
+    RSRC_MESH_TEXCOORDS,
+    RSRC_MESH_INDICES,
+    RSRC_MESH_VERTICES, // interleaved, see rsrc_mesh.vertices
+    RSRC_MESH_POSITION_QUANT, // see rsrc_mesh.position_quant
+    RSRC_MESH_KNOWN_SECTIONS,
+
+    RSRC_MESH_MAX_SECTIONS = 8 // room for more kinds of data
+};
+
+struct rsrc_mesh_section {
+    uint64_t offset; // from the start of the file, 0 when there is none
+    uint64_t size;
+};
+
+struct rsrc_mesh_header {
+    uint8_t version; // first, as in version 0
+    uint8_t vertex_layout; // of the vertices section
+    uint8_t reserved[6];
+    uint32_t nverts;
+    uint32_t nindices;
+    uint64_t size; // of the whole file
+    uint32_t vertex_size; // of the vertices section
+    uint32_t reserved2;
+
+    struct rsrc_mesh_section sections[RSRC_MESH_MAX_SECTIONS];
+};
 
 struct rsrc_mesh {
     float* positions; // size: nverts*3*sizeof(float)
@@ -34,10 +72,40 @@ struct rsrc_mesh {
 
     uint32_t nverts;
     uint32_t nindices;
+
+    // Vertices interleaved as the GPU takes them, so they are uploaded
+    // without packing; 0 when the file has none. Files with them may leave
+    // out the separate arrays above.
+    void* vertices; // size: nverts*vertex_size
+    uint8_t vertex_layout; // gpu_vtx_flags_t
+    uint32_t vertex_size;
+
+    // Scale xyz then bias xyz of positions quantized in vertices, which
+    // decode as stored * scale + bias. 0 when they are stored as they are.
+    float* position_quant; // size: 6*sizeof(float)
+
+    // Block holding all the arrays, 0 when they point into a file loaded in
+    // place.
+    void* data;
 };
 
 enum rsrc_status rsrc_mesh_load(struct rsrc_mesh* res, const uint8_t* buffer,
                                 uint32_t buf_size);
+
+// Pulls the next nbytes of a resource into dst, e.g. from a file_stream.
+typedef enum rsrc_status (*rsrc_read_fptr)(void* reader, void* dst, uint64_t nbytes);
+
+// Same as rsrc_mesh_load, but reads the mesh piece by piece straight into its
+// final buffers, so the whole file never has to be in memory.
+enum rsrc_status rsrc_mesh_load_stream(struct rsrc_mesh* res, rsrc_read_fptr read,
+                                       void* reader);
+
+// Points the mesh into a version 1 file without copying anything, e.g. one
+// from file_map. buffer must be RSRC_MESH_ALIGN aligned and outlive the mesh,
+// which must not be written to.
+enum rsrc_status rsrc_mesh_load_in_place(struct rsrc_mesh* res, const uint8_t* buffer,
+                                         uint64_t buf_size);
+
 void rsrc_mesh_unload(struct rsrc_mesh* res);
 enum rsrc_status rsrc_mesh_save(const struct rsrc_mesh* res, uint8_t* buffer,
                                 uint32_t buf_size);
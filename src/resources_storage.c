@@ -43,15 +43,23 @@ enum rsrc_status rsrc_load(enum rsrc_resource_type type, str_id name, struct rsr
                 continue;
             }
 
-            pair->id = name;
-            if (file_load_binary(str_id_resolve(name), &file_buf, &size) != FILE_OK) {
+            const char* path = str_id_resolve(name);
+            if (!path) {
+                goto error;
+            }
+            if (file_load_binary(path, &file_buf, &size) != FILE_OK) {
                 goto error;
             }
             if (rsrc_mesh_load(&pair->payload, file_buf, size) != RSRC_OK) {
                 goto error;
             }
+            pair->id = name;
 
             file_unload_binary(&file_buf);
+
+            out_token->type = type;
+            out_token->name = name;
+            out_token->mesh = &pair->payload;
             return RSRC_OK;
         }
 
@@ -78,7 +86,7 @@ enum rsrc_status rsrc_unload(struct rsrc_token* token)
     switch (token->type) {
     case RSRC_MESH: {
         uint64_t max_pairs = RSRC_MAX_MESHES;
-        uint64_t idx = name % max_pairs;
+        uint64_t idx = token->name % max_pairs;
         uint64_t col_idx = 0;
 
         while (col_idx < max_pairs) {
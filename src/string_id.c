@@ -1,65 +1,408 @@
 #include "string_id.h"
 
-#include <assert.h>
+#include <stdatomic.h>
 
-static const char* str_id_map[STR_ID_MAX_STRINGS];
+#define STR_ID_MIN_CAPACITY 1024
+// A level takes no more inserts once it is fuller than 7/10.
+#define STR_ID_MAX_LOAD_NUM 7
+#define STR_ID_MAX_LOAD_DEN 10
+#define STR_ID_MAX_LEVELS 24
 
-static char stored_strings[STR_ID_MAX_STORED_CHARS];
-static size_t stored_strings_size;
+#define STR_ID_ALIGN 16 // of table levels in the arena
 
-static uint32_t hash(const char* s)
+static str_id_log_fptr text_log = NULL;
+
+void str_id_set_log(str_id_log_fptr l) { text_log = l; }
+
+static str_id_malloc_fptr str_id_malloc = NULL;
+static str_id_free_fptr str_id_free = NULL;
+
+void str_id_set_mem(str_id_malloc_fptr m, str_id_free_fptr f)
 {
-	uint32_t h = 0;
-	for(const char* c = s; *c != 0; c++)
+	str_id_malloc = m;
+	str_id_free = f;
+}
+
+// The table is safe to use from any number of threads without a lock.
+//
+// It is made of levels, open addressing tables with linear probing keyed by
+// the id, each twice the size of the previous one. Levels are never moved or
+// rehashed: once the newest one is full, another one is added and takes all
+// further inserts, while lookups go through every level. A slot is claimed
+// by a CAS on its id, after which the claiming thread publishes the string;
+// readers that find the id before the string wait for it. A name inserted by
+// two threads while a level is being added can end up in two levels, which
+// is harmless as both entries are identical.
+struct str_id_entry
+{
+	_Atomic str_id id;
+	_Atomic(const char*) str;
+};
+
+struct str_id_level
+{
+	uint32_t capacity; // power of two
+	_Atomic uint32_t count;
+	struct str_id_entry entries[];
+};
+
+// Claimed by the thread that is adding the level, which the others wait for.
+#define STR_ID_LEVEL_PENDING ((struct str_id_level*)1)
+
+static struct
+{
+	_Atomic(struct str_id_level*) levels[STR_ID_MAX_LEVELS];
+	_Atomic uint32_t nlevels;
+} table;
+
+// Levels and stored strings are carved from one block taken in str_id_init,
+// so the memory hooks are only ever called on the thread that sets the table
+// up and tears it down. Nothing in the arena moves or is freed before
+// str_id_deinit, so pointers from str_id_resolve stay valid until then.
+static struct
+{
+	uint8_t* base;
+	size_t capacity;
+	_Atomic size_t used;
+} arena;
+
+static void* arena_alloc(size_t size, size_t align)
+{
+	size_t used = atomic_load_explicit(&arena.used, memory_order_relaxed);
+	for(;;)
 	{
-		h = 37 * h + *c;
+		size_t offset = (used + align - 1) & ~(align - 1);
+		if(offset > arena.capacity || size > arena.capacity - offset)
+			return 0;
+
+		if(atomic_compare_exchange_weak_explicit(&arena.used, &used, offset + size,
+		                                         memory_order_relaxed, memory_order_relaxed))
+			return arena.base + offset;
+	}
+}
+
+uint8_t str_id_init(size_t capacity)
+{
+	str_id_deinit();
+
+	arena.base = str_id_malloc(capacity);
+	if(!arena.base)
+	{
+		text_log("ERROR: Cannot allocate %llu bytes for string ids.\n",
+		         (unsigned long long)capacity);
+		return 0;
 	}
 
-	return h;
+	arena.capacity = capacity;
+	atomic_init(&arena.used, 0);
+
+	return 1;
 }
 
-str_id str_id_create(const char* s, uint8_t should_store)
+static struct str_id_offline
 {
-	uint32_t len = 0;
+	const uint32_t* displacements;
+	const struct str_id_blob_entry* entries;
+	const char* strings;
+	uint32_t nentries;
+	uint32_t nbuckets;
+} offline;
+
+static uint8_t str_equal(const char* a, const char* b)
+{
+	while(*a && *a == *b)
 	{
-		const char* sc = s;
-		while(*sc++) len++;
+		a++;
+		b++;
 	}
 
-	if(should_store != 0)
+	return *a == *b;
+}
+
+static const char* store(const char* s, size_t len)
+{
+	char* dst = arena_alloc(len + 1, 1);
+	if(!dst)
+		return 0;
+
+	for(size_t i = 0; i <= len; i++)
 	{
-		size_t new_size = stored_strings_size + len;
-		if(new_size >= STR_ID_MAX_STORED_CHARS) 
+		dst[i] = s[i];
+	}
+
+	return dst;
+}
+
+static const char* wait_str(struct str_id_entry* e)
+{
+	const char* str;
+	while(!(str = atomic_load_explicit(&e->str, memory_order_acquire)))
+	{
+	}
+
+	return str;
+}
+
+// Returns the entry holding the id, or 0.
+static struct str_id_entry* level_find(struct str_id_level* level, str_id id)
+{
+	uint32_t mask = level->capacity - 1;
+	uint32_t idx = (uint32_t)id & mask;
+	for(uint32_t probe = 0; probe < level->capacity; probe++)
+	{
+		struct str_id_entry* e = &level->entries[idx];
+		str_id e_id = atomic_load_explicit(&e->id, memory_order_acquire);
+		if(e_id == id)
+			return e;
+		if(e_id == 0)
+			return 0;
+
+		idx = (idx + 1) & mask;
+	}
+
+	return 0;
+}
+
+static struct str_id_entry* table_find(str_id id)
+{
+	uint32_t nlevels = atomic_load_explicit(&table.nlevels, memory_order_acquire);
+	for(uint32_t level_i = 0; level_i < nlevels; level_i++)
+	{
+		struct str_id_level* level = atomic_load_explicit(&table.levels[level_i], memory_order_acquire);
+		struct str_id_entry* e = level ? level_find(level, id) : 0;
+		if(e)
+			return e;
+	}
+
+	return 0;
+}
+
+// Makes sure level `level_i` exists. Returns 0 when out of memory or levels.
+static uint8_t add_level(uint32_t level_i)
+{
+	if(level_i >= STR_ID_MAX_LEVELS)
+		return 0;
+
+	struct str_id_level* level = 0;
+	if(atomic_compare_exchange_strong_explicit(&table.levels[level_i], &level, STR_ID_LEVEL_PENDING,
+	                                           memory_order_acq_rel, memory_order_acquire))
+	{
+		uint32_t capacity = STR_ID_MIN_CAPACITY << level_i;
+		level = arena_alloc(sizeof(struct str_id_level) + sizeof(struct str_id_entry) * capacity,
+		                    STR_ID_ALIGN);
+		if(!level)
 		{
-			assert(!"Maximum number of stored characters exceeded. Increase STR_ID_MAX_STORED_CHARS.");
+			atomic_store_explicit(&table.levels[level_i], 0, memory_order_release);
 			return 0;
 		}
 
-		for(uint32_t i = 0; i <= len; i++)
+		level->capacity = capacity;
+		atomic_init(&level->count, 0);
+		for(uint32_t i = 0; i < capacity; i++)
 		{
-			stored_strings[stored_strings_size + i] = s[i];
+			atomic_init(&level->entries[i].id, 0);
+			atomic_init(&level->entries[i].str, 0);
 		}
 
-		s = &stored_strings[stored_strings_size];
-		stored_strings_size = new_size;
+		atomic_store_explicit(&table.levels[level_i], level, memory_order_release);
+	}
+	else
+	{
+		// Another thread is adding it; it may also fail, then try again.
+		while(level == STR_ID_LEVEL_PENDING)
+			level = atomic_load_explicit(&table.levels[level_i], memory_order_acquire);
+		if(!level)
+			return add_level(level_i);
 	}
 
-	uint32_t h = hash(s);
-	
-	const char* entry = str_id_map[h % STR_ID_MAX_STRINGS];
+	uint32_t nlevels = level_i;
+	atomic_compare_exchange_strong_explicit(&table.nlevels, &nlevels, level_i + 1,
+	                                        memory_order_acq_rel, memory_order_acquire);
+
+	return 1;
+}
 
-	// Collision check. Change one of the strings involved if this happens.
-	assert(entry == 0);
+static const struct str_id_blob_entry* offline_find(str_id sid)
+{
+	if(offline.nentries == 0)
+		return 0;
+
+	uint32_t d = offline.displacements[str_id_blob_bucket(sid, offline.nbuckets)];
+	const struct str_id_blob_entry* e = &offline.entries[str_id_blob_slot(sid, d, offline.nentries)];
+
+	return e->id == sid ? e : 0;
+}
+
+uint8_t str_id_load_table(const void* blob, size_t size)
+{
+	const struct str_id_blob_header* header = blob;
+	if(size < sizeof(*header) || header->magic != STR_ID_BLOB_MAGIC || header->nbuckets == 0)
+		goto error;
+
+	size_t displacements_size = (sizeof(uint32_t) * header->nbuckets + 7) & ~(size_t)7;
+	size_t entries_size = sizeof(struct str_id_blob_entry) * header->nentries;
+	if(size != sizeof(*header) + displacements_size + entries_size + header->strings_size)
+		goto error;
+
+	const uint8_t* b = (const uint8_t*)blob + sizeof(*header);
+	const struct str_id_blob_entry* entries = (const struct str_id_blob_entry*)(b + displacements_size);
+	const char* strings = header->strings_size
+		? (const char*)(b + displacements_size + entries_size)
+		: 0;
+
+	// Every string must lie within the string data and end there; stripped
+	// blobs have none.
+	for(uint32_t i = 0; i < header->nentries; i++)
+	{
+		const struct str_id_blob_entry* e = &entries[i];
+		if(!strings)
+		{
+			if(e->str_offset != 0 || e->str_len != 0)
+				goto error;
+			continue;
+		}
+
+		if(e->str_offset >= header->strings_size
+		   || e->str_len >= header->strings_size - e->str_offset
+		   || strings[e->str_offset + e->str_len] != 0)
+			goto error;
+	}
+
+	offline.displacements = (const uint32_t*)b;
+	offline.entries = entries;
+	offline.strings = strings;
+	offline.nentries = header->nentries;
+	offline.nbuckets = header->nbuckets;
+
+	return 1;
+
+error:
+	text_log("ERROR: Malformed string id table.\n");
 	return 0;
-	
-	entry = s;
+}
+
+static str_id check_collision(struct str_id_entry* e, const char* s)
+{
+	const char* entry_str = wait_str(e);
+	if(!str_equal(entry_str, s))
+	{
+		text_log("ERROR: String id collision between \"%s\" and \"%s\".\n",
+		         entry_str, s);
+		return 0;
+	}
+
+	return atomic_load_explicit(&e->id, memory_order_relaxed);
+}
+
+str_id str_id_create(const char* s, uint8_t should_store)
+{
+	str_id h = str_id_hash(s);
+
+	const struct str_id_blob_entry* offline_entry = offline_find(h);
+	if(offline_entry)
+	{
+		const char* entry_str = offline.strings ? offline.strings + offline_entry->str_offset : 0;
+		if(entry_str && !str_equal(entry_str, s))
+		{
+			text_log("ERROR: String id collision between \"%s\" and \"%s\".\n",
+			         entry_str, s);
+			return 0;
+		}
 
-	return h;
+		return h;
+	}
+
+	struct str_id_entry* found = table_find(h);
+	if(found)
+		return check_collision(found, s);
+
+	// Stored before a slot is claimed, so every claimed slot gets its string.
+	// The copy is wasted if another thread inserts the name meanwhile.
+	const char* str = s;
+	if(should_store != 0)
+	{
+		size_t len = 0;
+		while(s[len])
+			len++;
+
+		str = store(s, len);
+		if(!str)
+			goto error;
+	}
+
+	for(;;)
+	{
+		uint32_t level_i = atomic_load_explicit(&table.nlevels, memory_order_acquire);
+		struct str_id_level* level = level_i
+			? atomic_load_explicit(&table.levels[level_i - 1], memory_order_acquire)
+			: 0;
+
+		uint32_t count = level ? atomic_load_explicit(&level->count, memory_order_relaxed) : 0;
+		if(!level || (uint64_t)count * STR_ID_MAX_LOAD_DEN >= (uint64_t)level->capacity * STR_ID_MAX_LOAD_NUM)
+		{
+			if(!add_level(level_i))
+				goto error;
+			continue;
+		}
+
+		uint32_t mask = level->capacity - 1;
+		uint32_t idx = (uint32_t)h & mask;
+		for(uint32_t probe = 0; probe < level->capacity; probe++)
+		{
+			struct str_id_entry* e = &level->entries[idx];
+
+			str_id e_id = 0;
+			if(atomic_compare_exchange_strong_explicit(&e->id, &e_id, h,
+			                                           memory_order_acq_rel, memory_order_acquire))
+			{
+				atomic_fetch_add_explicit(&level->count, 1, memory_order_relaxed);
+				atomic_store_explicit(&e->str, str, memory_order_release);
+				return h;
+			}
+
+			if(e_id == h)
+				return check_collision(e, s);
+
+			idx = (idx + 1) & mask;
+		}
+
+		// Every slot taken while others were inserting, move on to a new level.
+		if(!add_level(level_i))
+			goto error;
+	}
+
+error:
+	text_log("ERROR: Out of memory for string ids.\n");
+	return 0;
 }
 
 const char* str_id_resolve(str_id sid)
 {
-	const char* entry = str_id_map[sid % STR_ID_MAX_STRINGS];
+	const struct str_id_blob_entry* offline_entry = offline_find(sid);
+	if(offline_entry)
+		return offline.strings ? offline.strings + offline_entry->str_offset : 0;
+
+	if(sid == 0)
+		return 0;
+
+	struct str_id_entry* e = table_find(sid);
+
+	return e ? wait_str(e) : 0;
+}
+
+void str_id_deinit()
+{
+	offline = (struct str_id_offline){};
 
-	return entry;
-}
\ No newline at end of file
+	for(uint32_t level_i = 0; level_i < STR_ID_MAX_LEVELS; level_i++)
+	{
+		atomic_store(&table.levels[level_i], 0);
+	}
+	atomic_store(&table.nlevels, 0);
+
+	if(arena.base)
+		str_id_free(arena.base);
+	arena.base = 0;
+	arena.capacity = 0;
+	atomic_store(&arena.used, 0);
+}
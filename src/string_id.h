@@ -1,19 +1,103 @@
 #pragma once
 
-// todo: offline compilation of strings - just a load and save for the
-//    hashmap
-
 #include <stdint.h>
 #include <stddef.h>
 
-#define STR_ID_MAX_STRINGS 7717
-// this is hash map size, so prime is good
+typedef void (*str_id_log_fptr)(const char*, ...);
+void str_id_set_log(str_id_log_fptr l);
+
+// str_id_create and str_id_resolve can be called from any thread without
+// locking. All table memory is one block taken with the malloc hook in
+// str_id_init and given back in str_id_deinit, so the hooks need not be
+// thread safe; they are only called from the thread running those two.
+typedef void* (*str_id_malloc_fptr)(size_t);
+typedef void (*str_id_free_fptr)(void*);
+void str_id_set_mem(str_id_malloc_fptr m, str_id_free_fptr f);
+
+uint8_t str_id_init(size_t capacity);
+// Takes `capacity` bytes for the table and the stored strings. Interning
+//    fails once they are used up. Returns 0 when out of memory. Call before
+//    other threads use the table.
+
+// 64-bit FNV-1a of the string. 0 is never a valid id.
+typedef uint64_t str_id;
 
-#define STR_ID_MAX_STORED_CHARS 1024
+static inline str_id str_id_hash(const char* s)
+{
+	uint64_t h = 14695981039346656037ull;
+	for(const char* c = s; *c != 0; c++)
+	{
+		h ^= (uint8_t)*c;
+		h *= 1099511628211ull;
+	}
 
-typedef uint32_t str_id;
+	// 0 marks empty slots.
+	return h ? h : 1;
+}
+
+// Build-time ids for literal names, e.g. SID(light_pos) is the constant
+// str_id_hash("light_pos"). Generated by tools/sid_gen.c, which also rejects
+// colliding names. Names must be valid C identifiers.
+#ifndef SID_GEN_TOOL
+#include "string_id_gen.h"
+#endif
 
 str_id str_id_create(const char*, uint8_t should_store);
-// shoud_store - if set to 1 string is copied
+// shoud_store - if set to 1 string is copied, otherwise it has to outlive
+//    the table
+// Returns 0 when out of memory or when the string hashes to the id of a
+//    different, already interned string.
+
+const char* str_id_resolve(str_id);
+// Returns 0 for ids that were never created.
+
+void str_id_deinit();
+// Releases the table and all stored strings. Not thread safe.
+
+// ---- Offline table ----
+
+// Blob written by tools/sid_gen.c with every known asset, shader and uniform
+// name. Its ids are indexed with a minimal perfect hash, so resolving one is
+// a single slot computation and compare. Blobs built with --strip keep only
+// the index: their ids are recognized but resolve to 0.
+//
+// Layout: header, displacements[nbuckets], entries[nentries], strings.
+
+#define STR_ID_BLOB_MAGIC 0x30444953u // "SID0"
+
+struct str_id_blob_header
+{
+	uint32_t magic;
+	uint32_t nentries;
+	uint32_t nbuckets;
+	uint32_t strings_size; // 0 when stripped
+};
+
+struct str_id_blob_entry
+{
+	str_id id;
+	uint32_t str_offset; // into the string data, 0-terminated
+	uint32_t str_len;
+};
+
+static inline uint32_t str_id_blob_bucket(str_id id, uint32_t nbuckets)
+{
+	return (uint32_t)((id >> 32) % nbuckets);
+}
+
+static inline uint32_t str_id_blob_slot(str_id id, uint32_t displacement, uint32_t nentries)
+{
+	uint64_t x = id ^ (displacement * 0x9e3779b97f4a7c15ull);
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+
+	return (uint32_t)(x % nentries);
+}
 
-const char* str_id_resolve(str_id);
\ No newline at end of file
+uint8_t str_id_load_table(const void* blob, size_t size);
+// Makes the blob the first place str_id_create and str_id_resolve look.
+//    The blob is not copied and has to outlive the table. Returns 0 when it
+//    is malformed. Call before other threads use the table.
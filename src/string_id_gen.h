@@ -0,0 +1,16 @@
+// Generated by tools/sid_gen.c from the SID uses in src, do not edit.
+
+#pragma once
+
+#define SID(name) SID_##name
+
+#define SID_basic 0xd6e85e826dfb20bdull
+#define SID_light_pos 0xdc316ff868fbd5eaull
+#define SID_model 0x9de543933e6e703aull
+#define SID_octahedral_normals 0x333fe77d999c85ffull
+#define SID_position 0x4cbf3a26fca1d74aull
+#define SID_position_bias 0xde5f4310f56a7df6ull
+#define SID_position_scale 0x47c3ec2bbde8636full
+#define SID_projection 0xe6cb463920c97e60ull
+#define SID_text 0xfa04f4ef1995407eull
+#define SID_view 0xfe46f400c6b86658ull
@@ -0,0 +1,248 @@
+// inotify and the directory walk are hidden by -std=c11 otherwise.
+#define _DEFAULT_SOURCE
+
+#include "watch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define WATCH_MAX_PATH 256
+#define WATCH_MAX_DIRS 256
+#define WATCH_QUEUE_SIZE 64
+
+static watch_log_fptr text_log = NULL;
+
+void watch_set_log(watch_log_fptr l) { text_log = l; }
+
+#if defined(__linux__)
+
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---- Queue ------------------------------------------------------------------
+
+// Changed files in the order they were first written, each once.
+static struct {
+    char paths[WATCH_QUEUE_SIZE][WATCH_MAX_PATH];
+    uint32_t count;
+
+    char polled[WATCH_MAX_PATH]; // last one handed out
+} queue;
+
+static void queue_push(const char* dir, const char* name)
+{
+    char path[WATCH_MAX_PATH];
+    int len = snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (len < 0 || len >= (int)sizeof(path))
+        return;
+
+    for (uint32_t i = 0; i < queue.count; ++i) {
+        if (strcmp(queue.paths[i], path) == 0)
+            return;
+    }
+
+    if (queue.count == WATCH_QUEUE_SIZE) {
+        text_log("WARNING: Too many changed files, missed %s.\n", path);
+        return;
+    }
+
+    memcpy(queue.paths[queue.count++], path, (size_t)len + 1);
+}
+
+static const char* queue_pop()
+{
+    if (queue.count == 0)
+        return 0;
+
+    memcpy(queue.polled, queue.paths[0], WATCH_MAX_PATH);
+    memmove(queue.paths[0], queue.paths[1], (queue.count - 1) * WATCH_MAX_PATH);
+    --queue.count;
+
+    return queue.polled;
+}
+
+// ---- Watcher ----------------------------------------------------------------
+
+// Editors either write a file in place or write a copy and rename it over.
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR)
+
+// inotify watches single directories, so every one in the tree gets its own.
+static struct {
+    int fd; // -1 when not watching
+
+    int wds[WATCH_MAX_DIRS]; // -1 for free slots
+    char dirs[WATCH_MAX_DIRS][WATCH_MAX_PATH];
+    uint32_t ndirs;
+} watcher = { .fd = -1 };
+
+// A directory that appeared while running may have had files written into it
+// before it was watched; report_files queues those.
+static void add_dir(const char* dir, uint8_t report_files)
+{
+    int wd = inotify_add_watch(watcher.fd, dir, WATCH_EVENTS);
+    if (wd < 0) {
+        text_log("WARNING: Cannot watch %s.\n", dir);
+        return;
+    }
+
+    uint32_t slot = watcher.ndirs;
+    for (uint32_t i = 0; i < watcher.ndirs; ++i) {
+        if (watcher.wds[i] == wd)
+            return; // already watched, e.g. moved within the tree
+        if (watcher.wds[i] < 0 && slot == watcher.ndirs)
+            slot = i;
+    }
+
+    if (slot == WATCH_MAX_DIRS) {
+        text_log("WARNING: Too many directories to watch, skipped %s.\n", dir);
+        inotify_rm_watch(watcher.fd, wd);
+        return;
+    }
+
+    watcher.wds[slot] = wd;
+    snprintf(watcher.dirs[slot], WATCH_MAX_PATH, "%s", dir);
+    if (slot == watcher.ndirs)
+        ++watcher.ndirs;
+
+    DIR* d = opendir(dir);
+    if (!d)
+        return;
+
+    struct dirent* e;
+    while ((e = readdir(d)) != 0) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+
+        char path[WATCH_MAX_PATH];
+        int len = snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        struct stat st;
+        if (len <= 0 || len >= (int)sizeof(path) || stat(path, &st) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode))
+            add_dir(path, report_files);
+        else if (report_files)
+            queue_push(dir, e->d_name);
+    }
+
+    closedir(d);
+}
+
+static int32_t find_dir(int wd)
+{
+    for (uint32_t i = 0; i < watcher.ndirs; ++i) {
+        if (watcher.wds[i] == wd)
+            return (int32_t)i;
+    }
+
+    return -1;
+}
+
+enum watch_status watch_init(const char* dir)
+{
+    watch_deinit();
+
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode) || strlen(dir) >= WATCH_MAX_PATH) {
+        text_log("ERROR: Cannot watch %s, it is not a directory.\n", dir);
+        return WATCH_FAILURE;
+    }
+
+    watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher.fd < 0) {
+        text_log("ERROR: Cannot start inotify.\n");
+        return WATCH_FAILURE;
+    }
+
+    add_dir(dir, 0);
+    if (watcher.ndirs == 0) {
+        watch_deinit();
+        return WATCH_FAILURE;
+    }
+
+    return WATCH_OK;
+}
+
+void watch_deinit()
+{
+    if (watcher.fd >= 0)
+        close(watcher.fd); // drops all the watches
+    watcher.fd = -1;
+    watcher.ndirs = 0;
+
+    queue.count = 0;
+}
+
+// Moves whatever inotify has into the queue, without waiting for more.
+static void drain()
+{
+    _Alignas(struct inotify_event) char buf[4096];
+
+    for (;;) {
+        ssize_t n = read(watcher.fd, buf, sizeof(buf));
+        if (n <= 0)
+            return;
+
+        for (char* p = buf; p < buf + n;) {
+            const struct inotify_event* e = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + e->len;
+
+            if (e->mask & IN_Q_OVERFLOW) {
+                text_log("WARNING: Too many file changes at once, some were missed.\n");
+                continue;
+            }
+
+            int32_t dir = find_dir(e->wd);
+            if (dir < 0)
+                continue;
+
+            if (e->mask & IN_IGNORED) {
+                watcher.wds[dir] = -1; // the directory is gone
+                continue;
+            }
+
+            if (e->len == 0)
+                continue;
+
+            if (e->mask & IN_ISDIR) {
+                if (e->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    char path[WATCH_MAX_PATH];
+                    int len = snprintf(path, sizeof(path), "%s/%s", watcher.dirs[dir], e->name);
+                    if (len > 0 && len < (int)sizeof(path))
+                        add_dir(path, 1);
+                }
+            } else if (e->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                queue_push(watcher.dirs[dir], e->name);
+            }
+        }
+    }
+}
+
+const char* watch_poll()
+{
+    if (watcher.fd >= 0)
+        drain();
+
+    return queue_pop();
+}
+
+#else
+
+enum watch_status watch_init(const char* dir)
+{
+    text_log("ERROR: Cannot watch %s, not supported on this platform.\n", dir);
+    return WATCH_FAILURE;
+}
+
+void watch_deinit()
+{
+}
+
+const char* watch_poll()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// Notices files written under a directory tree, for reloading assets while
+// the game runs. Changes are queued as they come and handed out one by one
+// from watch_poll, which never blocks. Only Linux (inotify) is supported,
+// elsewhere watch_init fails and nothing is reported.
+
+typedef void (*watch_log_fptr)(const char*, ...);
+void watch_set_log(watch_log_fptr l);
+
+enum watch_status { WATCH_OK = 0,
+                    WATCH_FAILURE };
+
+// Watches dir and every directory below it, including ones created later.
+enum watch_status watch_init(const char* dir);
+void watch_deinit();
+
+// Path of the next changed file, e.g. "res/shaders/basic.vs" for dir "res",
+// valid until the next call. 0 when nothing changed. A file written several
+// times before it is polled is reported once.
+const char* watch_poll();
@@ -0,0 +1,1343 @@
+// Times the engine's hot paths against the plain code they replaced, so
+// their wins can be checked on the machine at hand.
+//
+// Usage: bench [sections...]
+//
+// Runs the named sections, or all of them. Every measurement is the best of
+// BENCH_REPS runs. Sections:
+//   alloc      mesh and program allocations replayed: malloc, TLSF heap, slabs
+//   copy       mem_memcpy/mem_memset against libc and a byte loop, 64 B-64 MiB
+//   snapshot   relocatable arena save/restore against walking heap objects
+//   intern     str_id_create/str_id_resolve of 100k asset paths
+//   intern_mt  the same from 1, 2, 4 and 8 threads on the job pool
+//   program    program lookup by id and handle against a scan by name
+//   io         serial file_load_binary against batched file_read_async, with a
+//              warm and (on Linux) a cold page cache
+//   pak        loads from a compressed pak against a stored one, and
+//              lz_decompress alone
+//   mesh       rsrc_mesh_load of version 0 and 1 files, and load in place
+//
+// io and pak write their files to the working directory and remove them
+// after.
+
+// posix_fadvise and fsync are hidden by -std=c11 otherwise.
+#define _DEFAULT_SOURCE
+
+#include "../src/file.h"
+#include "../src/graphics.h"
+#include "../src/jobs.h"
+#include "../src/lz.h"
+#include "../src/resources.h"
+#include "../src/resources_storage.h"
+#include "../src/memory.h"
+#include "../src/string_id.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_REPS 5
+
+static void log_error(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "bench: ");
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+static double now()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint32_t rng_state = 1;
+
+static void rng_seed(uint32_t seed)
+{
+    rng_state = seed ? seed : 1;
+}
+
+// xorshift32, so every variant sees the same sequence.
+static uint32_t rng()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// Results written here cannot be optimized away.
+static volatile uint64_t sink;
+
+static void report(const char* section, const char* name, double value, const char* unit)
+{
+    printf("%-9s %-28s %12.2f %s\n", section, name, value, unit);
+}
+
+// ---- GL stubs ----
+
+// Stand-ins for the GL calls of building programs, meshes and textures, so
+// that the gfx calls run without a context. Every program has the uniforms
+// of basic.vs.
+static const char* const stub_uniforms[] = { "model", "view", "projection", "light_pos" };
+static GLuint stub_next_name;
+
+static GLenum APIENTRY stub_get_error() { return GL_NO_ERROR; }
+static GLuint APIENTRY stub_create_shader(GLenum type) { return ++stub_next_name; }
+static void APIENTRY stub_shader_source(GLuint shader, GLsizei count, const GLchar* const* string,
+                                        const GLint* length) {}
+static void APIENTRY stub_compile_shader(GLuint shader) {}
+static GLuint APIENTRY stub_create_program() { return ++stub_next_name; }
+static void APIENTRY stub_attach_shader(GLuint program, GLuint shader) {}
+static void APIENTRY stub_link_program(GLuint program) {}
+static void APIENTRY stub_delete(GLuint name) {}
+static void APIENTRY stub_bind(GLenum target, GLuint name) {}
+static void APIENTRY stub_bind_vertex_array(GLuint name) {}
+static void APIENTRY stub_delete_names(GLsizei n, const GLuint* names) {}
+static void APIENTRY stub_buffer_data(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {}
+static void APIENTRY stub_enable_vertex_attrib_array(GLuint index) {}
+static void APIENTRY stub_generate_mipmap(GLenum target) {}
+static void APIENTRY stub_tex_parameteri(GLenum target, GLenum pname, GLint param) {}
+
+static void APIENTRY stub_tex_image_2d(GLenum target, GLint level, GLint internal_format, GLsizei width,
+                                       GLsizei height, GLint border, GLenum format, GLenum type,
+                                       const void* pixels) {}
+
+static void APIENTRY stub_vertex_attrib_pointer(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                               GLsizei stride, const void* pointer) {}
+
+static void APIENTRY stub_gen_names(GLsizei n, GLuint* names)
+{
+    for (GLsizei i = 0; i < n; ++i)
+        names[i] = ++stub_next_name;
+}
+
+static void APIENTRY stub_get_shaderiv(GLuint shader, GLenum pname, GLint* params)
+{
+    *params = GL_TRUE;
+}
+
+static void APIENTRY stub_get_programiv(GLuint program, GLenum pname, GLint* params)
+{
+    *params = pname == GL_ACTIVE_UNIFORMS ? (GLint)(sizeof(stub_uniforms) / sizeof(stub_uniforms[0])) : GL_TRUE;
+}
+
+static void APIENTRY stub_get_active_uniform(GLuint program, GLuint index, GLsizei size, GLsizei* length,
+                                             GLint* usize, GLenum* type, GLchar* name)
+{
+    *length = snprintf(name, size, "%s", stub_uniforms[index]);
+    *usize = 1;
+    *type = GL_FLOAT_MAT4;
+}
+
+static GLint APIENTRY stub_get_uniform_location(GLuint program, const GLchar* name)
+{
+    return (GLint)strlen(name);
+}
+
+static void stub_gl()
+{
+    gl3wGetError = stub_get_error;
+    gl3wCreateShader = stub_create_shader;
+    gl3wShaderSource = stub_shader_source;
+    gl3wCompileShader = stub_compile_shader;
+    gl3wGetShaderiv = stub_get_shaderiv;
+    gl3wCreateProgram = stub_create_program;
+    gl3wAttachShader = stub_attach_shader;
+    gl3wLinkProgram = stub_link_program;
+    gl3wGetProgramiv = stub_get_programiv;
+    gl3wGetActiveUniform = stub_get_active_uniform;
+    gl3wGetUniformLocation = stub_get_uniform_location;
+    gl3wDeleteShader = stub_delete;
+    gl3wDeleteProgram = stub_delete;
+
+    gl3wGenVertexArrays = stub_gen_names;
+    gl3wGenBuffers = stub_gen_names;
+    gl3wGenTextures = stub_gen_names;
+    gl3wBindVertexArray = stub_bind_vertex_array;
+    gl3wBindBuffer = stub_bind;
+    gl3wBindTexture = stub_bind;
+    gl3wBufferData = stub_buffer_data;
+    gl3wEnableVertexAttribArray = stub_enable_vertex_attrib_array;
+    gl3wVertexAttribPointer = stub_vertex_attrib_pointer;
+    gl3wTexImage2D = stub_tex_image_2d;
+    gl3wTexParameteri = stub_tex_parameteri;
+    gl3wGenerateMipmap = stub_generate_mipmap;
+    gl3wDeleteVertexArrays = stub_delete_names;
+    gl3wDeleteBuffers = stub_delete_names;
+    gl3wDeleteTextures = stub_delete_names;
+}
+
+// ---- Alloc ----
+
+// The allocations of loading meshes and building their programs, recorded
+// once through the memory hooks of gfx, rsrc and file with the real calls,
+// then replayed against each allocator.
+#define ALLOC_MAX_OPS 4096
+#define ALLOC_MAX_LIVE 1024
+#define ALLOC_MESHES 24 // one blob mount each, within FILE_MAX_MOUNTS
+#define ALLOC_PROGRAMS 16
+#define ALLOC_RELOADS 4
+#define ALLOC_REPLAYS 2000
+
+enum alloc_op_type { ALLOC_OP_MALLOC,
+                     ALLOC_OP_FREE,
+                     ALLOC_OP_REALLOC };
+
+struct alloc_op {
+    uint8_t type; // enum alloc_op_type
+    uint16_t slot; // of the block, reused once it is freed
+    uint32_t size;
+};
+
+static struct alloc_op alloc_ops[ALLOC_MAX_OPS];
+static uint32_t alloc_nops;
+static void* alloc_live[ALLOC_MAX_LIVE]; // recorded blocks by slot
+
+static uint32_t alloc_slot(const void* ptr)
+{
+    uint32_t slot = 0;
+    while (slot < ALLOC_MAX_LIVE && alloc_live[slot] != ptr)
+        ++slot;
+    return slot;
+}
+
+static void alloc_record(uint8_t type, uint32_t slot, size_t size)
+{
+    if (alloc_nops < ALLOC_MAX_OPS && slot < ALLOC_MAX_LIVE)
+        alloc_ops[alloc_nops++] = (struct alloc_op){ type, (uint16_t)slot, (uint32_t)size };
+}
+
+static void* record_malloc(size_t size)
+{
+    void* ptr = malloc(size);
+    uint32_t slot = alloc_slot(0);
+    alloc_record(ALLOC_OP_MALLOC, slot, size);
+    if (ptr && slot < ALLOC_MAX_LIVE)
+        alloc_live[slot] = ptr;
+    return ptr;
+}
+
+static void record_free(void* ptr)
+{
+    if (!ptr)
+        return;
+    uint32_t slot = alloc_slot(ptr);
+    alloc_record(ALLOC_OP_FREE, slot, 0);
+    if (slot < ALLOC_MAX_LIVE)
+        alloc_live[slot] = 0;
+    free(ptr);
+}
+
+static void* record_realloc(void* ptr, size_t size)
+{
+    uint32_t slot = alloc_slot(ptr);
+    void* grown = realloc(ptr, size);
+    alloc_record(ALLOC_OP_REALLOC, slot, size);
+    if (grown && slot < ALLOC_MAX_LIVE)
+        alloc_live[slot] = grown;
+    return grown;
+}
+
+static uint8_t alloc_load_mesh(const char* path, const struct rsrc_texture* texture,
+                               struct rsrc_token* token, struct gfx_mesh* mesh)
+{
+    if (rsrc_load(RSRC_MESH, str_id_hash(path), token) != RSRC_OK) {
+        log_error("Cannot load %s.\n", path);
+        return 0;
+    }
+    if (gfx_mesh_create(mesh, token->mesh, texture, 1) != GFX_OK) {
+        rsrc_unload(token);
+        return 0;
+    }
+    return 1;
+}
+
+// Programs added one at a time, as the storage grows, then meshes loaded
+// through rsrc_load and given a texture by gfx_mesh_create, every other one
+// reloaded a few times, and everything torn down.
+static uint8_t alloc_trace()
+{
+    static char paths[ALLOC_MESHES][32];
+    static char names[ALLOC_PROGRAMS][3][32];
+    file_mount_handle mounts[ALLOC_MESHES] = { 0 };
+    struct rsrc_token tokens[ALLOC_MESHES];
+    struct gfx_mesh meshes[ALLOC_MESHES];
+    struct gfx_program_storage storage = { 0 };
+    uint8_t loaded[ALLOC_MESHES] = { 0 };
+    uint8_t ok = 0;
+
+    // A cube of separate positions, normals and texcoords.
+    float positions[24 * 3] = { 0 }, normals[24 * 3] = { 0 }, texcoords[24 * 3] = { 0 };
+    uint32_t indices[36];
+    for (uint32_t i = 0; i < 36; ++i)
+        indices[i] = i % 24;
+    struct rsrc_mesh cube = { positions, normals, texcoords, indices, 24, 36 };
+    uint8_t pixels[4 * 4 * 4] = { 0 };
+    struct rsrc_texture texture = { pixels, 4, 4, 4 };
+
+    str_id_set_mem(malloc, free);
+    file_set_mem(free, realloc);
+    uint32_t mesh_size = (uint32_t)rsrc_mesh_buf_size(&cube);
+    uint8_t* mesh_file = malloc(mesh_size);
+    if (!mesh_file || rsrc_mesh_save(&cube, mesh_file, mesh_size) != RSRC_OK
+        || !str_id_init(1u << 20))
+        goto done;
+
+    stub_gl();
+    for (uint32_t i = 0; i < ALLOC_MESHES; ++i) {
+        snprintf(paths[i], sizeof(paths[i]), "res/meshes/prop_%02u.mesh", i);
+        if (!str_id_create(paths[i], 1)
+            || file_mount_blob(paths[i], mesh_file, mesh_size, 0, &mounts[i]) != FILE_OK)
+            goto done;
+    }
+
+    alloc_nops = 0;
+    gfx_set_mem(record_malloc, record_free, record_realloc);
+    rsrc_set_mem(record_malloc, record_free, record_realloc);
+    file_set_mem(record_free, record_realloc);
+
+    for (uint32_t i = 0; i < ALLOC_PROGRAMS; ++i) {
+        snprintf(names[i][0], sizeof(names[i][0]), "basic_perm%02u", i);
+        snprintf(names[i][1], sizeof(names[i][1]), "basic_perm%02u.vs", i);
+        snprintf(names[i][2], sizeof(names[i][2]), "basic_perm%02u.fs", i);
+        struct gfx_shader_def shaders[] = {
+            { names[i][1], "", GFX_VERTEX_SHADER },
+            { names[i][2], "", GFX_FRAGMENT_SHADER },
+        };
+        struct gfx_program_def program = { names[i][0], names[i][1], names[i][2] };
+        if (gfx_compile_shaders(&storage, shaders, 2) != GFX_OK
+            || gfx_compile_programs(&storage, &program, 1) != GFX_OK)
+            goto teardown;
+    }
+
+    for (uint32_t i = 0; i < ALLOC_MESHES; ++i) {
+        if (!alloc_load_mesh(paths[i], &texture, &tokens[i], &meshes[i]))
+            goto teardown;
+        loaded[i] = 1;
+    }
+
+    for (uint32_t reload = 0; reload < ALLOC_RELOADS; ++reload) {
+        for (uint32_t i = reload % 2; i < ALLOC_MESHES; i += 2) {
+            gfx_mesh_destroy(&meshes[i]);
+            rsrc_unload(&tokens[i]);
+            loaded[i] = alloc_load_mesh(paths[i], &texture, &tokens[i], &meshes[i]);
+            if (!loaded[i])
+                goto teardown;
+        }
+    }
+    ok = 1;
+
+teardown:
+    for (uint32_t i = 0; i < ALLOC_MESHES; ++i) {
+        if (loaded[i]) {
+            gfx_mesh_destroy(&meshes[i]);
+            rsrc_unload(&tokens[i]);
+        }
+    }
+    gfx_program_storage_destroy(&storage);
+
+done:
+    gfx_set_mem(malloc, free, realloc);
+    rsrc_set_mem(malloc, free, realloc);
+    file_set_mem(free, realloc);
+    for (uint32_t i = 0; i < ALLOC_MESHES; ++i) {
+        if (mounts[i])
+            file_unmount(mounts[i]);
+    }
+    str_id_deinit();
+    free(mesh_file);
+
+    if (alloc_nops == ALLOC_MAX_OPS || alloc_slot(0) == ALLOC_MAX_LIVE) {
+        log_error("Allocation trace does not fit.\n");
+        ok = 0;
+    }
+    return ok;
+}
+
+typedef void* (*alloc_fptr)(size_t);
+typedef void (*free_fptr)(void*);
+typedef void* (*realloc_fptr)(void*, size_t);
+
+// ns per recorded operation
+static double alloc_replay(alloc_fptr alloc, free_fptr release, realloc_fptr resize)
+{
+    static void* blocks[ALLOC_MAX_LIVE];
+
+    double best = 1e30;
+    for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+        double start = now();
+        for (uint32_t replay = 0; replay < ALLOC_REPLAYS; ++replay) {
+            for (uint32_t i = 0; i < alloc_nops; ++i) {
+                const struct alloc_op* op = &alloc_ops[i];
+                switch (op->type) {
+                case ALLOC_OP_MALLOC:
+                    blocks[op->slot] = alloc(op->size);
+                    break;
+                case ALLOC_OP_FREE:
+                    release(blocks[op->slot]);
+                    blocks[op->slot] = 0;
+                    break;
+                default:
+                    blocks[op->slot] = resize(blocks[op->slot], op->size);
+                    break;
+                }
+            }
+        }
+        double t = (now() - start) * 1e9 / ((double)ALLOC_REPLAYS * alloc_nops);
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+static void bench_alloc()
+{
+    if (!alloc_trace())
+        return;
+
+    uint32_t nsmall = 0;
+    for (uint32_t i = 0; i < alloc_nops; ++i)
+        nsmall += alloc_ops[i].type != ALLOC_OP_FREE && alloc_ops[i].size <= MEM_SLAB_MAX_SIZE;
+    report("alloc", "recorded ops", alloc_nops, "");
+    report("alloc", "slab sized allocs", nsmall, "");
+
+    report("alloc", "malloc", alloc_replay(malloc, free, realloc), "ns/op");
+
+    if (mem_heap_init(256u << 20) != MEM_OK)
+        return;
+    report("alloc", "tlsf", alloc_replay(mem_alloc, mem_free, mem_realloc), "ns/op");
+
+    if (mem_slab_init(16u << 20) == MEM_OK) {
+        report("alloc", "slab", alloc_replay(mem_alloc, mem_free, mem_realloc), "ns/op");
+        mem_slab_deinit();
+    }
+    mem_heap_deinit();
+}
+
+// ---- Copy ----
+
+// Moves about this much per run at every size, so caches stay warm for the
+// small ones and the large ones reach memory.
+#define COPY_BYTES_PER_RUN (256u << 20)
+#define COPY_MAX_SIZE (64u << 20)
+
+// Byte at a time, like the rsrc_memcpy and gpu_memcpy mem_memcpy replaced.
+static void copy_bytes(void* dst, const void* src, size_t size)
+{
+    uint8_t* d = dst;
+    const uint8_t* s = src;
+    for (; size; --size)
+        *d++ = *s++;
+}
+
+static void copy_libc(void* dst, const void* src, size_t size)
+{
+    memcpy(dst, src, size);
+}
+
+static void fill_libc(void* dst, uint8_t value, size_t size)
+{
+    memset(dst, value, size);
+}
+
+typedef void (*copy_fptr)(void*, const void*, size_t);
+typedef void (*fill_fptr)(void*, uint8_t, size_t);
+
+// GB/s; exactly one of copy and fill is set.
+static double copy_rate(copy_fptr copy, fill_fptr fill, uint8_t* dst,
+                        const uint8_t* src, size_t size)
+{
+    size_t runs = COPY_BYTES_PER_RUN / size;
+    if (runs == 0)
+        runs = 1;
+
+    double best = 1e30;
+    for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+        double start = now();
+        for (size_t i = 0; i < runs; ++i) {
+            if (copy)
+                copy(dst, src, size);
+            else
+                fill(dst, (uint8_t)i, size);
+        }
+        double t = now() - start;
+        if (t < best)
+            best = t;
+    }
+    return (double)(runs * size) / best * 1e-9;
+}
+
+static void bench_copy()
+{
+    uint8_t* src = malloc(COPY_MAX_SIZE);
+    uint8_t* dst = malloc(COPY_MAX_SIZE);
+    if (!src || !dst) {
+        fprintf(stderr, "bench: out of memory\n");
+        goto done;
+    }
+    memset(src, 0x5a, COPY_MAX_SIZE);
+    memset(dst, 0, COPY_MAX_SIZE);
+
+    static const size_t sizes[] = { 64, 1u << 10, 64u << 10, 1u << 20, 8u << 20, COPY_MAX_SIZE };
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        char name[64];
+        size_t size = sizes[i];
+        const char* unit = size >= (1u << 20) ? "MiB" : size >= 1024 ? "KiB" : "B";
+        size_t scaled = size >= (1u << 20) ? size >> 20 : size >= 1024 ? size >> 10 : size;
+
+        snprintf(name, sizeof(name), "memcpy bytes %zu %s", scaled, unit);
+        report("copy", name, copy_rate(copy_bytes, 0, dst, src, size), "GB/s");
+        snprintf(name, sizeof(name), "memcpy libc %zu %s", scaled, unit);
+        report("copy", name, copy_rate(copy_libc, 0, dst, src, size), "GB/s");
+        snprintf(name, sizeof(name), "mem_memcpy %zu %s", scaled, unit);
+        report("copy", name, copy_rate(mem_memcpy, 0, dst, src, size), "GB/s");
+        snprintf(name, sizeof(name), "memset libc %zu %s", scaled, unit);
+        report("copy", name, copy_rate(0, fill_libc, dst, src, size), "GB/s");
+        snprintf(name, sizeof(name), "mem_memset %zu %s", scaled, unit);
+        report("copy", name, copy_rate(0, mem_memset, dst, src, size), "GB/s");
+    }
+
+done:
+    free(src);
+    free(dst);
+}
+
+// ---- Snapshot ----
+
+// Laid out like game_entity; game_sim's header is rounded up to SNAPSHOT_SIM.
+struct snapshot_entity {
+    float position[3];
+    float scale[3];
+    uint32_t mesh;
+};
+
+#define SNAPSHOT_SIM 64
+#define SNAPSHOT_RUNS (1u << 24) // entities copied per measurement
+
+// us per save and per restore, for nentities in a relocatable arena and for
+// the same entities as separate heap objects copied one by one.
+static void snapshot_time(uint32_t nentities)
+{
+    uint32_t entities_size = nentities * (uint32_t)sizeof(struct snapshot_entity);
+    uint32_t runs = SNAPSHOT_RUNS / nentities;
+    struct mem_rel_arena arena;
+    if (mem_rel_init(&arena, SNAPSHOT_SIM + entities_size + 64) != MEM_OK)
+        return;
+
+    struct snapshot_entity** objects = malloc(nentities * sizeof(*objects));
+    uint8_t* saved = malloc(arena.capacity);
+    if (!objects || !saved)
+        goto done;
+
+    mem_rel_alloc(&arena, SNAPSHOT_SIM);
+    struct snapshot_entity* entities = mem_rel_get(&arena, mem_rel_alloc(&arena, entities_size));
+    for (uint32_t i = 0; i < nentities; ++i) {
+        entities[i] = (struct snapshot_entity){ { (float)i, 0, 0 }, { 1, 1, 1 }, i & 1 };
+        objects[i] = malloc(sizeof(struct snapshot_entity));
+        *objects[i] = entities[i];
+    }
+
+    double best_save = 1e30, best_restore = 1e30;
+    double best_walk_save = 1e30, best_walk_restore = 1e30;
+    for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+        double start = now();
+        for (uint32_t run = 0; run < runs; ++run)
+            mem_rel_save(&arena, saved);
+        double t = now() - start;
+        best_save = t < best_save ? t : best_save;
+
+        start = now();
+        for (uint32_t run = 0; run < runs; ++run)
+            mem_rel_restore(&arena, saved, arena.used);
+        t = now() - start;
+        best_restore = t < best_restore ? t : best_restore;
+
+        start = now();
+        for (uint32_t run = 0; run < runs; ++run) {
+            struct snapshot_entity* out = (struct snapshot_entity*)(saved + SNAPSHOT_SIM);
+            for (uint32_t i = 0; i < nentities; ++i)
+                out[i] = *objects[i];
+        }
+        t = now() - start;
+        best_walk_save = t < best_walk_save ? t : best_walk_save;
+
+        start = now();
+        for (uint32_t run = 0; run < runs; ++run) {
+            const struct snapshot_entity* in = (const struct snapshot_entity*)(saved + SNAPSHOT_SIM);
+            for (uint32_t i = 0; i < nentities; ++i)
+                *objects[i] = in[i];
+        }
+        t = now() - start;
+        best_walk_restore = t < best_walk_restore ? t : best_walk_restore;
+    }
+
+    char name[64];
+    const double us = 1e6 / runs;
+    snprintf(name, sizeof(name), "arena save %u", nentities);
+    report("snapshot", name, best_save * us, "us");
+    snprintf(name, sizeof(name), "arena restore %u", nentities);
+    report("snapshot", name, best_restore * us, "us");
+    snprintf(name, sizeof(name), "heap walk save %u", nentities);
+    report("snapshot", name, best_walk_save * us, "us");
+    snprintf(name, sizeof(name), "heap walk restore %u", nentities);
+    report("snapshot", name, best_walk_restore * us, "us");
+
+    for (uint32_t i = 0; i < nentities; ++i)
+        free(objects[i]);
+done:
+    free(objects);
+    free(saved);
+    mem_rel_deinit(&arena);
+}
+
+static void bench_snapshot()
+{
+    // GAME_MAX_ENTITIES, then what a larger simulation would need.
+    snapshot_time(1024);
+    snapshot_time(16 * 1024);
+    snapshot_time(256 * 1024);
+}
+
+// ---- Intern ----
+
+#define INTERN_NAMES 100000
+#define INTERN_NAME_SIZE 48
+
+static char (*intern_names)[INTERN_NAME_SIZE];
+
+static uint8_t intern_make_names()
+{
+    if (intern_names)
+        return 1;
+
+    intern_names = malloc(INTERN_NAMES * sizeof(*intern_names));
+    if (!intern_names) {
+        fprintf(stderr, "bench: out of memory\n");
+        return 0;
+    }
+    for (uint32_t i = 0; i < INTERN_NAMES; ++i)
+        snprintf(intern_names[i], INTERN_NAME_SIZE, "res/meshes/level_%02u/prop_%06u.mesh", i % 32, i);
+    return 1;
+}
+
+// Room for every level the names grow the table to, and their copies.
+static uint8_t intern_reset()
+{
+    return str_id_init(32u << 20);
+}
+
+static void bench_intern()
+{
+    if (!intern_make_names())
+        return;
+    str_id_set_mem(malloc, free);
+
+    double best_hash = 1e30, best_insert = 1e30, best_find = 1e30, best_resolve = 1e30;
+    for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+        if (!intern_reset())
+            return;
+
+        str_id sum = 0;
+        double start = now();
+        for (uint32_t i = 0; i < INTERN_NAMES; ++i)
+            sum += str_id_hash(intern_names[i]);
+        double t = now() - start;
+        best_hash = t < best_hash ? t : best_hash;
+
+        start = now();
+        for (uint32_t i = 0; i < INTERN_NAMES; ++i)
+            sum += str_id_create(intern_names[i], 1);
+        t = now() - start;
+        best_insert = t < best_insert ? t : best_insert;
+
+        start = now();
+        for (uint32_t i = 0; i < INTERN_NAMES; ++i)
+            sum += str_id_create(intern_names[i], 1);
+        t = now() - start;
+        best_find = t < best_find ? t : best_find;
+
+        rng_seed(rep + 1);
+        start = now();
+        for (uint32_t i = 0; i < INTERN_NAMES; ++i)
+            sum += (uintptr_t)str_id_resolve(str_id_hash(intern_names[rng() % INTERN_NAMES]));
+        t = now() - start;
+        best_resolve = t < best_resolve ? t : best_resolve;
+
+        sink = sum;
+    }
+    str_id_deinit();
+
+    const double ns = 1e9 / INTERN_NAMES;
+    report("intern", "hash only", best_hash * ns, "ns/name");
+    report("intern", "create new", best_insert * ns, "ns/name");
+    report("intern", "create existing", best_find * ns, "ns/name");
+    report("intern", "hash + resolve", best_resolve * ns, "ns/name");
+}
+
+// ---- Intern, threaded ----
+
+struct intern_job {
+    uint32_t first;
+    uint32_t count;
+    uint8_t lookup; // resolve every name instead of creating its own
+    uint32_t failed; // per job, the threads share no results
+};
+
+static void intern_job(void* data)
+{
+    struct intern_job* job = data;
+    if (job->lookup) {
+        for (uint32_t i = 0; i < INTERN_NAMES; ++i)
+            job->failed += str_id_resolve(str_id_hash(intern_names[(job->first + i) % INTERN_NAMES])) == 0;
+        return;
+    }
+
+    for (uint32_t i = job->first; i < job->first + job->count; ++i)
+        job->failed += str_id_create(intern_names[i], 1) == 0;
+}
+
+// Seconds for nthreads jobs, all on the pool and the calling thread.
+static double intern_run(struct intern_job* jobs, uint32_t nthreads)
+{
+    struct jobs_counter counter = { 0 };
+    double start = now();
+    for (uint32_t i = 0; i < nthreads; ++i)
+        jobs_submit(intern_job, &jobs[i], &counter);
+    jobs_wait(&counter);
+    return now() - start;
+}
+
+static void bench_intern_mt()
+{
+    if (!intern_make_names())
+        return;
+    str_id_set_mem(malloc, free);
+
+    static const uint32_t thread_counts[] = { 1, 2, 4, 8 };
+    for (uint32_t c = 0; c < sizeof(thread_counts) / sizeof(thread_counts[0]); ++c) {
+        uint32_t nthreads = thread_counts[c];
+        if (nthreads > 1 && jobs_init(nthreads - 1) != JOBS_OK)
+            return;
+
+        struct intern_job jobs[8];
+        double best_insert = 1e30, best_lookup = 1e30;
+        uint32_t failed = 0;
+        for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+            if (!intern_reset())
+                return;
+
+            // Each thread creates its own slice of the names...
+            for (uint32_t i = 0; i < nthreads; ++i) {
+                uint32_t first = INTERN_NAMES / nthreads * i;
+                uint32_t last = i + 1 == nthreads ? INTERN_NAMES : first + INTERN_NAMES / nthreads;
+                jobs[i] = (struct intern_job){ .first = first, .count = last - first };
+            }
+            double t = intern_run(jobs, nthreads);
+            best_insert = t < best_insert ? t : best_insert;
+            for (uint32_t i = 0; i < nthreads; ++i)
+                failed += jobs[i].failed;
+
+            // ...then every thread resolves all of them.
+            for (uint32_t i = 0; i < nthreads; ++i)
+                jobs[i] = (struct intern_job){ .first = INTERN_NAMES / nthreads * i, .lookup = 1 };
+            t = intern_run(jobs, nthreads);
+            best_lookup = t < best_lookup ? t : best_lookup;
+            for (uint32_t i = 0; i < nthreads; ++i)
+                failed += jobs[i].failed;
+        }
+        jobs_deinit();
+        if (failed)
+            log_error("%u names failed to intern or resolve with %u threads.\n", failed, nthreads);
+
+        char name[64];
+        snprintf(name, sizeof(name), "create %u threads", nthreads);
+        report("intern_mt", name, INTERN_NAMES / best_insert * 1e-6, "M names/s");
+        snprintf(name, sizeof(name), "resolve %u threads", nthreads);
+        report("intern_mt", name, INTERN_NAMES * (double)nthreads / best_lookup * 1e-6, "M names/s");
+    }
+    str_id_deinit();
+}
+
+// ---- Program ----
+
+#define PROGRAM_MAX 600
+#define PROGRAM_LOOKUPS (1 << 20)
+#define PROGRAM_NAME_SIZE 32
+
+// Linear scan comparing names, as gfx_get_program did before the index.
+static struct gfx_program* program_scan(const struct gfx_program_storage* storage, const char* name)
+{
+    for (uint32_t i = 0; i < storage->nprograms; ++i) {
+        if (strcmp(storage->programs[i].name, name) == 0)
+            return &storage->programs[i];
+    }
+    return 0;
+}
+
+static void program_time(uint32_t nprograms)
+{
+    static char names[PROGRAM_MAX][3][PROGRAM_NAME_SIZE];
+    static struct gfx_shader_def shader_defs[PROGRAM_MAX * 2];
+    static struct gfx_program_def program_defs[PROGRAM_MAX];
+    static str_id ids[PROGRAM_MAX];
+    static gfx_program_handle handles[PROGRAM_MAX];
+
+    for (uint32_t i = 0; i < nprograms; ++i) {
+        // Permutations of one shader, as generated from feature defines.
+        snprintf(names[i][0], PROGRAM_NAME_SIZE, "basic_perm%03u", i);
+        snprintf(names[i][1], PROGRAM_NAME_SIZE, "basic_perm%03u.vs", i);
+        snprintf(names[i][2], PROGRAM_NAME_SIZE, "basic_perm%03u.fs", i);
+        shader_defs[2 * i] = (struct gfx_shader_def){ names[i][1], "", GFX_VERTEX_SHADER };
+        shader_defs[2 * i + 1] = (struct gfx_shader_def){ names[i][2], "", GFX_FRAGMENT_SHADER };
+        program_defs[i] = (struct gfx_program_def){ names[i][0], names[i][1], names[i][2] };
+        ids[i] = str_id_hash(names[i][0]);
+    }
+
+    struct gfx_program_storage storage = { 0 };
+    double start = now();
+    if (gfx_compile_shaders(&storage, shader_defs, nprograms * 2) != GFX_OK
+        || gfx_compile_programs(&storage, program_defs, nprograms) != GFX_OK)
+        goto done;
+    double compile = now() - start;
+
+    for (uint32_t i = 0; i < nprograms; ++i)
+        gfx_find_program(&storage, ids[i], &handles[i]);
+
+    double best_scan = 1e30, best_find = 1e30, best_get = 1e30;
+    for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+        uint64_t sum = 0;
+
+        rng_seed(rep + 1);
+        start = now();
+        for (uint32_t i = 0; i < PROGRAM_LOOKUPS; ++i)
+            sum += (uintptr_t)program_scan(&storage, names[rng() % nprograms][0]);
+        double t = now() - start;
+        best_scan = t < best_scan ? t : best_scan;
+
+        rng_seed(rep + 1);
+        start = now();
+        for (uint32_t i = 0; i < PROGRAM_LOOKUPS; ++i) {
+            gfx_program_handle handle;
+            gfx_find_program(&storage, ids[rng() % nprograms], &handle);
+            sum += handle;
+        }
+        t = now() - start;
+        best_find = t < best_find ? t : best_find;
+
+        rng_seed(rep + 1);
+        start = now();
+        for (uint32_t i = 0; i < PROGRAM_LOOKUPS; ++i)
+            sum += (uintptr_t)gfx_program_get(&storage, handles[rng() % nprograms]);
+        t = now() - start;
+        best_get = t < best_get ? t : best_get;
+
+        sink = sum;
+    }
+
+    char name[64];
+    const double ns = 1e9 / PROGRAM_LOOKUPS;
+    snprintf(name, sizeof(name), "compile %u (stubbed GL)", nprograms);
+    report("program", name, compile * 1e6, "us");
+    snprintf(name, sizeof(name), "scan by name %u", nprograms);
+    report("program", name, best_scan * ns, "ns/lookup");
+    snprintf(name, sizeof(name), "gfx_find_program %u", nprograms);
+    report("program", name, best_find * ns, "ns/lookup");
+    snprintf(name, sizeof(name), "gfx_program_get %u", nprograms);
+    report("program", name, best_get * ns, "ns/lookup");
+
+done:
+    gfx_program_storage_destroy(&storage);
+}
+
+static void bench_program()
+{
+    stub_gl();
+    gfx_set_mem(malloc, free, realloc);
+
+    // What the game has now, then a full set of permutations.
+    program_time(16);
+    program_time(PROGRAM_MAX);
+}
+
+// ---- IO ----
+
+#define IO_MAX_FILES 1024
+#define IO_NAME_SIZE 32
+
+struct io_set {
+    const char* name;
+    uint32_t nfiles;
+    uint32_t file_size;
+};
+
+static char io_paths[IO_MAX_FILES][IO_NAME_SIZE];
+
+// Drops the file from the page cache, so the next read comes from the disk.
+// Returns 0 where that is not possible.
+static uint8_t evict(const char* path)
+{
+#ifdef __linux__
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    fsync(fd);
+    int err = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return err == 0;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+static uint8_t io_evict(uint32_t nfiles)
+{
+    for (uint32_t i = 0; i < nfiles; ++i) {
+        if (!evict(io_paths[i]))
+            return 0;
+    }
+    return 1;
+}
+
+// Seconds to read the whole set, one file after the other or in one batch.
+// Either way all buffers are alive at the end, as after a load phase.
+static double io_run(uint32_t nfiles, uint8_t async, uint8_t cold)
+{
+    static struct file_async_read reads[IO_MAX_FILES];
+
+    if (cold && !io_evict(nfiles))
+        return -1;
+
+    for (uint32_t i = 0; i < nfiles; ++i)
+        reads[i] = (struct file_async_read){ .path = io_paths[i] };
+
+    double start = now();
+    if (async) {
+        file_read_async(reads, nfiles);
+        file_async_wait();
+    } else {
+        for (uint32_t i = 0; i < nfiles; ++i)
+            reads[i].status = file_load_binary(io_paths[i], &reads[i].buf, &reads[i].size);
+    }
+    double t = now() - start;
+
+    for (uint32_t i = 0; i < nfiles; ++i) {
+        if (reads[i].status != FILE_OK)
+            log_error("Cannot read %s.\n", io_paths[i]);
+        file_unload_binary(&reads[i].buf);
+    }
+    return t;
+}
+
+static void io_time(const struct io_set* set)
+{
+    uint8_t* data = malloc(set->file_size);
+    if (!data)
+        return;
+    for (uint32_t i = 0; i < set->file_size; ++i)
+        data[i] = (uint8_t)rng();
+
+    uint32_t nwritten = 0;
+    for (; nwritten < set->nfiles; ++nwritten) {
+        snprintf(io_paths[nwritten], IO_NAME_SIZE, "bench_io_%04u.tmp", nwritten);
+        if (file_save_binary(io_paths[nwritten], data, set->file_size) != FILE_OK) {
+            log_error("Cannot write %s.\n", io_paths[nwritten]);
+            goto done;
+        }
+    }
+
+    static const char* const runs[] = { "serial warm", "async warm", "serial cold", "async cold" };
+    for (uint32_t r = 0; r < 4; ++r) {
+        double best = 1e30;
+        for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+            double t = io_run(set->nfiles, r & 1, r >> 1);
+            best = t < best ? t : best;
+        }
+        if (best < 0)
+            continue; // no way to go cold
+
+        char name[64];
+        snprintf(name, sizeof(name), "%s %s", set->name, runs[r]);
+        report("io", name, (double)set->nfiles * set->file_size / best * 1e-6, "MB/s");
+    }
+
+done:
+    for (uint32_t i = 0; i < nwritten; ++i)
+        remove(io_paths[i]);
+    free(data);
+}
+
+static void bench_io()
+{
+    file_set_mem(free, realloc);
+    if (jobs_init(0) != JOBS_OK || file_async_init(64) != FILE_OK)
+        return;
+
+    // Meshes and textures, then small files like shaders and configs.
+    static const struct io_set sets[] = {
+        { "64 x 1 MiB", 64, 1u << 20 },
+        { "1024 x 8 KiB", 1024, 8u << 10 },
+    };
+    for (uint32_t i = 0; i < sizeof(sets) / sizeof(sets[0]); ++i)
+        io_time(&sets[i]);
+
+    file_async_deinit();
+    jobs_deinit();
+}
+
+// ---- Pak ----
+
+#define PAK_ENTRIES 16
+#define PAK_ENTRY_SIZE (4u << 20)
+#define PAK_PATH_SIZE 32
+
+static uint64_t pak_align(uint64_t offset)
+{
+    return (offset + FILE_PAK_ALIGN - 1) & ~(uint64_t)(FILE_PAK_ALIGN - 1);
+}
+
+// Packs the data into `path` under entries[i], in blocks as pak_gen does, or
+// stored. Gives the bytes the entries take in the pak.
+static uint64_t pak_write(const char* path, const uint8_t* data, char (*entries)[PAK_PATH_SIZE],
+                          uint8_t compress)
+{
+    const uint32_t nblocks = PAK_ENTRY_SIZE / FILE_PAK_BLOCK_SIZE;
+    const uint32_t nslots = 2 * PAK_ENTRIES;
+    uint64_t toc_end = sizeof(struct file_pak_header) + nslots * sizeof(struct file_pak_entry);
+
+    uint8_t* head = calloc(1, toc_end);
+    uint8_t* packed = malloc(nblocks * (sizeof(uint32_t) + lz_compress_bound(FILE_PAK_BLOCK_SIZE)));
+    FILE* f = fopen(path, "wb");
+    uint64_t total = 0;
+    if (!head || !packed || !f)
+        goto done;
+
+    *(struct file_pak_header*)head = (struct file_pak_header){
+        .magic = FILE_PAK_MAGIC,
+        .nentries = PAK_ENTRIES,
+        .nslots = nslots,
+    };
+    struct file_pak_entry* toc = (struct file_pak_entry*)(head + sizeof(struct file_pak_header));
+    fwrite(head, 1, toc_end, f);
+
+    uint64_t offset = toc_end;
+    for (uint32_t i = 0; i < PAK_ENTRIES; ++i) {
+        const uint8_t* entry = data + (size_t)i * PAK_ENTRY_SIZE;
+        uint64_t size = PAK_ENTRY_SIZE;
+        if (compress) {
+            uint32_t* table = (uint32_t*)packed;
+            size = nblocks * sizeof(uint32_t);
+            for (uint32_t b = 0; b < nblocks; ++b) {
+                size_t n = lz_compress(entry + b * FILE_PAK_BLOCK_SIZE, FILE_PAK_BLOCK_SIZE, packed + size);
+                table[b] = (uint32_t)n;
+                if (n >= FILE_PAK_BLOCK_SIZE) {
+                    memcpy(packed + size, entry + b * FILE_PAK_BLOCK_SIZE, FILE_PAK_BLOCK_SIZE);
+                    n = FILE_PAK_BLOCK_SIZE;
+                    table[b] = (uint32_t)n | FILE_PAK_BLOCK_STORED;
+                }
+                size += n;
+            }
+            entry = packed;
+        }
+
+        uint64_t start = pak_align(offset);
+        static const uint8_t zeros[FILE_PAK_ALIGN];
+        fwrite(zeros, 1, start - offset, f);
+        fwrite(entry, 1, size, f);
+        offset = start + size;
+        total += size;
+
+        str_id id = str_id_hash(entries[i]);
+        uint32_t slot = file_pak_slot(id, nslots);
+        while (toc[slot].id != 0)
+            slot = (slot + 1) & (nslots - 1);
+        toc[slot] = (struct file_pak_entry){
+            .id = id,
+            .offset = start,
+            .size = PAK_ENTRY_SIZE,
+            .packed_size = compress ? size : 0,
+        };
+    }
+
+    fseek(f, 0, SEEK_SET);
+    if (fwrite(head, 1, toc_end, f) != toc_end)
+        total = 0;
+
+done:
+    if (f && fclose(f) != 0)
+        total = 0;
+    free(head);
+    free(packed);
+    return total;
+}
+
+// Seconds to load every entry from the pak, -1 when it cannot be mounted.
+static double pak_run(const char* path, char (*entries)[PAK_PATH_SIZE], uint8_t cold)
+{
+    static uint8_t* bufs[PAK_ENTRIES];
+    if (cold && !evict(path))
+        return -1;
+
+    file_mount_handle mount;
+    if (file_mount_pak(path, 0, &mount) != FILE_OK)
+        return -1;
+
+    double start = now();
+    for (uint32_t i = 0; i < PAK_ENTRIES; ++i) {
+        uint32_t size;
+        if (file_load_binary(entries[i], &bufs[i], &size) != FILE_OK || size != PAK_ENTRY_SIZE)
+            log_error("Cannot load %s from %s.\n", entries[i], path);
+    }
+    double t = now() - start;
+
+    for (uint32_t i = 0; i < PAK_ENTRIES; ++i)
+        file_unload_binary(&bufs[i]);
+    file_unmount(mount);
+    return t;
+}
+
+static void bench_pak()
+{
+    static char entries[PAK_ENTRIES][PAK_PATH_SIZE];
+    static const char* const paks[] = { "bench_stored.tmp", "bench_packed.tmp" };
+
+    file_set_mem(free, realloc);
+    if (jobs_init(0) != JOBS_OK)
+        return;
+
+    // Vertices of flat grid meshes: position, normal and texture coords.
+    float* data = malloc((size_t)PAK_ENTRIES * PAK_ENTRY_SIZE);
+    uint8_t* packed_block = malloc(lz_compress_bound(FILE_PAK_BLOCK_SIZE));
+    uint8_t* block = malloc(FILE_PAK_BLOCK_SIZE);
+    if (!data || !packed_block || !block)
+        goto done;
+    const uint32_t nverts = PAK_ENTRIES * PAK_ENTRY_SIZE / (8 * sizeof(float));
+    for (uint32_t i = 0; i < nverts; ++i) {
+        float x = (float)(i % 256), z = (float)(i / 256 % 256);
+        float v[8] = { x, (float)(rng() % 16) * 0.125f, z, 0, 1, 0, x / 255, z / 255 };
+        memcpy(&data[i * 8], v, sizeof(v));
+    }
+    for (uint32_t i = 0; i < PAK_ENTRIES; ++i)
+        snprintf(entries[i], PAK_PATH_SIZE, "meshes/grid_%02u.mesh", i);
+
+    uint64_t stored = pak_write(paks[0], (const uint8_t*)data, entries, 0);
+    uint64_t packed = pak_write(paks[1], (const uint8_t*)data, entries, 1);
+    if (!stored || !packed) {
+        log_error("Cannot write the paks.\n");
+        goto done;
+    }
+
+    // The codec alone, on one thread.
+    size_t n = lz_compress((const uint8_t*)data, FILE_PAK_BLOCK_SIZE, packed_block);
+    double best = 1e30;
+    for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+        double start = now();
+        for (uint32_t i = 0; i < 256; ++i)
+            lz_decompress(packed_block, n, block, FILE_PAK_BLOCK_SIZE);
+        double t = now() - start;
+        best = t < best ? t : best;
+    }
+    report("pak", "lz_decompress 64 KiB block", 256.0 * FILE_PAK_BLOCK_SIZE / best * 1e-6, "MB/s");
+
+    report("pak", "compressed size", 100.0 * packed / stored, "%");
+    report("pak", "job workers", jobs_nthreads(), "");
+
+    static const char* const runs[] = { "stored warm", "compressed warm", "stored cold", "compressed cold" };
+    for (uint32_t r = 0; r < 4; ++r) {
+        best = 1e30;
+        for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+            double t = pak_run(paks[r & 1], entries, r >> 1);
+            best = t < best ? t : best;
+        }
+        if (best >= 0)
+            report("pak", runs[r], (double)PAK_ENTRIES * PAK_ENTRY_SIZE / best * 1e-6, "MB/s");
+    }
+
+done:
+    remove(paks[0]);
+    remove(paks[1]);
+    free(data);
+    free(packed_block);
+    free(block);
+    jobs_deinit();
+}
+
+// ---- Mesh ----
+
+#define MESH_RUNS (1u << 24) // vertices loaded per measurement
+
+// Version 0 file of the mesh: packed counts and flags (texcoords 1, normals
+// 2), then positions, texcoords, normals and indices back to back.
+static uint8_t* mesh_write_v0(const struct rsrc_mesh* mesh, uint32_t* size)
+{
+    uint32_t array_size = mesh->nverts * 3 * sizeof(float);
+    *size = 10 + 3 * array_size + mesh->nindices * sizeof(uint32_t);
+    uint8_t* buf = malloc(*size);
+    if (!buf)
+        return 0;
+
+    uint8_t* p = buf;
+    *p++ = 0;
+    memcpy(p, &mesh->nverts, 4);
+    memcpy(p + 4, &mesh->nindices, 4);
+    p[8] = 1 | 2;
+    p += 9;
+    memcpy(p, mesh->positions, array_size);
+    memcpy(p + array_size, mesh->texcoords, array_size);
+    memcpy(p + 2 * array_size, mesh->normals, array_size);
+    memcpy(p + 3 * array_size, mesh->indices, mesh->nindices * sizeof(uint32_t));
+    return buf;
+}
+
+static void mesh_time(uint32_t nverts)
+{
+    // A grid, two triangles per quad.
+    uint32_t side = 1;
+    while (side * side < nverts)
+        ++side;
+    nverts = side * side;
+    uint32_t nindices = (side - 1) * (side - 1) * 6;
+
+    struct rsrc_mesh mesh = {
+        .positions = malloc(nverts * 3 * sizeof(float)),
+        .normals = malloc(nverts * 3 * sizeof(float)),
+        .texcoords = malloc(nverts * 3 * sizeof(float)),
+        .indices = malloc(nindices * sizeof(uint32_t)),
+        .nverts = nverts,
+        .nindices = nindices,
+    };
+    uint8_t* v0 = 0;
+    uint8_t* v1 = 0;
+    if (!mesh.positions || !mesh.normals || !mesh.texcoords || !mesh.indices)
+        goto done;
+
+    for (uint32_t i = 0; i < nverts; ++i) {
+        float x = (float)(i % side), z = (float)(i / side);
+        memcpy(&mesh.positions[i * 3], (float[3]){ x, 0, z }, 3 * sizeof(float));
+        memcpy(&mesh.normals[i * 3], (float[3]){ 0, 1, 0 }, 3 * sizeof(float));
+        memcpy(&mesh.texcoords[i * 3], (float[3]){ x / side, z / side, 0 }, 3 * sizeof(float));
+    }
+    uint32_t* idx = mesh.indices;
+    for (uint32_t z = 0; z + 1 < side; ++z) {
+        for (uint32_t x = 0; x + 1 < side; ++x) {
+            uint32_t i = z * side + x;
+            uint32_t quad[6] = { i, i + side, i + 1, i + 1, i + side, i + side + 1 };
+            memcpy(idx, quad, sizeof(quad));
+            idx += 6;
+        }
+    }
+
+    uint32_t v0_size;
+    uint32_t v1_size = (uint32_t)rsrc_mesh_buf_size(&mesh);
+    v0 = mesh_write_v0(&mesh, &v0_size);
+    v1 = malloc(v1_size); // 16 byte aligned, as RSRC_MESH_ALIGN needs
+    if (!v0 || !v1 || rsrc_mesh_save(&mesh, v1, v1_size) != RSRC_OK)
+        goto done;
+
+    uint32_t runs = MESH_RUNS / nverts + 1;
+    double best[3] = { 1e30, 1e30, 1e30 };
+    for (uint32_t rep = 0; rep < BENCH_REPS; ++rep) {
+        for (uint32_t kind = 0; kind < 3; ++kind) {
+            double start = now();
+            for (uint32_t run = 0; run < runs; ++run) {
+                struct rsrc_mesh loaded;
+                enum rsrc_status status = kind == 0   ? rsrc_mesh_load(&loaded, v0, v0_size)
+                                          : kind == 1 ? rsrc_mesh_load(&loaded, v1, v1_size)
+                                                      : rsrc_mesh_load_in_place(&loaded, v1, v1_size);
+                if (status != RSRC_OK) {
+                    log_error("Cannot load the mesh.\n");
+                    goto done;
+                }
+                rsrc_mesh_unload(&loaded);
+            }
+            double t = (now() - start) / runs;
+            best[kind] = t < best[kind] ? t : best[kind];
+        }
+    }
+
+    static const char* const kinds[] = { "v0 load", "v1 load", "v1 in place" };
+    for (uint32_t kind = 0; kind < 3; ++kind) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s %u verts", kinds[kind], nverts);
+        report("mesh", name, best[kind] * 1e6, "us");
+    }
+
+done:
+    free(mesh.positions);
+    free(mesh.normals);
+    free(mesh.texcoords);
+    free(mesh.indices);
+    free(v0);
+    free(v1);
+}
+
+static void bench_mesh()
+{
+    rsrc_set_mem(malloc, free, realloc);
+
+    // A prop, then about the size of the buddha.
+    mesh_time(16 * 1024);
+    mesh_time(512 * 1024);
+}
+
+// ---- Main ----
+
+struct bench_section {
+    const char* name;
+    void (*run)();
+};
+
+static const struct bench_section sections[] = {
+    { "alloc", bench_alloc },
+    { "copy", bench_copy },
+    { "snapshot", bench_snapshot },
+    { "intern", bench_intern },
+    { "intern_mt", bench_intern_mt },
+    { "program", bench_program },
+    { "io", bench_io },
+    { "pak", bench_pak },
+    { "mesh", bench_mesh },
+};
+
+int main(int argc, char** argv)
+{
+    gfx_set_log(log_error);
+    gpu_set_log(log_error);
+    mem_set_log(log_error);
+    rsrc_set_log(log_error);
+    str_id_set_log(log_error);
+    jobs_set_log(log_error);
+
+    const uint32_t nsections = sizeof(sections) / sizeof(sections[0]);
+
+    for (int i = 1; i < argc; ++i) {
+        uint32_t s = 0;
+        while (s < nsections && strcmp(argv[i], sections[s].name) != 0)
+            ++s;
+        if (s == nsections) {
+            fprintf(stderr, "bench: unknown section %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    for (uint32_t s = 0; s < nsections; ++s) {
+        uint8_t run = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            run |= strcmp(argv[i], sections[s].name) == 0;
+        if (run)
+            sections[s].run();
+    }
+    return 0;
+}
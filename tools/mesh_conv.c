@@ -0,0 +1,329 @@
+// Rewrites a mesh in the latest format, see rsrc_mesh_version.
+//
+// Usage: mesh_conv [--interleave] [--quantize [--half-positions]]
+//                  <input mesh> <output mesh>
+//
+// Reads any version rsrc_mesh_load accepts. Input and output may be the same
+// file.
+//
+// --interleave stores the vertices packed by gpu_pack_verts instead of the
+// separate arrays, so gfx_mesh_create uploads them without packing.
+//
+// --quantize interleaves them with gpu_pack_verts_quantized instead: int16
+// positions scaled to the bounds (half floats with --half-positions),
+// octahedral normals and uint16 texture coords, when those are all in
+// [0, 1]. Prints the error against the float source, as the GPU reads it.
+
+#include "../src/gpu.h"
+#include "../src/resources.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void log_error(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "mesh_conv: ");
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+static uint8_t* read_file(const char* path, uint32_t* size)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "mesh_conv: cannot open %s\n", path);
+        return 0;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long s = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* data = s >= 0 && (unsigned long)s <= UINT32_MAX ? malloc(s ? (size_t)s : 1) : 0;
+    if (!data || fread(data, 1, (size_t)s, f) != (size_t)s) {
+        fprintf(stderr, "mesh_conv: cannot read %s\n", path);
+        free(data);
+        fclose(f);
+        return 0;
+    }
+
+    fclose(f);
+    *size = (uint32_t)s;
+    return data;
+}
+
+// ---- Quantization ----
+
+// Bias at the center of the bounds and scale to their half extent, so
+// positions land in [-1, 1].
+static void fit_bounds(const float* positions, uint32_t nverts, float* quant)
+{
+    for (uint32_t axis = 0; axis < 3; ++axis) {
+        float lo = nverts ? positions[axis] : 0.0f;
+        float hi = lo;
+        for (uint32_t i = 1; i < nverts; ++i) {
+            float v = positions[i * 3 + axis];
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+
+        float half_extent = (hi - lo) * 0.5f;
+        quant[axis] = half_extent > 0.0f ? half_extent : 1.0f;
+        quant[3 + axis] = lo + half_extent;
+    }
+}
+
+static int texcoords_in_unit_range(const float* texcoords, uint32_t nverts)
+{
+    for (uint32_t i = 0; i < nverts; ++i) {
+        float u = texcoords[i * 3];
+        float v = texcoords[i * 3 + 1];
+        if (!(u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f))
+            return 0;
+    }
+
+    return 1;
+}
+
+// ---- Error report ----
+
+// The reverse of what the GPU does with each encoding, see
+// gpu_vertex_buffer_create and basic.vs.
+
+static float read_snorm16(const uint8_t* p)
+{
+    int16_t c;
+    memcpy(&c, p, sizeof(c));
+    float v = (float)c / 32767.0f;
+    return v < -1.0f ? -1.0f : v;
+}
+
+static float read_unorm16(const uint8_t* p)
+{
+    uint16_t c;
+    memcpy(&c, p, sizeof(c));
+    return (float)c / 65535.0f;
+}
+
+static float read_half(const uint8_t* p)
+{
+    uint16_t h;
+    memcpy(&h, p, sizeof(h));
+
+    float sign = (h & 0x8000) ? -1.0f : 1.0f;
+    int exp = (h >> 10) & 0x1f;
+    int mantissa = h & 0x3ff;
+    if (exp == 0)
+        return sign * ldexpf((float)mantissa, -24);
+    if (exp == 31)
+        return mantissa ? NAN : sign * INFINITY;
+    return sign * ldexpf((float)(mantissa | 0x400), exp - 25);
+}
+
+static void decode_oct(float x, float y, float* n)
+{
+    n[0] = x;
+    n[1] = y;
+    n[2] = 1.0f - fabsf(x) - fabsf(y);
+
+    float t = n[2] < 0.0f ? -n[2] : 0.0f;
+    n[0] += n[0] >= 0.0f ? -t : t;
+    n[1] += n[1] >= 0.0f ? -t : t;
+
+    float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (uint32_t i = 0; i < 3; ++i)
+        n[i] /= len;
+}
+
+static void report_error(const struct rsrc_mesh* src, const uint8_t* vertices,
+                         gpu_vtx_flags_t flags, const float* quant)
+{
+    uint32_t size = gpu_vertex_size(flags);
+    double pos_max = 0.0, pos_sum = 0.0, norm_max = 0.0, norm_sum = 0.0, tex_max = 0.0;
+
+    for (uint32_t vert_i = 0; vert_i < src->nverts; ++vert_i) {
+        const uint8_t* v = vertices + (size_t)vert_i * size;
+
+        if (flags & (GPU_POS_SNORM16 | GPU_POS_HALF)) {
+            const float* p = src->positions + vert_i * 3;
+            for (uint32_t i = 0; i < 3; ++i) {
+                float stored = (flags & GPU_POS_SNORM16) ? read_snorm16(v + i * 2) : read_half(v + i * 2);
+                double e = fabs((double)(stored * quant[i] + quant[3 + i]) - p[i]);
+                pos_max = e > pos_max ? e : pos_max;
+                pos_sum += e * e;
+            }
+        }
+        if (flags & GPU_POS)
+            v += (flags & (GPU_POS_SNORM16 | GPU_POS_HALF)) ? 8 : 12;
+
+        if (flags & GPU_NORM_OCT) {
+            const float* n = src->normals + vert_i * 3;
+            float decoded[3];
+            decode_oct(read_snorm16(v), read_snorm16(v + 2), decoded);
+
+            // acos of the dot product cannot tell apart angles this small.
+            double cross[3] = {
+                (double)decoded[1] * n[2] - (double)decoded[2] * n[1],
+                (double)decoded[2] * n[0] - (double)decoded[0] * n[2],
+                (double)decoded[0] * n[1] - (double)decoded[1] * n[0],
+            };
+            double dot = (double)decoded[0] * n[0] + (double)decoded[1] * n[1] + (double)decoded[2] * n[2];
+            double sin = sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+            double e = atan2(sin, dot) * 180.0 / acos(-1.0);
+            norm_max = e > norm_max ? e : norm_max;
+            norm_sum += e;
+        }
+        if (flags & GPU_NORM)
+            v += (flags & GPU_NORM_OCT) ? 4 : 12;
+
+        if (flags & GPU_TEXCOORD_UNORM16) {
+            const float* t = src->texcoords + vert_i * 3;
+            for (uint32_t i = 0; i < 2; ++i) {
+                double e = fabs((double)read_unorm16(v + i * 2) - t[i]);
+                tex_max = e > tex_max ? e : tex_max;
+            }
+        }
+    }
+
+    double nverts = src->nverts ? (double)src->nverts : 1.0;
+    if (flags & (GPU_POS_SNORM16 | GPU_POS_HALF)) {
+        double extent = 2.0 * fmax(quant[0], fmax(quant[1], quant[2]));
+        printf("positions (%s): max error %g (%.5f%% of the size), rms %g\n",
+               (flags & GPU_POS_SNORM16) ? "int16" : "half", pos_max,
+               100.0 * pos_max / extent, sqrt(pos_sum / (3.0 * nverts)));
+    }
+    if (flags & GPU_NORM_OCT) {
+        printf("normals (octahedral): max error %.4f degrees, mean %.4f\n", norm_max,
+               norm_sum / nverts);
+    }
+    if (flags & GPU_TEXCOORD_UNORM16) {
+        printf("texcoords (uint16): max error %g, %.3f texels at 4096\n", tex_max,
+               tex_max * 4096.0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int interleave = 0;
+    int quantize = 0;
+    gpu_vtx_flags_t position_encoding = GPU_POS_SNORM16;
+
+    int arg_i = 1;
+    for (; arg_i < argc; ++arg_i) {
+        if (strcmp(argv[arg_i], "--interleave") == 0)
+            interleave = 1;
+        else if (strcmp(argv[arg_i], "--quantize") == 0)
+            quantize = 1;
+        else if (strcmp(argv[arg_i], "--half-positions") == 0)
+            position_encoding = GPU_POS_HALF;
+        else
+            break;
+    }
+
+    if (argc - arg_i != 2) {
+        fprintf(stderr, "usage: mesh_conv [--interleave] [--quantize [--half-positions]] "
+                        "<input mesh> <output mesh>\n");
+        return 1;
+    }
+
+    const char* in_path = argv[arg_i];
+    const char* out_path = argv[arg_i + 1];
+
+    rsrc_set_log(log_error);
+    rsrc_set_mem(malloc, free, realloc);
+
+    uint32_t in_size;
+    uint8_t* in = read_file(in_path, &in_size);
+    if (!in)
+        return 1;
+
+    struct rsrc_mesh mesh;
+    if (rsrc_mesh_load(&mesh, in, in_size) != RSRC_OK) {
+        fprintf(stderr, "mesh_conv: %s is not a mesh\n", in_path);
+        return 1;
+    }
+    free(in);
+
+    void* vertices = 0;
+    float position_quant[6];
+    if (quantize) {
+        if (!mesh.positions) {
+            fprintf(stderr, "mesh_conv: %s has no float positions to quantize\n", in_path);
+            return 1;
+        }
+
+        vertices = malloc((size_t)mesh.nverts * gpu_max_vert_bytes + 1);
+        if (!vertices) {
+            fprintf(stderr, "mesh_conv: out of memory\n");
+            return 1;
+        }
+
+        gpu_vtx_flags_t encodings = position_encoding | GPU_NORM_OCT;
+        if (mesh.texcoords && texcoords_in_unit_range(mesh.texcoords, mesh.nverts))
+            encodings |= GPU_TEXCOORD_UNORM16;
+        else if (mesh.texcoords)
+            printf("texcoords outside [0, 1], kept as floats\n");
+
+        fit_bounds(mesh.positions, mesh.nverts, position_quant);
+
+        mesh.vertex_layout = gpu_pack_verts_quantized(vertices, mesh.positions, mesh.normals,
+                                                      mesh.texcoords, mesh.nverts, encodings,
+                                                      position_quant);
+        mesh.vertex_size = gpu_vertex_size(mesh.vertex_layout);
+        mesh.vertices = vertices;
+        mesh.position_quant = position_quant;
+
+        report_error(&mesh, vertices, mesh.vertex_layout, position_quant);
+        printf("vertex size %u -> %u bytes\n",
+               gpu_vertex_size(mesh.vertex_layout & (GPU_POS | GPU_NORM | GPU_TEXCOORD)),
+               mesh.vertex_size);
+
+        mesh.positions = 0;
+        mesh.normals = 0;
+        mesh.texcoords = 0;
+    } else if (interleave && !mesh.vertices) {
+        vertices = malloc((size_t)mesh.nverts * gpu_max_vert_bytes + 1);
+        if (!vertices) {
+            fprintf(stderr, "mesh_conv: out of memory\n");
+            return 1;
+        }
+
+        mesh.vertex_layout = gpu_pack_verts(vertices, mesh.positions, mesh.normals,
+                                            mesh.texcoords, mesh.nverts);
+        mesh.vertex_size = gpu_vertex_size(mesh.vertex_layout);
+        mesh.vertices = vertices;
+
+        mesh.positions = 0;
+        mesh.normals = 0;
+        mesh.texcoords = 0;
+    }
+
+    uint64_t out_size = rsrc_mesh_buf_size(&mesh);
+    uint8_t* out = out_size <= UINT32_MAX ? malloc((size_t)out_size) : 0;
+    if (!out || rsrc_mesh_save(&mesh, out, (uint32_t)out_size) != RSRC_OK) {
+        fprintf(stderr, "mesh_conv: cannot convert %s\n", in_path);
+        return 1;
+    }
+
+    FILE* f = fopen(out_path, "wb");
+    if (!f || fwrite(out, 1, (size_t)out_size, f) != out_size) {
+        fprintf(stderr, "mesh_conv: cannot write %s\n", out_path);
+        if (f)
+            fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    printf("%s: %u vertices, %u indices, %u -> %llu bytes\n", out_path, mesh.nverts,
+           mesh.nindices, in_size, (unsigned long long)out_size);
+
+    free(out);
+    free(vertices);
+    rsrc_mesh_unload(&mesh);
+    return 0;
+}
@@ -0,0 +1,364 @@
+// Packs asset files into a single pak, mounted with file_mount_pak.
+//
+// Usage: pak_gen [--store] [--trace <trace>] <output pak> <files...>
+//
+// Every file is stored under its path as given, with '\\' turned into '/',
+// so it must match the path the game loads it by. Fails when two paths hash
+// to the same id.
+//
+// Files are compressed in blocks when that saves at least an eighth of their
+// size. --store keeps them all as is, so file_map never has to copy.
+//
+// --trace takes a file_trace_end output and puts the files in it first, in
+// the order they were loaded, so they are read front to back; the header
+// tells file_mount_pak how far to read ahead. The rest follow by path.
+
+#define SID_GEN_TOOL
+#include "../src/file.h"
+#include "../src/lz.h"
+#include "../src/string_id.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAK_GEN_MAX_PATH 256
+
+struct pak_file {
+    char path[PAK_GEN_MAX_PATH];
+    str_id id;
+    uint32_t rank; // first load in the trace, UINT32_MAX when not in it
+    uint64_t offset;
+    uint64_t size;
+
+    uint8_t* packed; // 0 when stored
+    uint64_t packed_size;
+};
+
+static int compare_files(const void* a, const void* b)
+{
+    return strcmp(((const struct pak_file*)a)->path, ((const struct pak_file*)b)->path);
+}
+
+static int compare_ranks(const void* a, const void* b)
+{
+    const struct pak_file* fa = a;
+    const struct pak_file* fb = b;
+    if (fa->rank != fb->rank)
+        return fa->rank < fb->rank ? -1 : 1;
+    return strcmp(fa->path, fb->path);
+}
+
+// Ranks the files by the first line of the trace naming them.
+static int read_trace(const char* path, struct pak_file* files, uint32_t nfiles)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "pak_gen: cannot open %s\n", path);
+        return 1;
+    }
+
+    uint32_t rank = 0;
+    unsigned long long offset, size;
+    char name[PAK_GEN_MAX_PATH];
+    while (fscanf(f, "%llu %llu %255[^\n]", &offset, &size, name) == 3) {
+        for (char* c = name; *c; ++c) {
+            if (*c == '\\')
+                *c = '/';
+        }
+
+        for (uint32_t i = 0; i < nfiles; ++i) {
+            if (files[i].rank == UINT32_MAX && strcmp(files[i].path, name) == 0)
+                files[i].rank = rank++;
+        }
+    }
+
+    int res = ferror(f) ? 1 : 0;
+    if (res)
+        fprintf(stderr, "pak_gen: cannot read %s\n", path);
+    fclose(f);
+    return res;
+}
+
+static uint64_t align(uint64_t offset)
+{
+    return (offset + FILE_PAK_ALIGN - 1) & ~(uint64_t)(FILE_PAK_ALIGN - 1);
+}
+
+static int file_size(const char* path, uint64_t* size)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "pak_gen: cannot open %s\n", path);
+        return 1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long s = ftell(f);
+    fclose(f);
+
+    if (s < 0) {
+        fprintf(stderr, "pak_gen: cannot read %s\n", path);
+        return 1;
+    }
+
+    *size = (uint64_t)s;
+    return 0;
+}
+
+// Compresses the file block by block into file->packed, leaves it stored
+// when that does not pay off.
+static int pack_file(struct pak_file* file)
+{
+    if (file->size == 0)
+        return 0;
+
+    uint8_t* data = malloc((size_t)file->size);
+    FILE* f = fopen(file->path, "rb");
+    if (!data || !f || fread(data, 1, (size_t)file->size, f) != file->size) {
+        fprintf(stderr, "pak_gen: cannot read %s\n", file->path);
+        if (f)
+            fclose(f);
+        free(data);
+        return 1;
+    }
+    fclose(f);
+
+    uint64_t nblocks = (file->size + FILE_PAK_BLOCK_SIZE - 1) / FILE_PAK_BLOCK_SIZE;
+    uint64_t table_size = nblocks * sizeof(uint32_t);
+    uint8_t* packed = malloc((size_t)(table_size + nblocks * lz_compress_bound(FILE_PAK_BLOCK_SIZE)));
+    if (!packed) {
+        fprintf(stderr, "pak_gen: out of memory\n");
+        free(data);
+        return 1;
+    }
+
+    uint32_t* table = (uint32_t*)packed;
+    uint64_t pos = table_size;
+    for (uint64_t b = 0; b < nblocks; ++b) {
+        uint64_t offset = b * FILE_PAK_BLOCK_SIZE;
+        size_t size = file->size - offset < FILE_PAK_BLOCK_SIZE ? (size_t)(file->size - offset)
+                                                                : FILE_PAK_BLOCK_SIZE;
+
+        size_t n = lz_compress(data + offset, size, packed + pos);
+        if (n < size) {
+            table[b] = (uint32_t)n;
+        } else {
+            memcpy(packed + pos, data + offset, size);
+            n = size;
+            table[b] = (uint32_t)n | FILE_PAK_BLOCK_STORED;
+        }
+        pos += n;
+    }
+
+    free(data);
+
+    if (pos > file->size - file->size / 8) {
+        free(packed);
+        return 0;
+    }
+
+    file->packed = packed;
+    file->packed_size = pos;
+    return 0;
+}
+
+static int copy_file(FILE* out, const struct pak_file* file)
+{
+    FILE* f = fopen(file->path, "rb");
+    if (!f) {
+        fprintf(stderr, "pak_gen: cannot open %s\n", file->path);
+        return 1;
+    }
+
+    static uint8_t buf[1 << 16];
+    uint64_t left = file->size;
+    while (left) {
+        size_t n = left < sizeof(buf) ? (size_t)left : sizeof(buf);
+        if (fread(buf, 1, n, f) != n || fwrite(buf, 1, n, out) != n) {
+            fprintf(stderr, "pak_gen: cannot copy %s\n", file->path);
+            fclose(f);
+            return 1;
+        }
+        left -= n;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static int write_pak(const char* path, const struct pak_file* files, uint32_t nfiles,
+                     uint32_t nslots, uint64_t toc_end, uint32_t hot_pages)
+{
+    uint8_t* head = calloc(1, (size_t)toc_end);
+    if (!head) {
+        fprintf(stderr, "pak_gen: out of memory\n");
+        return 1;
+    }
+
+    *(struct file_pak_header*)head = (struct file_pak_header){
+        .magic = FILE_PAK_MAGIC,
+        .nentries = nfiles,
+        .nslots = nslots,
+        .hot_pages = hot_pages,
+    };
+
+    struct file_pak_entry* toc = (struct file_pak_entry*)(head + sizeof(struct file_pak_header));
+    for (uint32_t i = 0; i < nfiles; ++i) {
+        uint32_t slot = file_pak_slot(files[i].id, nslots);
+        while (toc[slot].id != 0)
+            slot = (slot + 1) & (nslots - 1);
+
+        toc[slot] = (struct file_pak_entry){
+            .id = files[i].id,
+            .offset = files[i].offset,
+            .size = files[i].size,
+            .packed_size = files[i].packed_size,
+        };
+    }
+
+    FILE* out = fopen(path, "wb");
+    if (!out || fwrite(head, 1, (size_t)toc_end, out) != toc_end) {
+        fprintf(stderr, "pak_gen: cannot write %s\n", path);
+        if (out)
+            fclose(out);
+        free(head);
+        return 1;
+    }
+    free(head);
+
+    uint64_t pos = toc_end;
+    for (uint32_t i = 0; i < nfiles; ++i) {
+        static const uint8_t zeros[FILE_PAK_ALIGN];
+        size_t pad = (size_t)(files[i].offset - pos);
+        if (fwrite(zeros, 1, pad, out) != pad) {
+            fprintf(stderr, "pak_gen: cannot write %s\n", path);
+            fclose(out);
+            return 1;
+        }
+
+        if (files[i].packed) {
+            size_t n = (size_t)files[i].packed_size;
+            if (fwrite(files[i].packed, 1, n, out) != n) {
+                fprintf(stderr, "pak_gen: cannot write %s\n", path);
+                fclose(out);
+                return 1;
+            }
+            pos = files[i].offset + files[i].packed_size;
+        } else {
+            if (copy_file(out, &files[i]) != 0) {
+                fclose(out);
+                return 1;
+            }
+            pos = files[i].offset + files[i].size;
+        }
+    }
+
+    fclose(out);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int store = 0;
+    const char* trace_path = 0;
+
+    int arg_i = 1;
+    for (; arg_i < argc; ++arg_i) {
+        if (strcmp(argv[arg_i], "--store") == 0)
+            store = 1;
+        else if (strcmp(argv[arg_i], "--trace") == 0 && arg_i + 1 < argc)
+            trace_path = argv[++arg_i];
+        else
+            break;
+    }
+
+    if (arg_i >= argc) {
+        fprintf(stderr, "usage: pak_gen [--store] [--trace <trace>] <output pak> <files...>\n");
+        return 1;
+    }
+
+    const char* out_path = argv[arg_i++];
+
+    struct pak_file* files = calloc(argc, sizeof(struct pak_file));
+    if (!files) {
+        fprintf(stderr, "pak_gen: out of memory\n");
+        return 1;
+    }
+
+    uint32_t nfiles = 0;
+    for (int i = arg_i; i < argc; ++i) {
+        // A previous pak may be among the inputs.
+        if (strcmp(argv[i], out_path) == 0)
+            continue;
+
+        size_t len = strlen(argv[i]);
+        if (len >= PAK_GEN_MAX_PATH) {
+            fprintf(stderr, "pak_gen: path too long: %s\n", argv[i]);
+            return 1;
+        }
+
+        struct pak_file* f = &files[nfiles];
+        for (size_t c = 0; c <= len; ++c)
+            f->path[c] = argv[i][c] == '\\' ? '/' : argv[i][c];
+        f->id = str_id_hash(f->path);
+        f->rank = UINT32_MAX;
+
+        if (file_size(f->path, &f->size) != 0)
+            return 1;
+
+        ++nfiles;
+    }
+
+    qsort(files, nfiles, sizeof(struct pak_file), compare_files);
+
+    // Drop repeated paths, and stop on different ones with the same id.
+    uint32_t nunique = 0;
+    for (uint32_t i = 0; i < nfiles; ++i) {
+        if (nunique && strcmp(files[nunique - 1].path, files[i].path) == 0)
+            continue;
+
+        for (uint32_t j = 0; j < nunique; ++j) {
+            if (files[j].id == files[i].id) {
+                fprintf(stderr, "pak_gen: \"%s\" and \"%s\" have the same id, rename one of them\n",
+                        files[j].path, files[i].path);
+                return 1;
+            }
+        }
+
+        files[nunique++] = files[i];
+    }
+    nfiles = nunique;
+
+    if (trace_path) {
+        if (read_trace(trace_path, files, nfiles) != 0)
+            return 1;
+        qsort(files, nfiles, sizeof(struct pak_file), compare_ranks);
+    }
+
+    // At most half full, so probes stay short.
+    uint32_t nslots = 2;
+    while (nslots < nfiles * 2)
+        nslots *= 2;
+
+    uint64_t toc_end = sizeof(struct file_pak_header) + (uint64_t)nslots * sizeof(struct file_pak_entry);
+    uint64_t offset = toc_end;
+    uint32_t hot_pages = 0;
+    for (uint32_t i = 0; i < nfiles; ++i) {
+        if (!store && pack_file(&files[i]) != 0)
+            return 1;
+
+        files[i].offset = align(offset);
+        offset = files[i].offset + (files[i].packed ? files[i].packed_size : files[i].size);
+
+        if (files[i].rank != UINT32_MAX)
+            hot_pages = (uint32_t)(align(offset) / FILE_PAK_ALIGN);
+    }
+
+    int res = write_pak(out_path, files, nfiles, nslots, toc_end, hot_pages);
+
+    for (uint32_t i = 0; i < nfiles; ++i)
+        free(files[i].packed);
+    free(files);
+    return res;
+}
@@ -0,0 +1,404 @@
+// Generates the header with build-time string ids and the offline string
+// table.
+//
+// Usage: sid_gen <output header> <source files...>
+//        sid_gen --blob [--strip] <output blob> <source files...>
+//                [--names <names...>]
+//
+// Scans the sources for SID(name) and writes a SID_name define with the
+// str_id of every distinct name. Fails when two names hash to the same id, so
+// collisions are caught before anything runs.
+//
+// With --blob it instead writes the table loaded by str_id_load_table, with
+// the SID names plus the literal --names (e.g. asset paths, with '\\'
+// turned into '/'). --strip leaves out the strings and keeps only the index.
+//
+// Outputs are only rewritten when they change.
+
+#define SID_GEN_TOOL
+#include "../src/string_id.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SID_GEN_MAX_NAME 128
+
+struct sid_name {
+    char str[SID_GEN_MAX_NAME];
+    str_id id;
+};
+
+static struct sid_name* names = 0;
+static uint32_t nnames = 0;
+static uint32_t names_capacity = 0;
+
+static int is_ident_char(int c)
+{
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+static int add_name(const char* str, size_t len)
+{
+    if (len >= SID_GEN_MAX_NAME) {
+        fprintf(stderr, "sid_gen: name too long: %.*s\n", (int)len, str);
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < nnames; ++i) {
+        if (strlen(names[i].str) != len)
+            continue;
+
+        size_t c = 0;
+        while (c < len && names[i].str[c] == (str[c] == '\\' ? '/' : str[c]))
+            ++c;
+
+        if (c == len)
+            return 0;
+    }
+
+    if (nnames == names_capacity) {
+        names_capacity = names_capacity ? names_capacity * 2 : 256;
+        names = realloc(names, sizeof(struct sid_name) * names_capacity);
+        if (!names) {
+            fprintf(stderr, "sid_gen: out of memory\n");
+            return 1;
+        }
+    }
+
+    struct sid_name* n = &names[nnames++];
+    for (size_t i = 0; i < len; ++i)
+        n->str[i] = str[i] == '\\' ? '/' : str[i];
+    n->str[len] = '\0';
+    n->id = str_id_hash(n->str);
+
+    return 0;
+}
+
+// True for the SID( of "#define SID(name)", which the generated header has
+// and which must not add a "name" entry, whatever the output mode.
+static int is_define(const char* buf, const char* c)
+{
+    while (c > buf && (c[-1] == ' ' || c[-1] == '\t'))
+        --c;
+    if (c - buf < 6 || strncmp(c - 6, "define", 6) != 0)
+        return 0;
+    c -= 6;
+    while (c > buf && (c[-1] == ' ' || c[-1] == '\t'))
+        --c;
+    return c > buf && c[-1] == '#';
+}
+
+static int scan_file(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "sid_gen: cannot open %s\n", path);
+        return 1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char* buf = malloc(size + 1);
+    if (!buf || fread(buf, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "sid_gen: cannot read %s\n", path);
+        fclose(f);
+        free(buf);
+        return 1;
+    }
+    buf[size] = '\0';
+    fclose(f);
+
+    int res = 0;
+    for (const char* c = buf; (c = strstr(c, "SID(")) != 0; c += 4) {
+        if ((c > buf && is_ident_char(c[-1])) || is_define(buf, c))
+            continue;
+
+        const char* name = c + 4;
+        size_t len = 0;
+        while (is_ident_char(name[len]))
+            ++len;
+
+        if (len == 0 || name[len] != ')')
+            continue;
+
+        if (add_name(name, len) != 0) {
+            res = 1;
+            break;
+        }
+    }
+
+    free(buf);
+    return res;
+}
+
+static int compare_names(const void* a, const void* b)
+{
+    return strcmp(((const struct sid_name*)a)->str, ((const struct sid_name*)b)->str);
+}
+
+static int write_if_changed(const char* path, const void* data, size_t size)
+{
+    FILE* f = fopen(path, "rb");
+    if (f) {
+        char* old = malloc(size + 1);
+        size_t old_size = old ? fread(old, 1, size + 1, f) : 0;
+        fclose(f);
+
+        int same = old && old_size == size && memcmp(old, data, size) == 0;
+        free(old);
+        if (same)
+            return 0;
+    }
+
+    f = fopen(path, "wb");
+    if (!f || fwrite(data, 1, size, f) != size) {
+        fprintf(stderr, "sid_gen: cannot write %s\n", path);
+        if (f)
+            fclose(f);
+        return 1;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static int write_header(const char* path)
+{
+    size_t out_capacity = 1024 + (size_t)nnames * (SID_GEN_MAX_NAME * 2 + 64);
+    char* out = malloc(out_capacity);
+    if (!out) {
+        fprintf(stderr, "sid_gen: out of memory\n");
+        return 1;
+    }
+
+    size_t out_size = 0;
+    out_size += snprintf(out + out_size, out_capacity - out_size,
+                         "// Generated by tools/sid_gen.c from the SID uses in src, do not edit.\n"
+                         "\n"
+                         "#pragma once\n"
+                         "\n"
+                         "#define SID(name) SID_##name\n"
+                         "\n");
+
+    for (uint32_t i = 0; i < nnames; ++i) {
+        out_size += snprintf(out + out_size, out_capacity - out_size,
+                             "#define SID_%s 0x%016llxull\n",
+                             names[i].str, (unsigned long long)names[i].id);
+    }
+
+    int res = write_if_changed(path, out, out_size);
+    free(out);
+    return res;
+}
+
+// Hash and displace: names are spread over buckets, and every bucket, largest
+// first, gets the first displacement that moves all its names into free
+// slots. Returns 0 when some bucket found none.
+static int build_index(uint32_t nbuckets, uint32_t* displacements, int32_t* slot_names)
+{
+    uint32_t* bucket_sizes = calloc(nbuckets, sizeof(uint32_t));
+    uint32_t* order = malloc(sizeof(uint32_t) * nbuckets);
+    uint32_t* members = malloc(sizeof(uint32_t) * (nnames + 1));
+    uint32_t* slots = malloc(sizeof(uint32_t) * (nnames + 1));
+    if (!bucket_sizes || !order || !members || !slots) {
+        fprintf(stderr, "sid_gen: out of memory\n");
+        exit(1);
+    }
+
+    for (uint32_t i = 0; i < nnames; ++i)
+        ++bucket_sizes[str_id_blob_bucket(names[i].id, nbuckets)];
+
+    // Buckets sorted by size, largest first
+    for (uint32_t b = 0; b < nbuckets; ++b) {
+        uint32_t j = b;
+        while (j > 0 && bucket_sizes[order[j - 1]] < bucket_sizes[b]) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = b;
+    }
+
+    for (uint32_t i = 0; i < nnames; ++i)
+        slot_names[i] = -1;
+
+    int res = 1;
+    for (uint32_t ob = 0; ob < nbuckets && res; ++ob) {
+        uint32_t b = order[ob];
+        displacements[b] = 0;
+        if (bucket_sizes[b] == 0)
+            continue;
+
+        uint32_t nmembers = 0;
+        for (uint32_t i = 0; i < nnames; ++i) {
+            if (str_id_blob_bucket(names[i].id, nbuckets) == b)
+                members[nmembers++] = i;
+        }
+
+        uint32_t d = 0;
+        for (; d < (1u << 20); ++d) {
+            uint32_t m = 0;
+            for (; m < nmembers; ++m) {
+                uint32_t slot = str_id_blob_slot(names[members[m]].id, d, nnames);
+                if (slot_names[slot] != -1)
+                    break;
+
+                uint32_t prev = 0;
+                while (prev < m && slots[prev] != slot)
+                    ++prev;
+                if (prev < m)
+                    break;
+
+                slots[m] = slot;
+            }
+
+            if (m == nmembers)
+                break;
+        }
+
+        if (d == (1u << 20)) {
+            res = 0;
+            break;
+        }
+
+        displacements[b] = d;
+        for (uint32_t m = 0; m < nmembers; ++m)
+            slot_names[slots[m]] = (int32_t)members[m];
+    }
+
+    free(bucket_sizes);
+    free(order);
+    free(members);
+    free(slots);
+    return res;
+}
+
+static int write_blob(const char* path, int strip)
+{
+    uint32_t nbuckets = nnames / 4 + 1;
+    uint32_t* displacements = 0;
+    int32_t* slot_names = malloc(sizeof(int32_t) * (nnames + 1));
+
+    for (;;) {
+        displacements = realloc(displacements, sizeof(uint32_t) * nbuckets);
+        if (!displacements || !slot_names) {
+            fprintf(stderr, "sid_gen: out of memory\n");
+            return 1;
+        }
+
+        if (build_index(nbuckets, displacements, slot_names))
+            break;
+
+        nbuckets *= 2;
+    }
+
+    size_t strings_size = 0;
+    if (!strip) {
+        for (uint32_t i = 0; i < nnames; ++i)
+            strings_size += strlen(names[i].str) + 1;
+    }
+
+    size_t displacements_size = (sizeof(uint32_t) * nbuckets + 7) & ~(size_t)7;
+    size_t entries_size = sizeof(struct str_id_blob_entry) * nnames;
+    size_t size = sizeof(struct str_id_blob_header) + displacements_size + entries_size + strings_size;
+
+    uint8_t* out = calloc(1, size);
+    if (!out) {
+        fprintf(stderr, "sid_gen: out of memory\n");
+        return 1;
+    }
+
+    *(struct str_id_blob_header*)out = (struct str_id_blob_header){
+        .magic = STR_ID_BLOB_MAGIC,
+        .nentries = nnames,
+        .nbuckets = nbuckets,
+        .strings_size = (uint32_t)strings_size,
+    };
+
+    uint8_t* b = out + sizeof(struct str_id_blob_header);
+    memcpy(b, displacements, sizeof(uint32_t) * nbuckets);
+
+    struct str_id_blob_entry* entries = (struct str_id_blob_entry*)(b + displacements_size);
+    char* strings = (char*)(b + displacements_size + entries_size);
+    uint32_t str_offset = 0;
+    for (uint32_t slot = 0; slot < nnames; ++slot) {
+        const struct sid_name* n = &names[slot_names[slot]];
+        uint32_t len = (uint32_t)strlen(n->str);
+
+        entries[slot] = (struct str_id_blob_entry){ .id = n->id };
+        if (!strip) {
+            entries[slot].str_offset = str_offset;
+            entries[slot].str_len = len;
+            memcpy(strings + str_offset, n->str, len + 1);
+            str_offset += len + 1;
+        }
+    }
+
+    int res = write_if_changed(path, out, size);
+
+    free(out);
+    free(displacements);
+    free(slot_names);
+    return res;
+}
+
+int main(int argc, char** argv)
+{
+    int blob = 0;
+    int strip = 0;
+
+    int arg_i = 1;
+    for (; arg_i < argc && argv[arg_i][0] == '-' && argv[arg_i][1] == '-'; ++arg_i) {
+        if (strcmp(argv[arg_i], "--blob") == 0)
+            blob = 1;
+        else if (strcmp(argv[arg_i], "--strip") == 0)
+            strip = 1;
+        else
+            break;
+    }
+
+    if (arg_i >= argc || (strip && !blob)) {
+        fprintf(stderr, "usage: sid_gen <output header> <source files...>\n"
+                        "       sid_gen --blob [--strip] <output blob> <source files...> [--names <names...>]\n");
+        return 1;
+    }
+
+    const char* out_path = argv[arg_i++];
+
+    int literal_names = 0;
+    for (; arg_i < argc; ++arg_i) {
+        if (!literal_names && strcmp(argv[arg_i], "--names") == 0) {
+            literal_names = 1;
+            continue;
+        }
+
+        if (literal_names) {
+            if (add_name(argv[arg_i], strlen(argv[arg_i])) != 0)
+                return 1;
+            continue;
+        }
+
+        if (scan_file(argv[arg_i]) != 0)
+            return 1;
+    }
+
+    qsort(names, nnames, sizeof(struct sid_name), compare_names);
+
+    int collisions = 0;
+    for (uint32_t i = 0; i < nnames; ++i) {
+        for (uint32_t j = i + 1; j < nnames; ++j) {
+            if (names[i].id == names[j].id) {
+                fprintf(stderr, "sid_gen: \"%s\" and \"%s\" have the same id, rename one of them\n",
+                        names[i].str, names[j].str);
+                collisions = 1;
+            }
+        }
+    }
+
+    if (collisions)
+        return 1;
+
+    return blob ? write_blob(out_path, strip) : write_header(out_path);
+}